@@ -22,6 +22,7 @@
 
 #include "myheader.h"
 #include "mainwindow.h"
+#include "batchreport.h"
 #include "version.h"
 
 char *glbExeFileName;
@@ -35,6 +36,18 @@ extern void show_splash();
 */
 int main(int argc, char *argv[])
 {
+    /* -b writes reports for the records given without opening any windows */
+    for ( int a = 1 ; a < argc ; a++ ) {
+        if ( QString(argv[a]) == "-b" ) {
+            if ( qgetenv("QT_QPA_PLATFORM").isEmpty() ) {
+                qputenv( "QT_QPA_PLATFORM", "offscreen" );
+            }
+            QApplication app(argc, argv);
+            glbExeFileName = argv[0];
+            return run_batch( app.arguments().mid(1) );
+        }
+    }
+
     QApplication app(argc, argv);
 
     glbExeFileName = argv[0];
@@ -0,0 +1,357 @@
+/**
+ * @file batchreport.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtWidgets>
+#include <QtConcurrent>
+
+#include "myheader.h"
+#include "showsignal.h"
+#include "fulldisclosure.h"
+#include "batchreport.h"
+
+
+/** {{{ BatchReport::BatchReport( const QString &fileName, const QString &outputDir, int rasterDpi, QObject *parent )
+ */
+BatchReport::BatchReport( const QString &fileName, const QString &outputDir, int rasterDpi, QObject *parent )
+	: QObject(parent),
+	  m_fileName(fileName),
+	  m_outputDir(outputDir),
+	  m_rasterDpi(rasterDpi),
+	  m_ok(false),
+	  m_ecgdata(NULL)
+{
+	setAutoDelete( false );
+}
+/* }}} */
+
+
+/** {{{ BatchReport::~BatchReport()
+ */
+BatchReport::~BatchReport()
+{
+	EcgData::release( m_ecgdata );
+}
+/* }}} */
+
+
+/** {{{ QString BatchReport::output_name( const QString &suffix )
+    @brief Name of an output file: the record's base name, a dash and suffix
+*/
+QString BatchReport::output_name( const QString &suffix )
+{
+	QFileInfo record( m_fileName );
+	QDir dir( m_outputDir.isEmpty() ? record.absolutePath() : m_outputDir );
+	return dir.filePath( QString("%1-%2").arg( EcgData::record_name( m_fileName ) ).arg( suffix ) );
+}
+/* }}} */
+
+
+/** {{{ void BatchReport::run()
+    @brief Load the record and write everything that does not need a widget
+*/
+void BatchReport::run()
+{
+	QString recordName = m_fileName;
+	QFuture<BeatStore> annotations = QtConcurrent::run( [recordName]() {
+		BeatStore found;
+		EcgData::read_annotations( recordName, "atr", found );
+		return found;
+	} );
+
+	m_ecgdata = new EcgData();
+	m_ecgdata->open( m_fileName );
+	m_ecgdata->beats = annotations.result();
+	if ( m_ecgdata->beats.isEmpty() && m_ecgdata->datalen_secs > 0 ) {
+		m_ecgdata->detect_beats();
+	}
+
+	if ( m_ecgdata->datalen_secs > 0 ) {
+		m_ecgdata->edits.load( m_ecgdata->journal_file_name(), m_ecgdata->beats );
+		m_ecgdata->index_annotations();
+
+		FullDisclosureExporter exporter( m_ecgdata, 0, 0, 10 );
+		exporter.setPageLayout( QPageLayout( QPageSize( QPageSize::Letter ), QPageLayout::Portrait, QMarginsF( 5, 10, 5, 10 ), QPageLayout::Millimeter ) );
+		exporter.setResolution( 1200 );
+		exporter.setRasterDpi( m_rasterDpi );
+		m_ok = exporter.exportPdf( output_name( "full.pdf" ) );
+
+		m_ok = write_summary() && m_ok;
+	} else {
+		qDebug() << qPrintable( QString("%1: no ECG data could be loaded").arg( m_fileName ) );
+	}
+
+	m_ecgdata->moveToThread( thread() );
+	QMetaObject::invokeMethod( this, "render_strips", Qt::QueuedConnection );
+}
+/* }}} */
+
+
+/** {{{ void BatchReport::render_strips()
+    @brief Write the strip PDF; runs on the thread that owns the report
+*/
+void BatchReport::render_strips()
+{
+	if ( m_ecgdata && m_ecgdata->datalen_secs > 0 ) {
+		/* the view takes over the data */
+		ShowSignal *ss = new ShowSignal( 0, m_ecgdata );
+		m_ecgdata = NULL;
+
+		QVector<long> positions;
+		long samps_per_sec = ss->m_ecgdata->samps_per_chan_per_sec;
+		for ( long secs = 0 ; secs + ECG_DISPLAY_WINDOW_SIZE_SECONDS <= ss->m_ecgdata->datalen_secs ; secs += BATCH_STRIP_INTERVAL_SECS ) {
+			positions.append( secs * samps_per_sec );
+		}
+
+		QPrinter printer(QPrinter::HighResolution);
+		printer.setPaperSize(QPrinter::Letter);
+		printer.setPageMargins( 5, 10, 5, 10, QPrinter::Millimeter );
+		printer.setOutputFormat(QPrinter::PdfFormat);
+		printer.setOutputFileName( output_name( "strips.pdf" ) );
+		ss->printRenderStripPages( &printer, positions );
+
+		delete ss;
+	}
+
+	qDebug() << qPrintable( QString("%1: %2").arg( m_fileName ).arg( m_ok ? "done" : "FAILED" ) );
+
+	emit finished();
+}
+/* }}} */
+
+
+/** {{{ bool BatchReport::write_summary()
+    @brief Write a plain text summary of the record and its annotations
+*/
+bool BatchReport::write_summary()
+{
+	QFile file( output_name( "summary.txt" ) );
+	if ( ! file.open( QIODevice::WriteOnly | QIODevice::Text ) ) {
+		return false;
+	}
+
+	/* isqrs() and annstr() go through WFDB's globals */
+	QMutexLocker locker( &glb_wfdb_mutex );
+
+	long samps_per_sec = m_ecgdata->samps_per_chan_per_sec;
+	int minutes = m_ecgdata->datalen_secs / 60;
+
+	QMap<int,int> countsByType;
+	QVector<int> beatsPerMinute( minutes + 1, 0 );
+	long qrsCount = 0;
+	const BeatStore &beats = m_ecgdata->beats;
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		countsByType[beats.type(b)]++;
+		if ( isqrs( beats.type(b) ) ) {
+			qrsCount++;
+			int minute = beats.pos(b) / samps_per_sec / 60;
+			if ( minute >= 0 && minute < beatsPerMinute.size() ) {
+				beatsPerMinute[minute]++;
+			}
+		}
+	}
+
+	/* only whole minutes count towards the heart rate range */
+	int hrMin = 0;
+	int hrMax = 0;
+	for ( int m = 0 ; m < minutes ; m++ ) {
+		if ( m == 0 || beatsPerMinute[m] < hrMin ) {
+			hrMin = beatsPerMinute[m];
+		}
+		if ( m == 0 || beatsPerMinute[m] > hrMax ) {
+			hrMax = beatsPerMinute[m];
+		}
+	}
+
+	QTextStream out( &file );
+	out << "Record: " << m_fileName << "\n";
+	out << "Start: " << m_ecgdata->viewableDateTime.toString("yyyy-MM-dd hh:mm:ss") << "\n";
+	out << "Duration: " << QString("%1:%2:%3")
+		.arg( m_ecgdata->datalen_secs / 3600 )
+		.arg( (m_ecgdata->datalen_secs / 60) % 60, 2, 10, QLatin1Char('0') )
+		.arg( m_ecgdata->datalen_secs % 60, 2, 10, QLatin1Char('0') ) << "\n";
+	out << "Sample rate: " << samps_per_sec << " Hz\n";
+	out << "Channels: " << m_ecgdata->channel_count << "\n";
+	out << "Annotations: " << m_ecgdata->beats.size() << "\n";
+	out << "Beats: " << qrsCount << "\n";
+	if ( m_ecgdata->datalen_secs > 0 ) {
+		out << "Mean heart rate: " << qRound( qrsCount * 60.0 / m_ecgdata->datalen_secs ) << " bpm\n";
+	}
+	if ( minutes > 0 ) {
+		out << "Minute heart rate range: " << hrMin << " - " << hrMax << " bpm\n";
+	}
+	out << "Pacer spikes: " << m_ecgdata->pacer.size() << "\n";
+	if ( ! m_ecgdata->pacer.isEmpty() ) {
+		PacingStats paced = m_ecgdata->pacer.pacing( 0, m_ecgdata->size() );
+		out << QString("Paced beats: %1 (%2%)\n").arg( paced.paced ).arg( paced.percent(), 0, 'f', 1 );
+
+		QVector<PacingStats> hours = m_ecgdata->pacer.perHour();
+		out << "Hourly pacing (spikes, paced beats, %):\n";
+		for ( int h = 0 ; h < hours.size() ; h++ ) {
+			out << QString("  %1: %2, %3, %4%\n").arg( h, 2 )
+				.arg( hours[h].spikes ).arg( hours[h].paced ).arg( hours[h].percent(), 0, 'f', 1 );
+		}
+	}
+
+	for ( QMap<int,int>::const_iterator it = countsByType.constBegin() ; it != countsByType.constEnd() ; ++it ) {
+		out << "  " << annstr( it.key() ) << ": " << it.value() << "\n";
+	}
+
+	const HrvStats &hrv = m_ecgdata->rr.stats();
+	if ( hrv.count > 0 ) {
+		out << "NN intervals: " << hrv.count << "\n";
+		out << QString("HR mean/min/max: %1 / %2 / %3 bpm\n")
+			.arg( qRound( hrv.meanHR ) ).arg( qRound( hrv.minHR ) ).arg( qRound( hrv.maxHR ) );
+		out << QString("SDNN: %1 ms  SDANN: %2 ms  RMSSD: %3 ms  pNN50: %4%\n")
+			.arg( hrv.sdnn, 0, 'f', 1 ).arg( hrv.sdann, 0, 'f', 1 ).arg( hrv.rmssd, 0, 'f', 1 ).arg( hrv.pnn50 * 100, 0, 'f', 1 );
+
+		const QVector<HrBucket> &hours = m_ecgdata->rr.perHour();
+		out << "Hourly HR (mean/min/max):\n";
+		for ( int h = 0 ; h < hours.size() ; h++ ) {
+			if ( hours[h].count > 0 ) {
+				out << QString("  %1: %2 / %3 / %4\n").arg( h, 2 )
+					.arg( qRound( hours[h].meanHR ) ).arg( qRound( hours[h].minHR ) ).arg( qRound( hours[h].maxHR ) );
+			}
+		}
+	}
+
+	const EpisodeIndex &episodes = m_ecgdata->episodes;
+	if ( episodes.kindCount() > 0 ) {
+		out << "Episodes:\n";
+	}
+	for ( int kind = 0 ; kind < episodes.kindCount() ; kind++ ) {
+		long secs = episodes.totalLength( kind ) / qMax( 1L, samps_per_sec );
+		out << "  " << episodes.kindName( kind ) << ": " << episodes.count( kind )
+			<< QString(", %1:%2:%3")
+				.arg( secs / 3600 )
+				.arg( (secs / 60) % 60, 2, 10, QLatin1Char('0') )
+				.arg( secs % 60, 2, 10, QLatin1Char('0') )
+			<< QString(", %1%").arg( episodes.burden( kind ) * 100, 0, 'f', 1 ) << "\n";
+	}
+
+	return out.status() == QTextStream::Ok;
+}
+/* }}} */
+
+
+/** {{{ static void add_records( QStringList &records, const QString &arg )
+    @brief Add a record name, a wildcard pattern, or (with a leading @) every line of a list file
+*/
+static void add_records( QStringList &records, const QString &arg )
+{
+	if ( arg.startsWith("@") ) {
+		QFile list( arg.mid(1) );
+		if ( list.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+			QTextStream in( &list );
+			while ( ! in.atEnd() ) {
+				QString line = in.readLine().trimmed();
+				if ( ! line.isEmpty() && ! line.startsWith("#") ) {
+					add_records( records, line );
+				}
+			}
+		} else {
+			qDebug() << qPrintable( QString("cannot read record list %1").arg( list.fileName() ) );
+		}
+	} else if ( arg.contains( QRegExp("[*?\\[]") ) ) {
+		QFileInfo pattern( arg );
+		QDir dir( pattern.path() );
+		foreach ( QString name, dir.entryList( QStringList( pattern.fileName() ), QDir::Files, QDir::Name ) ) {
+			records.append( dir.filePath( name ) );
+		}
+	} else {
+		records.append( arg );
+	}
+}
+/* }}} */
+
+
+/** {{{ int run_batch( const QStringList &args )
+    @brief Write the reports of every record named in args, several at a time
+
+    Options:
+      -o dir    write the reports into dir instead of next to each record
+      -j count  how many records to process at once (default: one per core)
+      -r dpi    rasterize the full disclosure rows at dpi instead of writing vectors
+
+    @return 0 if every record was reported, 1 otherwise
+*/
+int run_batch( const QStringList &args )
+{
+	QSettings settings("Datrix", "DatrixECGViewer");
+	QString outputDir;
+	int jobs = QThread::idealThreadCount();
+	int rasterDpi = settings.value( "FullDisclosureRasterDpi", 0 ).toInt();
+	QStringList records;
+
+	for ( int a = 0 ; a < args.size() ; a++ ) {
+		if ( args[a] == "-o" && a + 1 < args.size() ) {
+			outputDir = args[++a];
+		} else if ( args[a] == "-j" && a + 1 < args.size() ) {
+			jobs = args[++a].toInt();
+		} else if ( args[a] == "-r" && a + 1 < args.size() ) {
+			rasterDpi = args[++a].toInt();
+		} else if ( args[a].startsWith("-") ) {
+			/* -b and the like are handled by main() */
+		} else {
+			add_records( records, args[a] );
+		}
+	}
+
+	if ( records.isEmpty() ) {
+		qDebug() << "batch mode: no records given";
+		return 1;
+	}
+
+	if ( ! outputDir.isEmpty() ) {
+		QDir().mkpath( outputDir );
+	}
+
+	QThreadPool pool;
+	pool.setMaxThreadCount( qMax( 1, jobs ) );
+
+	QEventLoop loop;
+	int remaining = records.size();
+	QList<BatchReport *> reports;
+	foreach ( QString record, records ) {
+		BatchReport *report = new BatchReport( record, outputDir, rasterDpi );
+		QObject::connect( report, &BatchReport::finished, [&]() {
+			if ( --remaining == 0 ) {
+				loop.quit();
+			}
+		} );
+		reports.append( report );
+		pool.start( report );
+	}
+
+	loop.exec();
+	pool.waitForDone();
+
+	int failures = 0;
+	foreach ( BatchReport *report, reports ) {
+		if ( ! report->succeeded() ) {
+			failures++;
+		}
+	}
+	qDeleteAll( reports );
+
+	qDebug() << qPrintable( QString("batch mode: %1 of %2 records reported").arg( records.size() - failures ).arg( records.size() ) );
+
+	return failures ? 1 : 0;
+}
+/* }}} */
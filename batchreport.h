@@ -0,0 +1,71 @@
+/**
+ * @file batchreport.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BATCHREPORT_H
+#define BATCHREPORT_H
+
+#include <QtWidgets>
+#include "ecgdata.h"
+
+
+#define BATCH_STRIP_INTERVAL_SECS	(60 * 60)	/**< one page of strips for every hour of recording */
+
+
+/* {{{ class BatchReport
+   @brief	Writes the reports of one record without opening any windows
+
+   run() loads the record, writes the full disclosure PDF and the summary on
+   a pool thread.  The strip PDF is drawn by a ShowSignal, a widget, so that
+   part is handed back to the thread the report was created on.
+*/
+class BatchReport : public QObject, public QRunnable
+{
+	Q_OBJECT
+
+public:
+	BatchReport( const QString &fileName, const QString &outputDir, int rasterDpi, QObject *parent = 0 );
+	~BatchReport();
+
+	void run();
+	bool succeeded() const { return m_ok; }
+	QString fileName() const { return m_fileName; }
+
+signals:
+	void finished();
+
+private slots:
+	void render_strips();
+
+private:
+	QString output_name( const QString &suffix );
+	bool write_summary();
+
+	QString m_fileName;
+	QString m_outputDir;
+	int m_rasterDpi;
+	bool m_ok;
+
+	EcgData *m_ecgdata;
+};
+/* }}} */
+
+
+int run_batch( const QStringList &args );
+
+#endif // BATCHREPORT_H
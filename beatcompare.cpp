@@ -0,0 +1,269 @@
+/**
+ * @file beatcompare.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include "wfdb/ecgcodes.h"
+#include "beatcompare.h"
+
+
+/** {{{ static QVector<int> beat_indexes( const BeatStore &beats )
+    @brief The annotations of beats that are heart beats, in order
+*/
+static QVector<int> beat_indexes( const BeatStore &beats )
+{
+	QVector<int> indexes;
+	indexes.reserve( beats.size() );
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		if ( BeatStore::isBeat( beats.type( b ) ) ) {
+			indexes.append( b );
+		}
+	}
+	return indexes;
+}
+/* }}} */
+
+
+/** {{{ BeatComparison::BeatComparison()
+ */
+BeatComparison::BeatComparison()
+{
+	clear();
+}
+/* }}} */
+
+
+/** {{{ void BeatComparison::clear()
+ */
+void BeatComparison::clear()
+{
+	memset( m_matrix, 0, sizeof(m_matrix) );
+	m_mismatches.clear();
+	m_agrees.clear();
+}
+/* }}} */
+
+
+/** {{{ int BeatComparison::aamiClass( int type )
+    @brief The AAMI class of a beat type
+*/
+int BeatComparison::aamiClass( int type )
+{
+	switch ( type ) {
+		case NORMAL:
+		case LBBB:
+		case RBBB:
+		case BBB:
+		case AESC:
+		case NESC:
+			return BXB_N;
+		case APC:
+		case ABERR:
+		case NPC:
+		case SVPB:
+			return BXB_S;
+		case PVC:
+		case RONT:
+		case VESC:
+			return BXB_V;
+		case FUSION:
+			return BXB_F;
+	}
+	return BXB_Q;
+}
+/* }}} */
+
+
+/** {{{ void BeatComparison::tally( const BeatStore &ref, int r, const BeatStore &test, int t )
+    @brief Count a pair; either index may be -1 for a beat the other does not have
+*/
+void BeatComparison::tally( const BeatStore &ref, int r, const BeatStore &test, int t )
+{
+	int refClass = ( r >= 0 ) ? aamiClass( ref.type( r ) ) : BXB_NONE;
+	int testClass = ( t >= 0 ) ? aamiClass( test.type( t ) ) : BXB_NONE;
+	m_matrix[refClass][testClass]++;
+
+	if ( refClass != testClass ) {
+		BeatMismatch mismatch;
+		mismatch.refPos = ( r >= 0 ) ? ref.pos( r ) : -1;
+		mismatch.testPos = ( t >= 0 ) ? test.pos( t ) : -1;
+		mismatch.refType = ( r >= 0 ) ? ref.type( r ) : NOTQRS;
+		mismatch.testType = ( t >= 0 ) ? test.type( t ) : NOTQRS;
+		m_mismatches.append( mismatch );
+		if ( t >= 0 ) {
+			m_agrees[t] = false;
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatComparison::compare( const BeatStore &ref, const BeatStore &test, int sampsPerSec )
+ */
+void BeatComparison::compare( const BeatStore &ref, const BeatStore &test, int sampsPerSec )
+{
+	clear();
+	m_agrees.fill( true, test.size() );
+
+	QVector<int> r = beat_indexes( ref );
+	QVector<int> t = beat_indexes( test );
+	qint64 window = (qint64) BXB_MATCH_WINDOW_MS * qMax( 1, sampsPerSec ) / 1000;
+
+	int i = 0;
+	int j = 0;
+	while ( i < r.size() && j < t.size() ) {
+		qint64 refPos = ref.pos( r[i] );
+		qint64 testPos = test.pos( t[j] );
+		qint64 gap = qAbs( refPos - testPos );
+
+		if ( testPos < refPos - window ) {
+			tally( ref, -1, test, t[j++] );
+		} else if ( refPos < testPos - window ) {
+			tally( ref, r[i++], test, -1 );
+		} else if ( j + 1 < t.size() && qAbs( test.pos( t[j + 1] ) - refPos ) < gap ) {
+			/* the next test beat is the better match for this reference beat */
+			tally( ref, -1, test, t[j++] );
+		} else if ( i + 1 < r.size() && qAbs( ref.pos( r[i + 1] ) - testPos ) < gap ) {
+			tally( ref, r[i++], test, -1 );
+		} else {
+			tally( ref, r[i++], test, t[j++] );
+		}
+	}
+	while ( i < r.size() ) {
+		tally( ref, r[i++], test, -1 );
+	}
+	while ( j < t.size() ) {
+		tally( ref, -1, test, t[j++] );
+	}
+}
+/* }}} */
+
+
+/** {{{ int BeatComparison::matched() const
+    @brief Beats both annotators have, whatever their class
+*/
+int BeatComparison::matched() const
+{
+	int n = 0;
+	for ( int rc = 0 ; rc < BXB_NONE ; rc++ ) {
+		for ( int tc = 0 ; tc < BXB_NONE ; tc++ ) {
+			n += m_matrix[rc][tc];
+		}
+	}
+	return n;
+}
+/* }}} */
+
+
+/** {{{ int BeatComparison::missed() const
+    @brief Reference beats the test annotator does not have
+*/
+int BeatComparison::missed() const
+{
+	int n = 0;
+	for ( int rc = 0 ; rc < BXB_NONE ; rc++ ) {
+		n += m_matrix[rc][BXB_NONE];
+	}
+	return n;
+}
+/* }}} */
+
+
+/** {{{ int BeatComparison::extra() const
+    @brief Test beats that are not in the reference
+*/
+int BeatComparison::extra() const
+{
+	int n = 0;
+	for ( int tc = 0 ; tc < BXB_NONE ; tc++ ) {
+		n += m_matrix[BXB_NONE][tc];
+	}
+	return n;
+}
+/* }}} */
+
+
+/** {{{ double BeatComparison::sensitivity() const
+ */
+double BeatComparison::sensitivity() const
+{
+	int found = matched();
+	return ( found + missed() > 0 ) ? (double) found / ( found + missed() ) : 0.0;
+}
+/* }}} */
+
+
+/** {{{ double BeatComparison::positivePredictivity() const
+ */
+double BeatComparison::positivePredictivity() const
+{
+	int found = matched();
+	return ( found + extra() > 0 ) ? (double) found / ( found + extra() ) : 0.0;
+}
+/* }}} */
+
+
+/** {{{ QString BeatComparison::report( int sampsPerSec, int maxListed ) const
+    @brief The confusion matrix and the first maxListed disagreements, as text
+*/
+QString BeatComparison::report( int sampsPerSec, int maxListed ) const
+{
+	QString text;
+	QTextStream out( &text );
+	sampsPerSec = qMax( 1, sampsPerSec );
+
+	out << QString("QRS Se %1%  +P %2%  (%3 matched, %4 missed, %5 extra)\n")
+		.arg( sensitivity() * 100, 0, 'f', 2 ).arg( positivePredictivity() * 100, 0, 'f', 2 )
+		.arg( matched() ).arg( missed() ).arg( extra() );
+
+	out << "\nref\\test";
+	for ( int tc = 0 ; tc < BXB_CLASSES ; tc++ ) {
+		out << QString("%1").arg( className( tc ), 8 );
+	}
+	out << "\n";
+	for ( int rc = 0 ; rc < BXB_CLASSES ; rc++ ) {
+		out << QString("%1").arg( className( rc ), 8 );
+		for ( int tc = 0 ; tc < BXB_CLASSES ; tc++ ) {
+			out << QString("%1").arg( m_matrix[rc][tc], 8 );
+		}
+		out << "\n";
+	}
+
+	if ( ! m_mismatches.isEmpty() ) {
+		out << QString("\n%1 disagreements:\n").arg( m_mismatches.size() );
+	}
+	for ( int m = 0 ; m < m_mismatches.size() && m < maxListed ; m++ ) {
+		const BeatMismatch &mismatch = m_mismatches[m];
+		qint64 pos = ( mismatch.refPos >= 0 ) ? mismatch.refPos : mismatch.testPos;
+		qint64 tenths = pos * 10 / sampsPerSec;
+		out << QString("  %1:%2:%3.%4  %5 -> %6\n")
+			.arg( tenths / 36000 )
+			.arg( ( tenths / 600 ) % 60, 2, 10, QLatin1Char('0') )
+			.arg( ( tenths / 10 ) % 60, 2, 10, QLatin1Char('0') )
+			.arg( tenths % 10 )
+			.arg( className( mismatch.refPos >= 0 ? aamiClass( mismatch.refType ) : BXB_NONE ) )
+			.arg( className( mismatch.testPos >= 0 ? aamiClass( mismatch.testType ) : BXB_NONE ) );
+	}
+	if ( m_mismatches.size() > maxListed ) {
+		out << "  ...\n";
+	}
+
+	out.flush();
+	return text;
+}
+/* }}} */
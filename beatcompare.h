@@ -0,0 +1,92 @@
+/**
+ * @file beatcompare.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BEATCOMPARE_H
+#define BEATCOMPARE_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define BXB_MATCH_WINDOW_MS		(150)	/**< beats further apart than this do not match, as in EC57 */
+
+/* AAMI beat classes; BXB_NONE counts the beats the other annotator does not have */
+#define BXB_N			(0)
+#define BXB_S			(1)
+#define BXB_V			(2)
+#define BXB_F			(3)
+#define BXB_Q			(4)
+#define BXB_NONE		(5)
+#define BXB_CLASSES		(6)
+
+
+/* {{{ struct BeatMismatch
+   @brief	A reference beat and test beat that do not agree; a missing one has position -1
+*/
+struct BeatMismatch
+{
+	qint64 refPos;
+	qint64 testPos;
+	int refType;
+	int testType;
+};
+/* }}} */
+
+
+/* {{{ class BeatComparison
+   @brief	Beat by beat comparison of a test annotator against a reference
+
+   Like bxb, the beats of both are matched within BXB_MATCH_WINDOW_MS and
+   tallied by AAMI class.  Both position arrays are sorted, so the matching
+   is a single merge through them: each reference beat is paired with the
+   nearest test beat unless a neighbour of either is closer still.
+*/
+class BeatComparison
+{
+public:
+	BeatComparison();
+
+	void compare( const BeatStore &ref, const BeatStore &test, int sampsPerSec );
+	void clear();
+
+	static int aamiClass( int type );
+	static char className( int aamiClass ) { return "NSVFQ-"[aamiClass]; }
+
+	int count( int refClass, int testClass ) const { return m_matrix[refClass][testClass]; }
+	int matched() const;
+	int missed() const;
+	int extra() const;
+	double sensitivity() const;
+	double positivePredictivity() const;
+
+	const QVector<BeatMismatch> &mismatches() const { return m_mismatches; }
+	bool agrees( int testIndex ) const { return testIndex >= m_agrees.size() || m_agrees[testIndex]; }
+
+	QString report( int sampsPerSec, int maxListed ) const;
+
+private:
+	void tally( const BeatStore &ref, int r, const BeatStore &test, int t );
+
+	int m_matrix[BXB_CLASSES][BXB_CLASSES];		/**< [reference class][test class] */
+	QVector<BeatMismatch> m_mismatches;
+	QVector<bool> m_agrees;			/**< per test annotation: matched and of the same class */
+};
+/* }}} */
+
+#endif // BEATCOMPARE_H
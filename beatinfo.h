@@ -61,15 +61,6 @@ public:
 		}
 	}
 
-	BeatInfo &operator =( const BeatInfo &other )
-	{
-		// QQQ("beatinfo.log") << "assigning beat at pos " << pos_samps << " to " << other.pos_samps;
-                annotationString = other.annotationString;
-		pos_samps = other.pos_samps;
-		type = other.type;
-		return *this;
-	};
-
 	bool operator == ( const BeatInfo &other ) const
 	{
 		// QQQ("beatinfo.log") << "comparing beat at pos " << pos_samps << " to " << other.pos_samps;
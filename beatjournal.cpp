@@ -0,0 +1,493 @@
+/**
+ * @file beatjournal.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include "beatjournal.h"
+
+
+/** {{{ BeatJournal::BeatJournal()
+ */
+BeatJournal::BeatJournal()
+{
+	clear();
+}
+/* }}} */
+
+
+/** {{{ void BeatJournal::clear()
+    @brief Forget every edit; the annotations are left as they are
+*/
+void BeatJournal::clear()
+{
+	m_edits.clear();
+	m_applied = 0;
+	m_saved = 0;
+	m_rewrite = false;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::insert( BeatStore &beats, qint64 pos, int type, int subtype, const QString &aux )
+    @brief Add an annotation at pos
+*/
+bool BeatJournal::insert( BeatStore &beats, qint64 pos, int type, int subtype, const QString &aux )
+{
+	BeatEdit edit;
+	edit.op = BEAT_EDIT_INSERT;
+	edit.pos = pos;
+	edit.type = type;
+	edit.subtype = subtype;
+	edit.aux = aux;
+	return record( beats, edit );
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::remove( BeatStore &beats, int index )
+    @brief Delete annotation index
+*/
+bool BeatJournal::remove( BeatStore &beats, int index )
+{
+	if ( index < 0 || index >= beats.size() ) {
+		return false;
+	}
+
+	BeatEdit edit;
+	edit.op = BEAT_EDIT_DELETE;
+	edit.pos = beats.pos( index );
+	edit.type = beats.type( index );
+	return record( beats, edit );
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::relabel( BeatStore &beats, int index, int type )
+    @brief Give annotation index another type
+*/
+bool BeatJournal::relabel( BeatStore &beats, int index, int type )
+{
+	if ( index < 0 || index >= beats.size() || beats.type( index ) == type ) {
+		return false;
+	}
+
+	BeatEdit edit;
+	edit.op = BEAT_EDIT_RELABEL;
+	edit.pos = beats.pos( index );
+	edit.oldType = beats.type( index );
+	edit.type = type;
+	return record( beats, edit );
+}
+/* }}} */
+
+
+/** {{{ int BeatJournal::relabelRange( BeatStore &beats, qint64 from, qint64 to, int type )
+    @brief Give every beat from up to to the type; other annotations are left alone
+    @return how many beats changed, all of them in one edit
+*/
+int BeatJournal::relabelRange( BeatStore &beats, qint64 from, qint64 to, int type )
+{
+	int changed = 0;
+	for ( int b = beats.lowerBound( from ) ; b < beats.size() && beats.pos( b ) < to ; b++ ) {
+		if ( BeatStore::isBeat( beats.type( b ) ) && beats.type( b ) != type ) {
+			changed++;
+		}
+	}
+	if ( changed == 0 ) {
+		return 0;
+	}
+
+	BeatEdit edit;
+	edit.op = BEAT_EDIT_RELABEL_RANGE;
+	edit.pos = from;
+	edit.endPos = to;
+	edit.type = type;
+	return record( beats, edit ) ? changed : 0;
+}
+/* }}} */
+
+
+/** {{{ int BeatJournal::relabelList( BeatStore &beats, const QVector<int> &indexes, int type )
+    @brief Give the beats at indexes (ascending) the type, all in one edit
+    @return how many beats changed
+*/
+int BeatJournal::relabelList( BeatStore &beats, const QVector<int> &indexes, int type )
+{
+	BeatEdit edit;
+	edit.op = BEAT_EDIT_RELABEL_LIST;
+	edit.type = type;
+	foreach ( int b, indexes ) {
+		if ( b >= 0 && b < beats.size() && BeatStore::isBeat( beats.type( b ) ) && beats.type( b ) != type ) {
+			edit.positions.append( beats.pos( b ) );
+			edit.oldTypes.append( (quint8) beats.type( b ) );
+		}
+	}
+	if ( edit.positions.isEmpty() ) {
+		return 0;
+	}
+
+	edit.pos = edit.positions.first();
+	return record( beats, edit ) ? edit.positions.size() : 0;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::undo( BeatStore &beats )
+ */
+bool BeatJournal::undo( BeatStore &beats )
+{
+	if ( ! canUndo() ) {
+		return false;
+	}
+	unapply( beats, m_edits[ --m_applied ] );
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::redo( BeatStore &beats )
+ */
+bool BeatJournal::redo( BeatStore &beats )
+{
+	if ( ! canRedo() || ! apply( beats, m_edits[m_applied] ) ) {
+		return false;
+	}
+	m_applied++;
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::record( BeatStore &beats, BeatEdit &edit )
+    @brief Apply a new edit and add it, dropping whatever had been undone
+*/
+bool BeatJournal::record( BeatStore &beats, BeatEdit &edit )
+{
+	if ( ! apply( beats, edit ) ) {
+		return false;
+	}
+
+	if ( m_applied < m_saved ) {
+		m_saved = m_applied;
+		m_rewrite = true;
+	}
+	m_edits.resize( m_applied );
+	m_edits.append( edit );
+	m_applied++;
+	return true;
+}
+/* }}} */
+
+
+/** {{{ int BeatJournal::find( const BeatStore &beats, qint64 pos, int type )
+    @brief Index of the first annotation of type at pos, -1 if there is none
+*/
+int BeatJournal::find( const BeatStore &beats, qint64 pos, int type )
+{
+	for ( int b = beats.lowerBound( pos ) ; b < beats.size() && beats.pos( b ) == pos ; b++ ) {
+		if ( beats.type( b ) == type ) {
+			return b;
+		}
+	}
+	return -1;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::find_list( const BeatStore &beats, const BeatEdit &edit, bool applied, QVector<int> &indexes )
+    @brief Indexes of the annotations of a list relabel, with their new types if applied, else the old
+    @return false if one of them is not there
+*/
+bool BeatJournal::find_list( const BeatStore &beats, const BeatEdit &edit, bool applied, QVector<int> &indexes )
+{
+	indexes.resize( edit.positions.size() );
+	for ( int i = 0 ; i < edit.positions.size() ; i++ ) {
+		if ( ( indexes[i] = find( beats, edit.positions[i], applied ? edit.type : edit.oldTypes[i] ) ) < 0 ) {
+			return false;
+		}
+	}
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::apply( BeatStore &beats, BeatEdit &edit )
+    @brief Make the change to beats, filling in edit with what undoing it needs
+    @return false if the annotation it is about is not there
+*/
+bool BeatJournal::apply( BeatStore &beats, BeatEdit &edit )
+{
+	int b;
+
+	switch ( edit.op ) {
+		case BEAT_EDIT_INSERT:
+			beats.insert( beats.lowerBound( edit.pos + 1 ), edit.pos, edit.type, edit.subtype, edit.aux );
+			return true;
+
+		case BEAT_EDIT_DELETE:
+			if ( ( b = find( beats, edit.pos, edit.type ) ) < 0 ) {
+				return false;
+			}
+			edit.subtype = beats.subtype( b );
+			edit.aux = beats.aux( b );
+			beats.remove( b );
+			return true;
+
+		case BEAT_EDIT_RELABEL:
+			if ( ( b = find( beats, edit.pos, edit.oldType ) ) < 0 ) {
+				return false;
+			}
+			beats.setType( b, edit.type );
+			return true;
+
+		case BEAT_EDIT_RELABEL_RANGE:
+			{
+				edit.first = beats.lowerBound( edit.pos );
+				edit.oldTypes = beats.types( edit.first, beats.lowerBound( edit.endPos ) );
+
+				QVector<quint8> types = edit.oldTypes;
+				for ( int i = 0 ; i < types.size() ; i++ ) {
+					if ( BeatStore::isBeat( types[i] ) ) {
+						types[i] = (quint8) edit.type;
+					}
+				}
+				beats.setTypes( edit.first, types );
+			}
+			return true;
+
+		case BEAT_EDIT_RELABEL_LIST:
+			{
+				QVector<int> indexes;
+				if ( ! find_list( beats, edit, false, indexes ) ) {
+					return false;
+				}
+				beats.setTypes( indexes, QVector<quint8>( indexes.size(), (quint8) edit.type ) );
+			}
+			return true;
+	}
+	return false;
+}
+/* }}} */
+
+
+/** {{{ void BeatJournal::unapply( BeatStore &beats, const BeatEdit &edit )
+    @brief Put beats back the way they were before edit
+*/
+void BeatJournal::unapply( BeatStore &beats, const BeatEdit &edit )
+{
+	int b;
+
+	switch ( edit.op ) {
+		case BEAT_EDIT_INSERT:
+			/* it went in after anything else at the same position */
+			for ( b = beats.lowerBound( edit.pos + 1 ) - 1 ; b >= 0 && beats.pos( b ) == edit.pos ; b-- ) {
+				if ( beats.type( b ) == edit.type ) {
+					beats.remove( b );
+					break;
+				}
+			}
+			break;
+
+		case BEAT_EDIT_DELETE:
+			beats.insert( beats.lowerBound( edit.pos ), edit.pos, edit.type, edit.subtype, edit.aux );
+			break;
+
+		case BEAT_EDIT_RELABEL:
+			if ( ( b = find( beats, edit.pos, edit.type ) ) >= 0 ) {
+				beats.setType( b, edit.oldType );
+			}
+			break;
+
+		case BEAT_EDIT_RELABEL_RANGE:
+			beats.setTypes( edit.first, edit.oldTypes );
+			break;
+
+		case BEAT_EDIT_RELABEL_LIST:
+			{
+				QVector<int> indexes;
+				if ( find_list( beats, edit, true, indexes ) ) {
+					beats.setTypes( indexes, edit.oldTypes );
+				}
+			}
+			break;
+	}
+}
+/* }}} */
+
+
+/** {{{ QString BeatJournal::encode( const BeatEdit &edit )
+    @brief One line of the journal file
+*/
+QString BeatJournal::encode( const BeatEdit &edit )
+{
+	switch ( edit.op ) {
+		case BEAT_EDIT_INSERT:
+			return QString("I %1 %2 %3 %4").arg( edit.pos ).arg( edit.type ).arg( edit.subtype )
+				.arg( QString::fromLatin1( edit.aux.toUtf8().toPercentEncoding() ) );
+		case BEAT_EDIT_DELETE:
+			return QString("D %1 %2").arg( edit.pos ).arg( edit.type );
+		case BEAT_EDIT_RELABEL:
+			return QString("R %1 %2 %3").arg( edit.pos ).arg( edit.oldType ).arg( edit.type );
+		case BEAT_EDIT_RELABEL_RANGE:
+			return QString("G %1 %2 %3").arg( edit.pos ).arg( edit.endPos ).arg( edit.type );
+		case BEAT_EDIT_RELABEL_LIST:
+			{
+				/* L first-position type position old-type position old-type ... */
+				QString line = QString("L %1 %2").arg( edit.pos ).arg( edit.type );
+				for ( int i = 0 ; i < edit.positions.size() ; i++ ) {
+					line += QString(" %1 %2").arg( edit.positions[i] ).arg( edit.oldTypes[i] );
+				}
+				return line;
+			}
+	}
+	return QString();
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::decode( const QString &line, BeatEdit &edit )
+ */
+bool BeatJournal::decode( const QString &line, BeatEdit &edit )
+{
+	QStringList fields = line.split(' ');
+	if ( fields.size() < 3 || fields[0].size() != 1 ) {
+		return false;
+	}
+
+	bool ok = true;
+	edit.op = fields[0].at(0).toLatin1();
+	edit.pos = fields[1].toLongLong( &ok );
+
+	switch ( edit.op ) {
+		case BEAT_EDIT_INSERT:
+			if ( fields.size() != 5 ) {
+				return false;
+			}
+			edit.type = fields[2].toInt();
+			edit.subtype = fields[3].toInt();
+			edit.aux = QString::fromUtf8( QByteArray::fromPercentEncoding( fields[4].toLatin1() ) );
+			return ok;
+		case BEAT_EDIT_DELETE:
+			edit.type = fields[2].toInt();
+			return ok;
+		case BEAT_EDIT_RELABEL:
+			if ( fields.size() != 4 ) {
+				return false;
+			}
+			edit.oldType = fields[2].toInt();
+			edit.type = fields[3].toInt();
+			return ok;
+		case BEAT_EDIT_RELABEL_RANGE:
+			if ( fields.size() != 4 ) {
+				return false;
+			}
+			{
+				bool okEnd = true;
+				edit.endPos = fields[2].toLongLong( &okEnd );
+				edit.type = fields[3].toInt();
+				return ok && okEnd;
+			}
+		case BEAT_EDIT_RELABEL_LIST:
+			if ( fields.size() < 5 || fields.size() % 2 != 1 ) {
+				return false;
+			}
+			edit.type = fields[2].toInt();
+			for ( int f = 3 ; f + 1 < fields.size() && ok ; f += 2 ) {
+				edit.positions.append( fields[f].toLongLong( &ok ) );
+				edit.oldTypes.append( (quint8) fields[f + 1].toInt() );
+			}
+			return ok;
+	}
+	return false;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::load( const QString &fileName, BeatStore &beats )
+    @brief Replay a saved journal on top of freshly read annotations
+    @return false if there is no journal
+*/
+bool BeatJournal::load( const QString &fileName, BeatStore &beats )
+{
+	clear();
+
+	QFile file( fileName );
+	if ( ! file.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+		return false;
+	}
+
+	QTextStream in( &file );
+	while ( ! in.atEnd() ) {
+		QString line = in.readLine().trimmed();
+		BeatEdit edit;
+		if ( line.isEmpty() ) {
+			continue;
+		}
+		if ( decode( line, edit ) && apply( beats, edit ) ) {
+			m_edits.append( edit );
+		} else {
+			/* not for these annotations; leave it out next time */
+			qDebug() << "BeatJournal::load(" << fileName << ") skipping" << line;
+			m_rewrite = true;
+		}
+	}
+
+	m_applied = m_saved = m_edits.size();
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatJournal::save( const QString &fileName )
+    @brief Bring the journal file up to date, appending to it when that is enough
+*/
+bool BeatJournal::save( const QString &fileName )
+{
+	if ( ! isModified() ) {
+		return true;
+	}
+
+	QFile file( fileName );
+	bool append = ! m_rewrite && m_applied >= m_saved;
+	if ( ! append && m_applied == 0 ) {
+		if ( file.exists() && ! file.remove() ) {
+			return false;
+		}
+		m_saved = 0;
+		m_rewrite = false;
+		return true;
+	}
+
+	if ( ! file.open( QIODevice::WriteOnly | QIODevice::Text | ( append ? QIODevice::Append : QIODevice::Truncate ) ) ) {
+		return false;
+	}
+
+	QTextStream out( &file );
+	for ( int e = append ? m_saved : 0 ; e < m_applied ; e++ ) {
+		out << encode( m_edits[e] ) << "\n";
+	}
+	out.flush();
+	if ( out.status() != QTextStream::Ok ) {
+		return false;
+	}
+
+	m_saved = m_applied;
+	m_rewrite = false;
+	return true;
+}
+/* }}} */
@@ -0,0 +1,105 @@
+/**
+ * @file beatjournal.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BEATJOURNAL_H
+#define BEATJOURNAL_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define BEAT_JOURNAL_SUFFIX		"edits"		/**< the journal of record.atr is record.edits */
+
+#define BEAT_EDIT_INSERT		('I')
+#define BEAT_EDIT_DELETE		('D')
+#define BEAT_EDIT_RELABEL		('R')
+#define BEAT_EDIT_RELABEL_RANGE	('G')
+#define BEAT_EDIT_RELABEL_LIST	('L')
+
+
+/* {{{ struct BeatEdit
+   @brief	One change to the annotations, with what it takes to undo it
+*/
+struct BeatEdit
+{
+	char op;				/**< BEAT_EDIT_... */
+	qint64 pos;				/**< the annotation, or the start of the range or list */
+	qint64 endPos;			/**< one past the end of the range */
+	int type;				/**< the new type; for a deletion the deleted one's */
+	int subtype;			/**< inserted or deleted */
+	QString aux;			/**< inserted or deleted */
+	int oldType;			/**< relabel: the type it had */
+	int first;				/**< range: index of the first annotation in it when applied */
+	QVector<quint8> oldTypes;	/**< range and list: the types there before */
+	QVector<qint64> positions;	/**< list: the annotations, in order */
+};
+/* }}} */
+
+
+/* {{{ class BeatJournal
+   @brief	The edits made to a record's annotations, in order
+
+   The annotation file is never changed in place.  Each edit is applied to
+   the working BeatStore as it is made and kept here with what it replaced,
+   so undo and redo only replay one entry.  Edits identify annotations by
+   position and type rather than index, so the journal can be saved next
+   to the annotation file and replayed on top of it the next time it is
+   opened.  Saving only appends the edits made since the last save unless
+   some of those saved were undone and replaced.
+*/
+class BeatJournal
+{
+public:
+	BeatJournal();
+
+	void clear();
+	int count() const { return m_applied; }
+	bool isModified() const { return m_applied != m_saved || m_rewrite; }
+	bool canUndo() const { return m_applied > 0; }
+	bool canRedo() const { return m_applied < m_edits.size(); }
+
+	bool insert( BeatStore &beats, qint64 pos, int type, int subtype = 0, const QString &aux = QString() );
+	bool remove( BeatStore &beats, int index );
+	bool relabel( BeatStore &beats, int index, int type );
+	int relabelRange( BeatStore &beats, qint64 from, qint64 to, int type );
+	int relabelList( BeatStore &beats, const QVector<int> &indexes, int type );
+
+	bool undo( BeatStore &beats );
+	bool redo( BeatStore &beats );
+
+	bool load( const QString &fileName, BeatStore &beats );
+	bool save( const QString &fileName );
+
+private:
+	bool record( BeatStore &beats, BeatEdit &edit );
+	bool apply( BeatStore &beats, BeatEdit &edit );
+	void unapply( BeatStore &beats, const BeatEdit &edit );
+	static int find( const BeatStore &beats, qint64 pos, int type );
+	static bool find_list( const BeatStore &beats, const BeatEdit &edit, bool applied, QVector<int> &indexes );
+	static QString encode( const BeatEdit &edit );
+	static bool decode( const QString &line, BeatEdit &edit );
+
+	QVector<BeatEdit> m_edits;
+	int m_applied;			/**< m_edits beyond this were undone */
+	int m_saved;			/**< how many of m_edits the file holds */
+	bool m_rewrite;			/**< the file holds edits that were undone and replaced */
+};
+/* }}} */
+
+#endif // BEATJOURNAL_H
@@ -0,0 +1,380 @@
+/**
+ * @file beatmorphology.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <math.h>
+
+#include "beatmorphology.h"
+
+
+/** {{{ BeatMorphology::BeatMorphology()
+ */
+BeatMorphology::BeatMorphology()
+{
+	clear();
+}
+/* }}} */
+
+
+/** {{{ void BeatMorphology::clear()
+    @brief Forget every cluster; the next update() starts again from nothing
+*/
+void BeatMorphology::clear()
+{
+	m_sampsPerSec = 0;
+	m_channels = 0;
+	m_dims = 0;
+	m_before = 0;
+	m_after = 0;
+	m_pos.clear();
+	m_features.clear();
+	m_cluster.clear();
+	m_type.clear();
+	m_byPos.clear();
+	m_live = 0;
+	m_clusters.clear();
+}
+/* }}} */
+
+
+/** {{{ float BeatMorphology::correlate( const float *a, const float *b, int n )
+    @brief Dot product of two rows, which for unit length rows is their correlation
+
+    Four running sums rather than one, so the additions need not wait for
+    each other and the loop can be vectorized without reordering a single
+    floating point sum.
+*/
+float BeatMorphology::correlate( const float *a, const float *b, int n )
+{
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i = 0;
+	for ( ; i + 4 <= n ; i += 4 ) {
+		s0 += a[i] * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	for ( ; i < n ; i++ ) {
+		s0 += a[i] * b[i];
+	}
+	return ( s0 + s1 ) + ( s2 + s3 );
+}
+/* }}} */
+
+
+/** {{{ int BeatMorphology::update( const BeatStore &beats, const QVector<const quint16 *> &channels, long length, int sampsPerSec )
+    @brief Bring the clusters up to date with beats: place the new beats, take out the ones that went
+    @return how many beats are clustered
+*/
+int BeatMorphology::update( const BeatStore &beats, const QVector<const quint16 *> &channels, long length, int sampsPerSec )
+{
+	if ( sampsPerSec != m_sampsPerSec || channels.size() != m_channels ) {
+		clear();
+		m_sampsPerSec = qMax( 1, sampsPerSec );
+		m_channels = channels.size();
+		m_dims = m_channels * MORPH_POINTS;
+		m_before = (long) MORPH_BEFORE_MS * m_sampsPerSec / 1000;
+		m_after = (long) MORPH_AFTER_MS * m_sampsPerSec / 1000;
+	}
+	if ( m_dims == 0 ) {
+		return 0;
+	}
+
+	/** {{{ walk the beats and the rows in order of position together */
+	QVector<qint64> addedPos;
+	QVector<quint8> addedType;
+	int r = 0;
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		qint64 pos = beats.pos( b );
+		int type = beats.type( b );
+		if ( ! BeatStore::isBeat( type ) || pos < m_before || pos + m_after > length ) {
+			continue;
+		}
+
+		/* rows before it lost their beat */
+		for ( ; r < m_byPos.size() && m_pos[ m_byPos[r] ] < pos ; r++ ) {
+			join( m_byPos[r], -1 );
+		}
+
+		if ( r < m_byPos.size() && m_pos[ m_byPos[r] ] == pos ) {
+			m_type[ m_byPos[r++] ] = (quint8) type;
+		} else {
+			addedPos.append( pos );
+			addedType.append( (quint8) type );
+		}
+	}
+	for ( ; r < m_byPos.size() ; r++ ) {
+		join( m_byPos[r], -1 );
+	}
+	/* }}} */
+
+	/** {{{ extract the new beats, in parallel */
+	int first = m_pos.size();
+	int last = first + addedPos.size();
+	m_pos += addedPos;
+	m_type += addedType;
+	m_cluster.resize( last );
+	m_features.resize( last * m_dims );
+
+	QVector<int> rows;
+	for ( int row = first ; row < last ; row++ ) {
+		m_cluster[row] = -1;
+		rows.append( row );
+	}
+	float *features = m_features.data();
+	QtConcurrent::blockingMap( rows, [&]( int row ) {
+		extract( row, channels, features + (qint64) row * m_dims );
+	} );
+	/* }}} */
+
+	place( first, last );
+
+	/** {{{ the live rows in order of position, and what most of each cluster are */
+	m_byPos.clear();
+	for ( int row = 0 ; row < m_pos.size() ; row++ ) {
+		if ( m_cluster[row] >= 0 ) {
+			m_byPos.append( row );
+		}
+	}
+	std::stable_sort( m_byPos.begin(), m_byPos.end(), [this]( int a, int b ) { return m_pos[a] < m_pos[b]; } );
+
+	QVector<int> typeCounts( m_clusters.size() * BEAT_TYPE_COUNT, 0 );
+	foreach ( int row, m_byPos ) {
+		typeCounts[ m_cluster[row] * BEAT_TYPE_COUNT + m_type[row] ]++;
+	}
+	for ( int c = 0 ; c < m_clusters.size() ; c++ ) {
+		BeatCluster &cluster = m_clusters[c];
+		const int *counts = typeCounts.constData() + c * BEAT_TYPE_COUNT;
+		cluster.dominantType = std::max_element( counts, counts + BEAT_TYPE_COUNT ) - counts;
+		cluster.dominantCount = counts[ cluster.dominantType ];
+		reshape( c );
+	}
+	/* }}} */
+
+	return m_live;
+}
+/* }}} */
+
+
+/** {{{ void BeatMorphology::extract( int row, const QVector<const quint16 *> &channels, float *features )
+    @brief Fill in the features of a row from the samples around its beat
+*/
+void BeatMorphology::extract( int row, const QVector<const quint16 *> &channels, float *features )
+{
+	long span = m_before + m_after;
+	long start = m_pos[row] - m_before;
+	float length = 0;
+
+	for ( int c = 0 ; c < m_channels ; c++ ) {
+		const quint16 *x = channels[c] + start;
+		float *f = features + c * MORPH_POINTS;
+		float mean = 0;
+
+		for ( int p = 0 ; p < MORPH_POINTS ; p++ ) {
+			long s0 = p * span / MORPH_POINTS;
+			long s1 = qMax( s0 + 1, ( p + 1 ) * span / MORPH_POINTS );
+			long sum = 0;
+			for ( long s = s0 ; s < s1 ; s++ ) {
+				sum += x[s];
+			}
+			f[p] = (float) sum / ( s1 - s0 );
+			mean += f[p];
+		}
+
+		mean /= MORPH_POINTS;
+		for ( int p = 0 ; p < MORPH_POINTS ; p++ ) {
+			f[p] -= mean;
+			length += f[p] * f[p];
+		}
+	}
+
+	float scale = ( length > 0 ) ? 1.0f / sqrtf( length ) : 0.0f;
+	for ( int d = 0 ; d < m_dims ; d++ ) {
+		features[d] *= scale;
+	}
+}
+/* }}} */
+
+
+/** {{{ int BeatMorphology::nearest( const float *features, const float *shapes, int clusters, float *correlation ) const
+    @brief The one of clusters shapes (m_dims each) a row correlates best with, -1 if there are none
+*/
+int BeatMorphology::nearest( const float *features, const float *shapes, int clusters, float *correlation ) const
+{
+	int best = -1;
+	*correlation = -2;
+	for ( int c = 0 ; c < clusters ; c++ ) {
+		float r = correlate( features, shapes + c * m_dims, m_dims );
+		if ( r > *correlation ) {
+			*correlation = r;
+			best = c;
+		}
+	}
+	return best;
+}
+/* }}} */
+
+
+/** {{{ void BeatMorphology::place( int first, int last )
+    @brief Put rows first up to last into clusters, MORPH_CHUNK at a time
+*/
+void BeatMorphology::place( int first, int last )
+{
+	for ( int chunk = first ; chunk < last ; chunk += MORPH_CHUNK ) {
+		int end = qMin( last, chunk + MORPH_CHUNK );
+
+		/* the shapes as they are, side by side, matched against the whole chunk in parallel */
+		int known = m_clusters.size();
+		QVector<float> shapes( known * m_dims );
+		for ( int c = 0 ; c < known ; c++ ) {
+			memcpy( shapes.data() + c * m_dims, m_clusters[c].shape.constData(), m_dims * sizeof(float) );
+		}
+
+		QVector<int> rows;
+		for ( int row = chunk ; row < end ; row++ ) {
+			rows.append( row );
+		}
+		QVector<int> best( end - chunk );
+		QVector<float> correlation( end - chunk );
+		QtConcurrent::blockingMap( rows, [&]( int row ) {
+			best[row - chunk] = nearest( m_features.constData() + (qint64) row * m_dims, shapes.constData(), known, &correlation[row - chunk] );
+		} );
+
+		/* the rest one by one, since each may start a cluster the next one belongs to */
+		for ( int row = chunk ; row < end ; row++ ) {
+			int c = best[row - chunk];
+			float r = correlation[row - chunk];
+			const float *features = m_features.constData() + (qint64) row * m_dims;
+
+			for ( int n = known ; r < MORPH_MATCH && n < m_clusters.size() ; n++ ) {
+				float rn = correlate( features, m_clusters[n].shape.constData(), m_dims );
+				if ( rn > r ) {
+					r = rn;
+					c = n;
+				}
+			}
+
+			if ( r < MORPH_MATCH && m_clusters.size() < MORPH_MAX_CLUSTERS ) {
+				BeatCluster cluster;
+				cluster.count = 0;
+				cluster.dominantType = NOTQRS;
+				cluster.dominantCount = 0;
+				cluster.sum.fill( 0.0f, m_dims );
+				cluster.shape = QVector<float>( features, features + m_dims );
+				m_clusters.append( cluster );
+				c = m_clusters.size() - 1;
+			}
+			join( row, c );
+		}
+
+		for ( int c = 0 ; c < m_clusters.size() ; c++ ) {
+			reshape( c );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatMorphology::join( int row, int cluster )
+    @brief Move a row into cluster, or out of the one it is in for -1
+*/
+void BeatMorphology::join( int row, int cluster )
+{
+	const float *features = m_features.constData() + (qint64) row * m_dims;
+
+	int was = m_cluster[row];
+	if ( was >= 0 ) {
+		float *sum = m_clusters[was].sum.data();
+		for ( int d = 0 ; d < m_dims ; d++ ) {
+			sum[d] -= features[d];
+		}
+		m_clusters[was].count--;
+		m_live--;
+	}
+
+	m_cluster[row] = cluster;
+	if ( cluster >= 0 ) {
+		float *sum = m_clusters[cluster].sum.data();
+		for ( int d = 0 ; d < m_dims ; d++ ) {
+			sum[d] += features[d];
+		}
+		m_clusters[cluster].count++;
+		m_live++;
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatMorphology::reshape( int cluster )
+    @brief Set the shape of a cluster from the sum of its members
+*/
+void BeatMorphology::reshape( int cluster )
+{
+	BeatCluster &c = m_clusters[cluster];
+	if ( c.count == 0 ) {
+		return;
+	}
+
+	float length = correlate( c.sum.constData(), c.sum.constData(), m_dims );
+	float scale = ( length > 0 ) ? 1.0f / sqrtf( length ) : 0.0f;
+	for ( int d = 0 ; d < m_dims ; d++ ) {
+		c.shape[d] = c.sum[d] * scale;
+	}
+}
+/* }}} */
+
+
+/** {{{ QVector<qint64> BeatMorphology::members( int cluster ) const
+    @brief Positions of the beats in cluster, in order
+*/
+QVector<qint64> BeatMorphology::members( int cluster ) const
+{
+	QVector<qint64> positions;
+	if ( cluster >= 0 && cluster < m_clusters.size() ) {
+		positions.reserve( m_clusters[cluster].count );
+	}
+	foreach ( int row, m_byPos ) {
+		if ( m_cluster[row] == cluster ) {
+			positions.append( m_pos[row] );
+		}
+	}
+	return positions;
+}
+/* }}} */
+
+
+/** {{{ QVector<int> BeatMorphology::memberIndexes( int cluster, const BeatStore &beats ) const
+    @brief Annotation indexes in beats of the beats in cluster, ascending
+*/
+QVector<int> BeatMorphology::memberIndexes( int cluster, const BeatStore &beats ) const
+{
+	QVector<int> indexes;
+	foreach ( qint64 pos, members( cluster ) ) {
+		for ( int b = beats.lowerBound( pos ) ; b < beats.size() && beats.pos( b ) == pos ; b++ ) {
+			if ( BeatStore::isBeat( beats.type( b ) ) ) {
+				indexes.append( b );
+				break;
+			}
+		}
+	}
+	return indexes;
+}
+/* }}} */
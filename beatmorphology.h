@@ -0,0 +1,109 @@
+/**
+ * @file beatmorphology.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BEATMORPHOLOGY_H
+#define BEATMORPHOLOGY_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define MORPH_BEFORE_MS			(150)	/**< of each beat compared, before its annotation */
+#define MORPH_AFTER_MS			(250)	/**< ... and after */
+#define MORPH_POINTS			(32)	/**< the window is averaged down to this many points per channel */
+#define MORPH_MATCH				(0.90f)	/**< correlation with a cluster's shape a beat needs to join it */
+#define MORPH_MAX_CLUSTERS		(64)	/**< beyond this beats join the closest cluster however far it is */
+#define MORPH_CHUNK				(4096)	/**< beats matched against the same snapshot of the shapes */
+
+
+/* {{{ struct BeatCluster
+   @brief	Beats of one shape
+*/
+struct BeatCluster
+{
+	int count;				/**< beats in it now */
+	int dominantType;		/**< the type most of them have */
+	int dominantCount;		/**< ... and how many */
+	QVector<float> sum;		/**< of the members' features */
+	QVector<float> shape;	/**< sum scaled to unit length, what beats are correlated with */
+};
+/* }}} */
+
+
+/* {{{ class BeatMorphology
+   @brief	Groups the beats of a record by the shape of their complexes
+
+   Every beat gets one row of features: its window from MORPH_BEFORE_MS
+   before to MORPH_AFTER_MS after, averaged down to MORPH_POINTS points on
+   each channel, with each channel's mean taken out and the whole row
+   scaled to unit length.  The rows sit one after the other in one array,
+   so the normalized cross correlation of a beat with a cluster's shape is
+   a plain dot product the compiler can vectorize.  Rows are extracted in
+   parallel.
+
+   Clustering is incremental: beats are taken MORPH_CHUNK at a time and
+   correlated in parallel with the shapes as they stand; those that match
+   none are then placed one by one, starting new clusters.  update()
+   keeps the clusters and only places the beats that are new since the
+   last call and takes out the ones that went, so it can follow the
+   editing of a long record.
+*/
+class BeatMorphology
+{
+public:
+	BeatMorphology();
+
+	void clear();
+	int update( const BeatStore &beats, const QVector<const quint16 *> &channels, long length, int sampsPerSec );
+
+	int beatCount() const { return m_live; }
+	const QVector<BeatCluster> &clusters() const { return m_clusters; }
+	QVector<qint64> members( int cluster ) const;
+	QVector<int> memberIndexes( int cluster, const BeatStore &beats ) const;
+
+	long windowBefore() const { return m_before; }
+	long windowAfter() const { return m_after; }
+
+	static float correlate( const float *a, const float *b, int n );
+
+private:
+	void extract( int row, const QVector<const quint16 *> &channels, float *features );
+	void place( int first, int last );
+	void join( int row, int cluster );
+	void reshape( int cluster );
+	int nearest( const float *features, const float *shapes, int clusters, float *correlation ) const;
+
+	int m_sampsPerSec;
+	int m_channels;
+	int m_dims;					/**< features per row */
+	long m_before;				/**< samples */
+	long m_after;
+
+	QVector<qint64> m_pos;		/**< of the beat of each row */
+	QVector<float> m_features;	/**< m_dims per row */
+	QVector<int> m_cluster;		/**< per row, -1 once the beat is gone */
+	QVector<quint8> m_type;		/**< per row, as of the last update() */
+	QVector<int> m_byPos;		/**< the rows in order of position */
+	int m_live;					/**< rows still clustered */
+
+	QVector<BeatCluster> m_clusters;
+};
+/* }}} */
+
+#endif // BEATMORPHOLOGY_H
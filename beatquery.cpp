@@ -0,0 +1,249 @@
+/**
+ * @file beatquery.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtConcurrent>
+#include <algorithm>
+
+#include "wfdb/wfdb.h"
+#include "wfdb/ecgcodes.h"
+#include "beatquery.h"
+
+extern QMutex glb_wfdb_mutex;
+
+
+/** {{{ static qint64 parse_clock( const QString &text, bool *ok )
+    @brief Seconds from h[:mm[:ss]]
+*/
+static qint64 parse_clock( const QString &text, bool *ok )
+{
+	QStringList fields = text.split( ':' );
+	qint64 secs = 0;
+	int scale = 3600;
+
+	*ok = fields.size() <= 3;
+	foreach ( const QString &field, fields ) {
+		bool fieldOk;
+		secs += (qint64) field.toUInt( &fieldOk ) * scale;
+		*ok = *ok && fieldOk;
+		scale /= 60;
+	}
+	return secs;
+}
+/* }}} */
+
+
+/** {{{ BeatQuery::BeatQuery()
+ */
+BeatQuery::BeatQuery()
+{
+	m_sampsPerSec = 1;
+	m_anySubtype = true;
+	m_subtype = 0;
+	m_from = 0;
+	m_to = -1;
+}
+/* }}} */
+
+
+/** {{{ bool BeatQuery::parse_types( const QString &list )
+    @brief Add the comma separated types in list, given by mnemonic or code
+*/
+bool BeatQuery::parse_types( const QString &list )
+{
+	foreach ( const QString &name, list.split( ',', QString::SkipEmptyParts ) ) {
+		bool isCode;
+		int type = name.toInt( &isCode );
+		if ( ! isCode ) {
+			/* strann() goes through WFDB's globals */
+			QMutexLocker locker( &glb_wfdb_mutex );
+			type = strann( name.toLatin1().data() );
+		}
+		if ( type <= NOTQRS || type > ACMAX ) {
+			m_error = QObject::tr("no annotation type %1").arg( name );
+			return false;
+		}
+		m_types.append( type );
+	}
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatQuery::parse( const QString &text, int sampsPerSec )
+    @return false with error() saying why if text is not a query
+*/
+bool BeatQuery::parse( const QString &text, int sampsPerSec )
+{
+	*this = BeatQuery();
+	m_sampsPerSec = qMax( 1, sampsPerSec );
+
+	QRegularExpression termSyntax( "^(type|sub|from|to|hr|rr|aux)(<=|>=|=|<|>)(.+)$", QRegularExpression::CaseInsensitiveOption );
+
+	foreach ( const QString &term, text.split( ' ', QString::SkipEmptyParts ) ) {
+		QRegularExpressionMatch match = termSyntax.match( term );
+		if ( ! match.hasMatch() ) {
+			if ( ! parse_types( term ) ) {
+				return false;
+			}
+			continue;
+		}
+
+		QString key = match.captured(1).toLower();
+		QString op = match.captured(2);
+		QString value = match.captured(3);
+		bool ok = true;
+
+		if ( op != "=" && key != "hr" && key != "rr" ) {
+			m_error = QObject::tr("%1 only takes =").arg( key );
+			return false;
+		}
+
+		if ( key == "type" ) {
+			if ( ! parse_types( value ) ) {
+				return false;
+			}
+		} else if ( key == "sub" ) {
+			m_anySubtype = false;
+			m_subtype = value.toInt( &ok );
+		} else if ( key == "from" ) {
+			m_from = parse_clock( value, &ok ) * m_sampsPerSec;
+		} else if ( key == "to" ) {
+			m_to = parse_clock( value, &ok ) * m_sampsPerSec;
+		} else if ( key == "aux" ) {
+			m_aux = value;
+		} else {
+			Limit limit;
+			limit.hr = ( key == "hr" );
+			limit.op = op;
+			limit.value = value.toDouble( &ok );
+			m_limits.append( limit );
+		}
+
+		if ( ! ok ) {
+			m_error = QObject::tr("cannot make sense of %1").arg( term );
+			return false;
+		}
+	}
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool BeatQuery::matches( const BeatStore &beats, const RRSeries &rr, int b, const QVector<bool> &auxMatch ) const
+    @brief Whether annotation b passes every term; the time range was already applied
+*/
+bool BeatQuery::matches( const BeatStore &beats, const RRSeries &rr, int b, const QVector<bool> &auxMatch ) const
+{
+	if ( ! m_anySubtype && beats.subtype( b ) != m_subtype ) {
+		return false;
+	}
+	if ( ! auxMatch.isEmpty() && ! auxMatch[ beats.auxId( b ) ] ) {
+		return false;
+	}
+	if ( m_limits.isEmpty() ) {
+		return true;
+	}
+	if ( m_types.isEmpty() && ! BeatStore::isBeat( beats.type( b ) ) ) {
+		return false;
+	}
+
+	int interval = rr.intervalBefore( b );
+	if ( interval <= 0 ) {
+		return false;
+	}
+
+	foreach ( const Limit &limit, m_limits ) {
+		double v = limit.hr ? 60.0 * m_sampsPerSec / interval : (double) interval / m_sampsPerSec;
+		bool pass = ( limit.op == "<" )  ? v < limit.value
+				  : ( limit.op == "<=" ) ? v <= limit.value
+				  : ( limit.op == ">" )  ? v > limit.value
+				  : ( limit.op == ">=" ) ? v >= limit.value
+				  : limit.hr             ? qRound( v ) == qRound( limit.value )
+				  :                        qRound( v * 1000 ) == qRound( limit.value * 1000 );
+		if ( ! pass ) {
+			return false;
+		}
+	}
+	return true;
+}
+/* }}} */
+
+
+/** {{{ QVector<int> BeatQuery::run( const BeatStore &beats, const RRSeries &rr ) const
+    @brief Indexes of the annotations that match, in order
+*/
+QVector<int> BeatQuery::run( const BeatStore &beats, const RRSeries &rr ) const
+{
+	int first = beats.lowerBound( m_from );
+	int last = ( m_to < 0 ) ? beats.size() : beats.lowerBound( m_to );
+
+	/* the annotations to test; empty means all of first up to last */
+	QVector<int> candidates;
+	if ( ! m_types.isEmpty() ) {
+		foreach ( int type, m_types ) {
+			const QVector<int> &ofType = beats.indexesOfType( type );
+			QVector<int>::const_iterator from = std::lower_bound( ofType.constBegin(), ofType.constEnd(), first );
+			QVector<int>::const_iterator to = std::lower_bound( from, ofType.constEnd(), last );
+			for ( ; from != to ; ++from ) {
+				candidates.append( *from );
+			}
+		}
+		if ( m_types.size() > 1 ) {
+			std::sort( candidates.begin(), candidates.end() );
+		}
+		if ( candidates.isEmpty() ) {
+			return candidates;
+		}
+	}
+
+	QVector<bool> auxMatch;
+	if ( ! m_aux.isEmpty() ) {
+		const QVector<QString> &strings = beats.auxStrings();
+		auxMatch.resize( strings.size() );
+		for ( int i = 0 ; i < strings.size() ; i++ ) {
+			auxMatch[i] = strings[i].contains( m_aux, Qt::CaseInsensitive );
+		}
+	}
+
+	int count = candidates.isEmpty() ? qMax( 0, last - first ) : candidates.size();
+	int chunks = ( count + BEAT_QUERY_CHUNK - 1 ) / BEAT_QUERY_CHUNK;
+	QVector< QVector<int> > found( chunks );
+	QVector<int> indexes( chunks );
+	for ( int c = 0 ; c < chunks ; c++ ) {
+		indexes[c] = c;
+	}
+
+	QtConcurrent::blockingMap( indexes, [&]( int c ) {
+		int end = qMin( count, ( c + 1 ) * BEAT_QUERY_CHUNK );
+		for ( int k = c * BEAT_QUERY_CHUNK ; k < end ; k++ ) {
+			int b = candidates.isEmpty() ? first + k : candidates[k];
+			if ( matches( beats, rr, b, auxMatch ) ) {
+				found[c].append( b );
+			}
+		}
+	} );
+
+	QVector<int> results;
+	foreach ( const QVector<int> &part, found ) {
+		results += part;
+	}
+	return results;
+}
+/* }}} */
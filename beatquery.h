@@ -0,0 +1,81 @@
+/**
+ * @file beatquery.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BEATQUERY_H
+#define BEATQUERY_H
+
+#include <QtCore>
+#include "beatstore.h"
+#include "rrseries.h"
+
+
+#define BEAT_QUERY_CHUNK	(64*1024)	/**< annotations tested by one worker at a time */
+
+
+/* {{{ class BeatQuery
+   @brief	A search of the annotations, such as "V hr>120 from=2:00 to=5:00"
+
+   A query is a list of terms separated by spaces, all of which have to hold:
+
+	V,A				any of these types, by mnemonic or code (also type=V,A)
+	sub=1			this subtype
+	from=2:00		at or after h:mm[:ss] from the start of the record
+	to=5:00			... and before
+	hr>120			the heart rate from the interval before the annotation,
+					with <, <=, >, >= or =
+	rr>2.5			that interval in seconds
+	aux=TACH		aux text containing TACH, in any case
+
+   Without a type, hr and rr only look at beats.  With types the candidates
+   come from the per-type indexes, otherwise from the time range; either way
+   they are tested in parallel chunks of BEAT_QUERY_CHUNK.
+*/
+class BeatQuery
+{
+public:
+	BeatQuery();
+
+	bool parse( const QString &text, int sampsPerSec );
+	const QString &error() const { return m_error; }
+	QVector<int> run( const BeatStore &beats, const RRSeries &rr ) const;
+
+private:
+	struct Limit
+	{
+		bool hr;			/**< on the heart rate, else on the interval in seconds */
+		QString op;
+		double value;
+	};
+
+	bool parse_types( const QString &list );
+	bool matches( const BeatStore &beats, const RRSeries &rr, int b, const QVector<bool> &auxMatch ) const;
+
+	int m_sampsPerSec;
+	QVector<int> m_types;
+	bool m_anySubtype;
+	int m_subtype;
+	qint64 m_from;
+	qint64 m_to;			/**< -1 for the end of the record */
+	QVector<Limit> m_limits;
+	QString m_aux;
+	QString m_error;
+};
+/* }}} */
+
+#endif // BEATQUERY_H
@@ -0,0 +1,465 @@
+/**
+ * @file beatstore.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <algorithm>
+
+#include "beatstore.h"
+
+
+/** {{{ static int rank_in( const QVector<int> &list, int index )
+    @brief How many of the ascending annotation indexes in list come before index
+*/
+static int rank_in( const QVector<int> &list, int index )
+{
+	return std::lower_bound( list.constBegin(), list.constEnd(), index ) - list.constBegin();
+}
+/* }}} */
+
+
+/** {{{ BeatStore::BeatStore()
+ */
+BeatStore::BeatStore()
+{
+	m_auxPool.append( QString() );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::clear()
+ */
+void BeatStore::clear()
+{
+	m_pos.clear();
+	m_type.clear();
+	m_subtype.clear();
+	m_aux.clear();
+	for ( int t = 0 ; t < BEAT_TYPE_COUNT ; t++ ) {
+		m_byType[t].clear();
+	}
+	m_rhythmByAux.clear();
+	m_auxPool.resize( 1 );
+	m_auxIndex.clear();
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::reserve( int count )
+ */
+void BeatStore::reserve( int count )
+{
+	m_pos.reserve( count );
+	m_type.reserve( count );
+	m_subtype.reserve( count );
+	m_aux.reserve( count );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::append( qint64 pos, int type, int subtype, const QString &aux )
+    @brief Add an annotation; they are expected in order of position
+*/
+void BeatStore::append( qint64 pos, int type, int subtype, const QString &aux )
+{
+	m_byType[type & 0xff].append( m_pos.size() );
+	m_pos.append( pos );
+	m_type.append( (quint8) type );
+	m_subtype.append( (quint8) subtype );
+	m_aux.append( intern( aux ) );
+	if ( ( type & 0xff ) == RHYTHM ) {
+		m_rhythmByAux[ m_aux.last() ].append( m_pos.size() - 1 );
+	}
+}
+/* }}} */
+
+
+/** {{{ BeatInfo BeatStore::at( int i ) const
+    @brief Annotation i as a BeatInfo, for code that wants all of it at once
+*/
+BeatInfo BeatStore::at( int i ) const
+{
+	BeatInfo beat( m_pos[i], m_type[i] );
+	beat.putSubtype( subtype(i) );
+	beat.annotationString = aux(i);
+	return beat;
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::lowerBound( qint64 pos ) const
+    @brief Index of the first annotation at or after pos, size() if there is none
+*/
+int BeatStore::lowerBound( qint64 pos ) const
+{
+	return std::lower_bound( m_pos.constBegin(), m_pos.constEnd(), pos ) - m_pos.constBegin();
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::setType( int i, int type )
+    @brief Change the type of annotation i, moving it to the list of its new type
+*/
+void BeatStore::setType( int i, int type )
+{
+	int oldType = m_type[i];
+	type &= 0xff;
+	if ( oldType == type ) {
+		return;
+	}
+
+	QVector<int> &from = m_byType[oldType];
+	from.remove( rankInType( oldType, i ) );
+
+	QVector<int> &to = m_byType[type];
+	to.insert( rankInType( type, i ), i );
+
+	unindex_rhythm( i );
+	m_type[i] = (quint8) type;
+	index_rhythm( i );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::setAux( int i, const QString &aux )
+    @brief Change the aux string of annotation i, which for a rhythm change is the rhythm
+*/
+void BeatStore::setAux( int i, const QString &aux )
+{
+	unindex_rhythm( i );
+	m_aux[i] = intern( aux );
+	index_rhythm( i );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::index_rhythm( int i )
+    @brief Add annotation i to the list of its rhythm, if it is a rhythm change
+*/
+void BeatStore::index_rhythm( int i )
+{
+	if ( m_type[i] == RHYTHM ) {
+		QVector<int> &list = m_rhythmByAux[ m_aux[i] ];
+		list.insert( rank_in( list, i ), i );
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::unindex_rhythm( int i )
+    @brief Take annotation i out of the list of its rhythm, if it is a rhythm change
+*/
+void BeatStore::unindex_rhythm( int i )
+{
+	if ( m_type[i] != RHYTHM ) {
+		return;
+	}
+	QHash<quint32,QVector<int> >::iterator found = m_rhythmByAux.find( m_aux[i] );
+	if ( found == m_rhythmByAux.end() ) {
+		return;
+	}
+	found.value().remove( rank_in( found.value(), i ) );
+	if ( found.value().isEmpty() ) {
+		m_rhythmByAux.erase( found );
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::shift_indexes( int from, int by )
+    @brief Move every listed annotation index from onwards by by, for an insert or remove
+*/
+void BeatStore::shift_indexes( int from, int by )
+{
+	for ( int t = 0 ; t < BEAT_TYPE_COUNT ; t++ ) {
+		QVector<int> &list = m_byType[t];
+		for ( int r = rankInType( t, from ) ; r < list.size() ; r++ ) {
+			list[r] += by;
+		}
+	}
+	for ( QHash<quint32,QVector<int> >::iterator it = m_rhythmByAux.begin() ; it != m_rhythmByAux.end() ; ++it ) {
+		QVector<int> &list = it.value();
+		for ( int r = rank_in( list, from ) ; r < list.size() ; r++ ) {
+			list[r] += by;
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::insert( int i, qint64 pos, int type, int subtype, const QString &aux )
+    @brief Add an annotation at index i; pos has to keep the positions in order
+*/
+void BeatStore::insert( int i, qint64 pos, int type, int subtype, const QString &aux )
+{
+	shift_indexes( i, +1 );
+	m_byType[type & 0xff].insert( rankInType( type, i ), i );
+
+	m_pos.insert( i, pos );
+	m_type.insert( i, (quint8) type );
+	m_subtype.insert( i, (quint8) subtype );
+	m_aux.insert( i, intern( aux ) );
+	index_rhythm( i );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::remove( int i )
+    @brief Take annotation i out
+*/
+void BeatStore::remove( int i )
+{
+	m_byType[ m_type[i] ].remove( rankInType( m_type[i], i ) );
+	unindex_rhythm( i );
+	shift_indexes( i, -1 );
+
+	m_pos.remove( i );
+	m_type.remove( i );
+	m_subtype.remove( i );
+	m_aux.remove( i );
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::setTypes( int first, const QVector<quint8> &types )
+    @brief Change the types of annotations first onwards at once, e.g. to relabel a whole run
+*/
+void BeatStore::setTypes( int first, const QVector<quint8> &types )
+{
+	for ( int i = 0 ; i < types.size() ; i++ ) {
+		m_type[first + i] = types[i];
+	}
+	rebuild_type_index();
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::setTypes( const QVector<int> &indexes, const QVector<quint8> &types )
+    @brief Change the types of annotations scattered through the store at once, e.g. a whole cluster
+*/
+void BeatStore::setTypes( const QVector<int> &indexes, const QVector<quint8> &types )
+{
+	for ( int i = 0 ; i < indexes.size() ; i++ ) {
+		m_type[ indexes[i] ] = types[i];
+	}
+	rebuild_type_index();
+}
+/* }}} */
+
+
+/** {{{ void BeatStore::rebuild_type_index()
+    @brief Work out the list of each type again from the types
+*/
+void BeatStore::rebuild_type_index()
+{
+	for ( int t = 0 ; t < BEAT_TYPE_COUNT ; t++ ) {
+		m_byType[t].clear();
+	}
+	m_rhythmByAux.clear();
+	for ( int i = 0 ; i < m_type.size() ; i++ ) {
+		m_byType[ m_type[i] ].append( i );
+		if ( m_type[i] == RHYTHM ) {
+			m_rhythmByAux[ m_aux[i] ].append( i );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::rankInType( int type, int index ) const
+    @brief How many annotations of type come before annotation index
+*/
+int BeatStore::rankInType( int type, int index ) const
+{
+	return rank_in( m_byType[type & 0xff], index );
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::countOfType( int type, qint64 from, qint64 to ) const
+    @brief How many annotations of type lie at positions from up to, not including, to
+*/
+int BeatStore::countOfType( int type, qint64 from, qint64 to ) const
+{
+	if ( to <= from ) {
+		return 0;
+	}
+	return rankInType( type, lowerBound( to ) ) - rankInType( type, lowerBound( from ) );
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::nextOfType( int type, int afterIndex ) const
+    @brief The first annotation of type after annotation afterIndex
+*/
+int BeatStore::nextOfType( int type, int afterIndex ) const
+{
+	const QVector<int> &list = m_byType[type & 0xff];
+	int rank = std::upper_bound( list.constBegin(), list.constEnd(), afterIndex ) - list.constBegin();
+	return ( rank < list.size() ) ? list[rank] : -1;
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::prevOfType( int type, int beforeIndex ) const
+    @brief The last annotation of type before annotation beforeIndex
+*/
+int BeatStore::prevOfType( int type, int beforeIndex ) const
+{
+	const QVector<int> &list = m_byType[type & 0xff];
+	int rank = rankInType( type, beforeIndex );
+	return ( rank > 0 ) ? list[rank - 1] : -1;
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::nthOfType( int type, int n ) const
+    @brief The n-th annotation of type, counting from 0
+*/
+int BeatStore::nthOfType( int type, int n ) const
+{
+	const QVector<int> &list = m_byType[type & 0xff];
+	return ( n >= 0 && n < list.size() ) ? list[n] : -1;
+}
+/* }}} */
+
+
+/** {{{ QList<int> BeatStore::typesPresent() const
+    @brief Every type that has at least one annotation, in ascending order
+*/
+QList<int> BeatStore::typesPresent() const
+{
+	QList<int> types;
+	for ( int t = 0 ; t < BEAT_TYPE_COUNT ; t++ ) {
+		if ( ! m_byType[t].isEmpty() ) {
+			types.append( t );
+		}
+	}
+	return types;
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::countOfRhythm( quint32 auxId, qint64 from, qint64 to ) const
+    @brief How many changes to the rhythm auxId lie at positions from up to, not including, to
+*/
+int BeatStore::countOfRhythm( quint32 auxId, qint64 from, qint64 to ) const
+{
+	if ( to <= from ) {
+		return 0;
+	}
+	const QVector<int> list = m_rhythmByAux.value( auxId );
+	return rank_in( list, lowerBound( to ) ) - rank_in( list, lowerBound( from ) );
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::nextOfRhythm( quint32 auxId, int afterIndex ) const
+    @brief The first change to the rhythm auxId after annotation afterIndex
+*/
+int BeatStore::nextOfRhythm( quint32 auxId, int afterIndex ) const
+{
+	const QVector<int> list = m_rhythmByAux.value( auxId );
+	int rank = std::upper_bound( list.constBegin(), list.constEnd(), afterIndex ) - list.constBegin();
+	return ( rank < list.size() ) ? list[rank] : -1;
+}
+/* }}} */
+
+
+/** {{{ int BeatStore::prevOfRhythm( quint32 auxId, int beforeIndex ) const
+    @brief The last change to the rhythm auxId before annotation beforeIndex
+*/
+int BeatStore::prevOfRhythm( quint32 auxId, int beforeIndex ) const
+{
+	const QVector<int> list = m_rhythmByAux.value( auxId );
+	int rank = rank_in( list, beforeIndex );
+	return ( rank > 0 ) ? list[rank - 1] : -1;
+}
+/* }}} */
+
+
+/** {{{ QList<quint32> BeatStore::rhythmsPresent() const
+    @brief The aux id of every rhythm changed to at least once, in order of the strings
+*/
+QList<quint32> BeatStore::rhythmsPresent() const
+{
+	QMap<QString,quint32> byName;
+	for ( QHash<quint32,QVector<int> >::const_iterator it = m_rhythmByAux.constBegin() ; it != m_rhythmByAux.constEnd() ; ++it ) {
+		byName.insert( m_auxPool[ it.key() ], it.key() );
+	}
+	return byName.values();
+}
+/* }}} */
+
+
+/** {{{ bool BeatStore::isBeat( int type )
+    @brief Whether type is a heart beat
+
+    Decided here rather than with isqrs(), since the WFDB macros go through
+    globals.  PACE marks a pacer spike in these records, not a beat.
+*/
+bool BeatStore::isBeat( int type )
+{
+	switch ( type ) {
+		case NORMAL:
+		case LBBB:
+		case RBBB:
+		case ABERR:
+		case PVC:
+		case FUSION:
+		case NPC:
+		case APC:
+		case SVPB:
+		case VESC:
+		case NESC:
+		case AESC:
+		case SVESC:
+		case PFUS:
+		case UNKNOWN:
+		case FLWAV:
+		case RONT:
+		case BBB:
+			return true;
+
+		default:
+			return false;
+	}
+}
+/* }}} */
+
+
+/** {{{ quint32 BeatStore::intern( const QString &aux )
+    @brief Index of aux in the string pool, adding it the first time it is seen
+*/
+quint32 BeatStore::intern( const QString &aux )
+{
+	if ( aux.isEmpty() ) {
+		return 0;
+	}
+
+	QHash<QString,quint32>::const_iterator found = m_auxIndex.constFind( aux );
+	if ( found != m_auxIndex.constEnd() ) {
+		return found.value();
+	}
+
+	quint32 index = m_auxPool.size();
+	m_auxPool.append( aux );
+	m_auxIndex.insert( aux, index );
+	return index;
+}
+/* }}} */
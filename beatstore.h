@@ -0,0 +1,122 @@
+/**
+ * @file beatstore.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef BEATSTORE_H
+#define BEATSTORE_H
+
+#include <QtCore>
+#include "beatinfo.h"
+
+
+#define BEAT_TYPE_COUNT		(256)	/**< types are stored in a byte */
+
+
+/* {{{ class BeatStore
+   @brief	The annotations of a record, one array per field
+
+   Positions are kept in one contiguous array so searching and walking
+   through them only touches positions.  The aux strings, which most
+   annotations do not have, are interned: each annotation holds an index
+   into a pool of distinct strings, with 0 meaning none.
+
+   For each type there is also the list of the annotations of that type,
+   in order, kept up to date by append() and setType().  Finding the next
+   or previous annotation of a type, or counting them in a stretch, is a
+   binary search in that list rather than a walk through all of them.
+
+   Rhythm changes are all of type RHYTHM, with the rhythm in the aux
+   string, so they are also listed by aux string to be found by rhythm.
+
+   Every member is an implicitly shared Qt container, so copying a store
+   is cheap and the copies share memory until one of them is changed.
+*/
+class BeatStore
+{
+public:
+	BeatStore();
+
+	int size() const { return m_pos.size(); }
+	bool isEmpty() const { return m_pos.isEmpty(); }
+	void clear();
+	void reserve( int count );
+
+	void append( qint64 pos, int type, int subtype = 0, const QString &aux = QString() );
+	void append( const BeatInfo &beat ) { append( beat.pos_samps, beat.type, beat.subtype, beat.annotationString ); }
+
+	qint64 pos( int i ) const { return m_pos[i]; }
+	int type( int i ) const { return m_type[i]; }
+	int subtype( int i ) const { return (signed char) m_subtype[i]; }	/* WFDB subtypes are signed */
+	bool hasAux( int i ) const { return m_aux[i] != 0; }
+	const QString &aux( int i ) const { return m_auxPool[ m_aux[i] ]; }
+	BeatInfo at( int i ) const;
+
+	void setType( int i, int type );
+	void setAux( int i, const QString &aux );
+
+	/* editing; these move the later annotations, so cost a pass over the store */
+	void insert( int i, qint64 pos, int type, int subtype = 0, const QString &aux = QString() );
+	void remove( int i );
+	QVector<quint8> types( int first, int last ) const { return m_type.mid( first, last - first ); }
+	void setTypes( int first, const QVector<quint8> &types );
+	void setTypes( const QVector<int> &indexes, const QVector<quint8> &types );
+
+	const QVector<qint64> &positions() const { return m_pos; }
+	const QVector<int> &indexesOfType( int type ) const { return m_byType[type & 0xff]; }
+	quint32 auxId( int i ) const { return m_aux[i]; }
+	const QVector<QString> &auxStrings() const { return m_auxPool; }	/* indexed by auxId() */
+	int lowerBound( qint64 pos ) const;
+
+	/* by type; all return annotation indexes, -1 when there is none */
+	int countOfType( int type ) const { return m_byType[type & 0xff].size(); }
+	int countOfType( int type, qint64 from, qint64 to ) const;
+	int nextOfType( int type, int afterIndex ) const;
+	int prevOfType( int type, int beforeIndex ) const;
+	int nthOfType( int type, int n ) const;
+	QList<int> typesPresent() const;
+
+	/* RHYTHM annotations by their aux string; auxId 0 is those without one */
+	int countOfRhythm( quint32 auxId ) const { return m_rhythmByAux.value( auxId ).size(); }
+	int countOfRhythm( quint32 auxId, qint64 from, qint64 to ) const;
+	int nextOfRhythm( quint32 auxId, int afterIndex ) const;
+	int prevOfRhythm( quint32 auxId, int beforeIndex ) const;
+	QList<quint32> rhythmsPresent() const;
+
+	static bool isBeat( int type );
+
+private:
+	quint32 intern( const QString &aux );
+	int rankInType( int type, int index ) const;
+	void rebuild_type_index();
+	void index_rhythm( int i );
+	void unindex_rhythm( int i );
+	void shift_indexes( int from, int by );
+
+	QVector<qint64> m_pos;
+	QVector<quint8> m_type;
+	QVector<quint8> m_subtype;
+	QVector<quint32> m_aux;
+	QVector<int> m_byType[BEAT_TYPE_COUNT];	/**< annotation indexes of each type, ascending */
+	QHash<quint32,QVector<int> > m_rhythmByAux;	/**< RHYTHM annotation indexes of each aux string, ascending */
+
+	QVector<QString> m_auxPool;			/**< distinct aux strings; the first is the empty one */
+	QHash<QString,quint32> m_auxIndex;
+};
+/* }}} */
+
+#endif // BEATSTORE_H
@@ -0,0 +1,242 @@
+/**
+ * @file displayfilter.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtConcurrent>
+#include <math.h>
+
+#include "ecgdata.h"
+#include "displayfilter.h"
+
+
+/** {{{ FilterCache::FilterCache( EcgData *record )
+ */
+FilterCache::FilterCache( EcgData *record )
+	: m_record( record )
+{
+	m_blocks.setMaxCost( FILTER_CACHE_BLOCKS );
+}
+/* }}} */
+
+
+/** {{{ FilterCache::~FilterCache()
+ */
+FilterCache::~FilterCache()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+/* }}} */
+
+
+/** {{{ void FilterCache::clear()
+    @brief Forget every filtered block, e.g. when the samples are about to go
+*/
+void FilterCache::clear()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+
+	QMutexLocker locker( &m_mutex );
+	m_blocks.clear();
+	m_pending.clear();
+}
+/* }}} */
+
+
+/** {{{ QVector<FilterCache::Biquad> FilterCache::design( quint32 filters ) const
+    @brief The sections for a setting, leaving out any above the Nyquist frequency
+*/
+QVector<FilterCache::Biquad> FilterCache::design( quint32 filters ) const
+{
+	QVector<Biquad> sections;
+	double fs = qMax( 1, m_record->samps_per_chan_per_sec );
+
+	struct Wanted {
+		quint32 flag;
+		char kind;			/* h(igh pass), n(otch) or l(ow pass) */
+		double hz;
+		double q;
+	} wanted[] = {
+		{ FILTER_BASELINE,	'h', FILTER_BASELINE_HZ,	M_SQRT1_2 },
+		{ FILTER_NOTCH_50,	'n', 50.0,					FILTER_NOTCH_Q },
+		{ FILTER_NOTCH_60,	'n', 60.0,					FILTER_NOTCH_Q },
+		{ FILTER_MUSCLE,	'l', FILTER_MUSCLE_HZ,		M_SQRT1_2 },
+	};
+
+	for ( unsigned w = 0 ; w < sizeof(wanted) / sizeof(wanted[0]) ; w++ ) {
+		if ( ! ( filters & wanted[w].flag ) || wanted[w].hz >= fs / 2 ) {
+			continue;
+		}
+
+		/* the Audio EQ Cookbook's sections */
+		double w0 = 2 * M_PI * wanted[w].hz / fs;
+		double alpha = sin( w0 ) / ( 2 * wanted[w].q );
+		double c = cos( w0 );
+		double a0 = 1 + alpha;
+		double b0, b1, b2;
+		switch ( wanted[w].kind ) {
+			case 'h':	b0 = ( 1 + c ) / 2;	b1 = -( 1 + c );	b2 = ( 1 + c ) / 2;	break;
+			case 'l':	b0 = ( 1 - c ) / 2;	b1 = 1 - c;			b2 = ( 1 - c ) / 2;	break;
+			default:	b0 = 1;				b1 = -2 * c;		b2 = 1;				break;
+		}
+
+		Biquad bq;
+		bq.b0 = b0 / a0;
+		bq.b1 = b1 / a0;
+		bq.b2 = b2 / a0;
+		bq.a1 = -2 * c / a0;
+		bq.a2 = ( 1 - alpha ) / a0;
+		sections.append( bq );
+	}
+	return sections;
+}
+/* }}} */
+
+
+/** {{{ void FilterCache::run( const Biquad &bq, float *x, long n, bool backwards )
+    @brief Filter x in place, starting as if the first sample had always been there
+*/
+void FilterCache::run( const Biquad &bq, float *x, long n, bool backwards )
+{
+	if ( n <= 0 ) {
+		return;
+	}
+
+	long i = backwards ? n - 1 : 0;
+	long step = backwards ? -1 : 1;
+
+	/* the state a constant input of x[i] would have left, so there is no step at the start */
+	float gain = ( bq.b0 + bq.b1 + bq.b2 ) / ( 1 + bq.a1 + bq.a2 );
+	float z1 = ( gain - bq.b0 ) * x[i];
+	float z2 = ( bq.b2 - bq.a2 * gain ) * x[i];
+
+	for ( long k = 0 ; k < n ; k++, i += step ) {
+		float in = x[i];
+		float out = bq.b0 * in + z1;
+		z1 = bq.b1 * in - bq.a1 * out + z2;
+		z2 = bq.b2 * in - bq.a2 * out;
+		x[i] = out;
+	}
+}
+/* }}} */
+
+
+/** {{{ void FilterCache::compute( int channel, quint32 filters, long block )
+    @brief Filter one block; runs on m_pool
+*/
+void FilterCache::compute( int channel, quint32 filters, long block )
+{
+	const quint16 *samples = m_record->get_data_channel( channel );
+	long length = m_record->channel_length( channel );
+	long start = block * FILTER_BLOCK_SAMPLES;
+	long end = qMin( length, start + FILTER_BLOCK_SAMPLES );
+	long pad = (long) FILTER_PAD_SECONDS * m_record->samps_per_chan_per_sec;
+	long from = qMax( 0L, start - pad );
+	long to = qMin( length, end + pad );
+	float midpoint = m_record->range_per_sample / 2;
+
+	QVector<quint16> *filtered = new QVector<quint16>( qMax( 0L, end - start ) );
+	if ( samples != NULL && end > start ) {
+		QVector<float> x( to - from );
+		for ( long i = 0 ; i < x.size() ; i++ ) {
+			x[i] = samples[from + i] - midpoint;
+		}
+
+		foreach ( const Biquad &bq, design( filters ) ) {
+			run( bq, x.data(), x.size(), false );
+			if ( filters & FILTER_ZERO_PHASE ) {
+				run( bq, x.data(), x.size(), true );
+			}
+		}
+
+		quint16 *out = filtered->data();
+		const float *in = x.constData() + ( start - from );
+		for ( long i = 0 ; i < end - start ; i++ ) {
+			out[i] = (quint16) qBound( 0.0f, in[i] + midpoint + 0.5f, 65535.0f );
+		}
+	}
+
+	{
+		QMutexLocker locker( &m_mutex );
+		m_pending.remove( key( channel, filters, block ) );
+		m_blocks.insert( key( channel, filters, block ), filtered );
+	}
+	emit blockReady();
+}
+/* }}} */
+
+
+/** {{{ void FilterCache::schedule( int channel, quint32 filters, long block )
+    @brief Start filtering a block unless it is there or on its way; hold m_mutex
+*/
+void FilterCache::schedule( int channel, quint32 filters, long block )
+{
+	quint64 k = key( channel, filters, block );
+	if ( block < 0 || block * FILTER_BLOCK_SAMPLES >= m_record->channel_length( channel ) || m_blocks.contains( k ) || m_pending.contains( k ) ) {
+		return;
+	}
+	m_pending.insert( k );
+	QtConcurrent::run( &m_pool, [this, channel, filters, block]() {
+		compute( channel, filters, block );
+	} );
+}
+/* }}} */
+
+
+/** {{{ bool FilterCache::window( int channel, quint32 filters, long start, long count, QVector<quint16> &samples )
+    @brief Copy count filtered samples from start into samples, if they are all ready
+    @return false if some are still being filtered; samples is then incomplete
+*/
+bool FilterCache::window( int channel, quint32 filters, long start, long count, QVector<quint16> &samples )
+{
+	samples.resize( count );
+	if ( count <= 0 ) {
+		return true;
+	}
+
+	QMutexLocker locker( &m_mutex );
+
+	long firstBlock = start / FILTER_BLOCK_SAMPLES;
+	long lastBlock = ( start + count - 1 ) / FILTER_BLOCK_SAMPLES;
+	bool complete = true;
+
+	for ( long block = firstBlock ; block <= lastBlock ; block++ ) {
+		QVector<quint16> *filtered = m_blocks.object( key( channel, filters, block ) );
+		if ( filtered == NULL ) {
+			schedule( channel, filters, block );
+			complete = false;
+			continue;
+		}
+
+		long blockStart = block * FILTER_BLOCK_SAMPLES;
+		long from = qMax( start, blockStart );
+		long to = qMin( start + count, blockStart + (long) filtered->size() );
+		if ( to > from ) {
+			memcpy( samples.data() + ( from - start ), filtered->constData() + ( from - blockStart ), ( to - from ) * sizeof(quint16) );
+		}
+	}
+
+	/* scrolling will want the neighbours next */
+	schedule( channel, filters, firstBlock - 1 );
+	schedule( channel, filters, lastBlock + 1 );
+
+	return complete;
+}
+/* }}} */
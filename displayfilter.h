@@ -0,0 +1,89 @@
+/**
+ * @file displayfilter.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef DISPLAYFILTER_H
+#define DISPLAYFILTER_H
+
+#include <QtCore>
+
+class EcgData;
+
+
+/* display filter settings, or'ed together; 0 shows the samples as recorded */
+#define FILTER_BASELINE			(1 << 0)	/**< high pass against baseline wander */
+#define FILTER_NOTCH_50			(1 << 1)	/**< mains hum */
+#define FILTER_NOTCH_60			(1 << 2)
+#define FILTER_MUSCLE			(1 << 3)	/**< low pass against muscle noise */
+#define FILTER_ZERO_PHASE		(1 << 4)	/**< run every filter forwards and then backwards */
+
+#define FILTER_BASELINE_HZ		(0.5)
+#define FILTER_MUSCLE_HZ		(40.0)
+#define FILTER_NOTCH_Q			(30.0)
+
+#define FILTER_BLOCK_SAMPLES	(64*1024)	/**< filtered and cached in blocks this long */
+#define FILTER_PAD_SECONDS		(4)			/**< of the neighbouring samples filtered along with a block, for the filters to settle */
+#define FILTER_CACHE_BLOCKS		(96)		/**< blocks kept, over all channels and settings */
+
+
+/* {{{ class FilterCache
+   @brief	The record's samples as they look through the display filters
+
+   The filters are second order sections (high pass, notch, low pass) run
+   over a block plus FILTER_PAD_SECONDS either side, forwards and, for zero
+   phase, backwards as well.  Blocks are filtered on a thread pool of their
+   own and kept by channel, settings and block number.  window() only ever
+   copies from blocks that are ready; for any that are not it starts them
+   and says so, and blockReady() is emitted when each one is done, so a view
+   can draw the unfiltered samples for now and again once they are in.
+*/
+class FilterCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	FilterCache( EcgData *record );
+	~FilterCache();
+
+	bool window( int channel, quint32 filters, long start, long count, QVector<quint16> &samples );
+	void clear();
+
+signals:
+	void blockReady();
+
+private:
+	struct Biquad
+	{
+		float b0, b1, b2, a1, a2;
+	};
+
+	static quint64 key( int channel, quint32 filters, long block ) { return ( (quint64) filters << 40 ) | ( (quint64) channel << 32 ) | (quint64) block; }
+	QVector<Biquad> design( quint32 filters ) const;
+	static void run( const Biquad &bq, float *x, long n, bool backwards );
+	void schedule( int channel, quint32 filters, long block );
+	void compute( int channel, quint32 filters, long block );
+
+	EcgData *m_record;
+	QMutex m_mutex;					/**< guards m_blocks and m_pending */
+	QCache<quint64, QVector<quint16> > m_blocks;
+	QSet<quint64> m_pending;
+	QThreadPool m_pool;
+};
+/* }}} */
+
+#endif // DISPLAYFILTER_H
@@ -28,6 +28,7 @@
 #include <QString>
 #include <QStringList>
 #include <QProgressDialog>
+#include <QtConcurrent>
 #include <math.h>
 
 #include "myheader.h"
@@ -47,13 +48,20 @@
 /* TODO add more comments to this file */
 
 
+QMutex glb_wfdb_mutex;
+
+QHash<QString,EcgData *> EcgData::s_records;
+
+
 
 
 /** {{{ EcgData::EcgData()
   @brief Define a constructor for holding the ECG data
  */
 EcgData::EcgData( QWidget *parent )
+    : filtered(this), m_refs(1)
 {
+    m_reindexPending = false;
     Q_UNUSED(parent);
     device_range_mV = 10;
     range_per_sample = 50000;
@@ -63,6 +71,11 @@ EcgData::EcgData( QWidget *parent )
     signal_format_specifier = 311;
     bytes_per_samp = 4;
     viewableDateTime = QDateTime( QDate::currentDate(), QTime(0,0,0) );
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        chlen[ch] = 0;
+        chsum[ch] = NULL;
+        chsumsq[ch] = NULL;
+    }
 }
 /* }}} */
 
@@ -71,7 +84,9 @@ EcgData::EcgData( QWidget *parent )
   @Brief
  */
 EcgData::EcgData( QString filename, QWidget *parent )
+    : filtered(this), m_refs(1)
 {
+    m_reindexPending = false;
     file_name = filename;
     device_range_mV = 10;
     range_per_sample = 50000;
@@ -82,6 +97,11 @@ EcgData::EcgData( QString filename, QWidget *parent )
     bytes_per_samp = 4;
     data_loading = true;
     viewableDateTime = QDateTime( QDate::currentDate(), QTime(0,0,0) );
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        chlen[ch] = 0;
+        chsum[ch] = NULL;
+        chsumsq[ch] = NULL;
+    }
 
     QProgressDialog progress("Loading data...", "Cancel Data load", 0, 24*60*60*256*3 );
     progress.setWindowModality(Qt::ApplicationModal);
@@ -90,19 +110,544 @@ EcgData::EcgData( QString filename, QWidget *parent )
     QObject::connect( this, SIGNAL(data_loaded_so_far(int)), &progress, SLOT(setValue(int)));
     QObject::connect( this, SIGNAL(loading_finished()), &progress, SLOT(cancel()));
 
-	QObject::connect( this, SIGNAL(pacer_spike_found(long)), parent, SLOT(store_pacer_position(long)) );
+	QObject::connect( this, SIGNAL(pacer_spikes_found()), parent, SLOT(pacer_spikes_found()) );
 
 	progress.show();
 
 	QCoreApplication::processEvents();
 
-    Load( parse_header(filename) );
-
-	/* load annotation file */
-    ShowSignal *ss = qobject_cast<ShowSignal *>( parent );
+	/* the annotation file does not depend on the samples, so read it while they are decoded */
 	QString recordName(filename);
 	recordName.mid( 0, recordName.lastIndexOf(".") );
-    ss->load_annotation_file( recordName.toLatin1().data(), (char*)"atr" );
+	QFuture<BeatStore> annotations = QtConcurrent::run( [recordName]() {
+		BeatStore found;
+		read_annotations( recordName, "atr", found );
+		return found;
+	} );
+
+    open( filename );
+
+	beats = annotations.result();
+	if ( beats.isEmpty() ) {
+		detect_beats();
+	}
+	edits.load( journal_file_name(), beats );
+	index_annotations();
+
+	m_registeredName = QFileInfo(filename).canonicalFilePath();
+	if ( ! m_registeredName.isEmpty() && ! s_records.contains( m_registeredName ) ) {
+		s_records.insert( m_registeredName, this );
+	}
+}
+/* }}} */
+
+
+/** {{{ EcgData *EcgData::acquire( QString filename )
+  @brief Another reference to the record already loaded from filename
+  @return NULL if no view has the record open; otherwise release() it when done
+
+  Only the user interface registers records, so this is for the GUI thread.
+ */
+EcgData *EcgData::acquire( QString filename )
+{
+	EcgData *ecgdata = s_records.value( QFileInfo(filename).canonicalFilePath() );
+	if ( ecgdata ) {
+		ecgdata->retain();
+	}
+	return ecgdata;
+}
+/* }}} */
+
+
+/** {{{ void EcgData::release( EcgData *ecgdata )
+  @brief Drop a reference to a record, freeing it when it was the last one
+ */
+void EcgData::release( EcgData *ecgdata )
+{
+	if ( ecgdata == NULL || ecgdata->m_refs.deref() ) {
+		return;
+	}
+
+	if ( s_records.value( ecgdata->m_registeredName ) == ecgdata ) {
+		s_records.remove( ecgdata->m_registeredName );
+	}
+	delete ecgdata;
+}
+/* }}} */
+
+
+/** {{{ int EcgData::open( QString filename )
+  @brief Read a record without any user interface
+
+  The constructor taking a filename wraps this in a progress dialog; batch
+  processing calls it directly from worker threads.
+ */
+int EcgData::open( QString filename )
+{
+    file_name = filename;
+    data_loading = true;
+
+    /* Load() shows progress by pumping events, and a slot run from there may
+       want WFDB too, so all WFDB has for the record is read before that */
+    QMutexLocker locker( &glb_wfdb_mutex );
+    QString dataFileName = parse_header( filename );
+    QVector<WFDB_Sample> wfdbSamples;
+    if ( wfdbSignalInfo ) {
+        read_wfdb_samples( wfdbSamples );
+    }
+    locker.unlock();
+
+    if ( ! Load( dataFileName, wfdbSamples ) ) {
+        return false;
+    }
+    map_channels();
+
+    return true;
+}
+/* }}} */
+
+
+/** {{{ void EcgData::index_annotations()
+    @brief Work out what is derived from the annotations; call whenever beats is replaced
+*/
+void EcgData::index_annotations()
+{
+	episodes.build( beats, size() );
+	rr.build( beats, samps_per_chan_per_sec, size() );
+	pacer.index_beats( beats );
+	compare_annotators();
+}
+/* }}} */
+
+
+/** {{{ void EcgData::detect_beats()
+    @brief Fill beats from the QRS detector, for records that come without annotations
+*/
+void EcgData::detect_beats()
+{
+	QVector<const quint16 *> channels;
+	long length = size();
+	for ( int ch = 0 ; ch < channel_count ; ch++ ) {
+		if ( chdata[ch] != NULL ) {
+			channels.append( chdata[ch] );
+			length = qMin( length, chlen[ch] );
+		}
+	}
+
+	QVector<qint64> found = QrsDetector::detect( channels, length, samps_per_chan_per_sec );
+
+	beats.clear();
+	beats.reserve( found.size() );
+	foreach ( qint64 pos, found ) {
+		beats.append( pos, NORMAL, QRS_DETECTED_SUBTYPE );
+	}
+}
+/* }}} */
+
+
+/** {{{ int EcgData::load_annotators( const QStringList &names )
+    @brief Read other annotation files of the record, all at once, to show and compare with beats
+    @return how many of them could be read; one already loaded under the same name is replaced
+*/
+int EcgData::load_annotators( const QStringList &names )
+{
+	QString recordName = file_name;
+	QVector<Annotator> loaded( names.size() );
+	QVector<bool> found( names.size() );
+	QVector<int> indexes( names.size() );
+	for ( int i = 0 ; i < names.size() ; i++ ) {
+		indexes[i] = i;
+	}
+
+	QtConcurrent::blockingMap( indexes, [&]( int i ) {
+		loaded[i].name = names[i];
+		found[i] = read_annotations( recordName, names[i].toLatin1().constData(), loaded[i].beats );
+	} );
+
+	int count = 0;
+	for ( int i = 0 ; i < loaded.size() ; i++ ) {
+		if ( ! found[i] ) {
+			continue;
+		}
+		int a = 0;
+		while ( a < annotators.size() && annotators[a].name != loaded[i].name ) {
+			a++;
+		}
+		if ( a < annotators.size() ) {
+			annotators[a] = loaded[i];
+		} else {
+			annotators.append( loaded[i] );
+		}
+		count++;
+	}
+
+	compare_annotators();
+	emit annotations_changed();
+	return count;
+}
+/* }}} */
+
+
+/** {{{ void EcgData::compare_annotators()
+    @brief Compare every other annotator beat by beat with beats
+
+    Beats the QRS detector put in are left out of the reference; with none
+    but those there is nothing to compare against.
+*/
+void EcgData::compare_annotators()
+{
+	if ( annotators.isEmpty() ) {
+		return;
+	}
+
+	int detected = 0;
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		detected += ( beats.subtype( b ) == QRS_DETECTED_SUBTYPE );
+	}
+
+	BeatStore reference = beats;
+	if ( detected > 0 ) {
+		reference.clear();
+		reference.reserve( beats.size() - detected );
+		for ( int b = 0 ; b < beats.size() ; b++ ) {
+			if ( beats.subtype( b ) != QRS_DETECTED_SUBTYPE ) {
+				reference.append( beats.pos( b ), beats.type( b ), beats.subtype( b ), beats.aux( b ) );
+			}
+		}
+	}
+
+	for ( int a = 0 ; a < annotators.size() ; a++ ) {
+		if ( reference.isEmpty() ) {
+			annotators[a].comparison.clear();
+		} else {
+			annotators[a].comparison.compare( reference, annotators[a].beats, samps_per_chan_per_sec );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ void EcgData::annotations_edited()
+    @brief beats were edited; bring what depends on them up to date and tell every view
+
+    The indexes are rebuilt once control is back in the event loop, so a
+    burst of edits, such as a key held down, costs one rebuild.  Until then
+    the views keep drawing their own copy of the beats with the old indexes;
+    anything that edits has to find its beats in beats itself, since the
+    views' copies may be behind by a few inserts or deletes.
+*/
+void EcgData::annotations_edited()
+{
+	if ( m_reindexPending ) {
+		return;
+	}
+	m_reindexPending = true;
+	QTimer::singleShot( 0, this, SLOT(index_edited_annotations()) );
+}
+/* }}} */
+
+
+/** {{{ void EcgData::index_edited_annotations()
+    @brief Rebuild what depends on beats after one or more edits, and tell every view
+*/
+void EcgData::index_edited_annotations()
+{
+	m_reindexPending = false;
+	index_annotations();
+	emit annotations_changed();
+}
+/* }}} */
+
+
+/* the MIT annotation format, as written by putann() */
+#define MIT_ANN_CODE		(0176000)		/**< annotation code bits of a word */
+#define MIT_ANN_CS			(10)			/**< ... and how far they are shifted */
+#define MIT_ANN_DATA		(01777)			/**< time increment, or the pseudo-annotation's data */
+#define MIT_ANN_SKIP		(59 << MIT_ANN_CS)	/**< followed by a 32 bit time increment */
+#define MIT_ANN_NUM			(60 << MIT_ANN_CS)
+#define MIT_ANN_SUB			(61 << MIT_ANN_CS)
+#define MIT_ANN_CHN			(62 << MIT_ANN_CS)
+#define MIT_ANN_AUX			(63 << MIT_ANN_CS)	/**< followed by the aux bytes, padded to a word */
+
+
+/* {{{ struct MitAnnotation
+   @brief	The annotation being put together while decoding a MIT annotation file
+*/
+struct MitAnnotation
+{
+	bool valid;
+	qint64 time;
+	int type;
+	int subtype;
+	const uchar *aux;		/**< points into the file, NULL if there is none */
+	int auxLen;				/**< the length byte */
+};
+/* }}} */
+
+
+/** {{{ static bool finish_mit_annotation( const MitAnnotation &ann, bool &inTable, BeatStore &beats )
+    @brief Store an annotation once all its pseudo-annotations have been read
+    @return false if the file needs something only getann() does
+
+    Like annopen(), the NOTE annotations at time 0 at the start of the file
+    are taken as the table of user defined mnemonics and not stored, and like
+    getann() the first annotation after them is dropped if it is at time 0.
+*/
+static bool finish_mit_annotation( const MitAnnotation &ann, bool &inTable, BeatStore &beats )
+{
+	QByteArray aux;
+	if ( ann.aux ) {
+		aux = QByteArray( (const char *) ann.aux, qstrnlen( (const char *) ann.aux, ann.auxLen ) );
+	}
+
+	if ( inTable ) {
+		if ( ann.time == 0 && ann.type == NOTE && ann.subtype == 0 ) {
+			if ( aux.startsWith( "## time resolution: " ) ) {
+				return false;			/* times have to be scaled to the record's frequency */
+			}
+			if ( ! aux.isEmpty() && ! aux.startsWith( '#' ) ) {
+				/* "code mnemonic description" */
+				QList<QByteArray> words = aux.simplified().split( ' ' );
+				int code = strtol( aux.constData(), NULL, 10 );
+				if ( words.size() >= 2 && code >= 0 && code <= ACMAX ) {
+					int descStart = aux.indexOf( words[1], aux.indexOf( words[0] ) + words[0].size() ) + words[1].size() + 1;
+					QByteArray desc = aux.mid( descStart );
+
+					QMutexLocker locker( &glb_wfdb_mutex );
+					setannstr( code, words[1].data() );
+					setanndesc( code, desc.isEmpty() ? NULL : desc.data() );
+				}
+			}
+			return true;
+		}
+		inTable = false;
+		if ( ann.time == 0 ) {
+			return true;
+		}
+	}
+
+	beats.append( ann.time, ann.type, (signed char) ann.subtype, QString::fromLatin1( aux ) );
+	return true;
+}
+/* }}} */
+
+
+/** {{{ static bool decode_mit_annotations( const uchar *data, qint64 size, BeatStore &beats )
+    @brief Decode a whole MIT format annotation file in one pass
+    @return false if getann() has to read it instead; beats is then incomplete
+
+    Each annotation is a little endian word holding the code and the time
+    since the previous one, followed by pseudo-annotations for a longer time
+    step, the subtype and the aux text.  NUM and CHN are not kept.
+*/
+static bool decode_mit_annotations( const uchar *data, qint64 size, BeatStore &beats )
+{
+	const uchar *p = data;
+	const uchar *end = data + ( size & ~1 );
+
+	/* an MIT file does not start with a zero byte, an AHA format one might */
+	if ( size >= 2 && p[0] == 0 && p[1] != 0 ) {
+		return false;
+	}
+
+	MitAnnotation ann;
+	memset( &ann, 0, sizeof(ann) );
+	bool inTable = true;
+	qint64 time = 0;
+
+	beats.reserve( size / 2 );		/* a beat is usually a single word */
+	while ( p < end ) {
+		unsigned word = p[0] | ( p[1] << 8 );
+		unsigned code = word & MIT_ANN_CODE;
+		p += 2;
+
+		if ( word == 0 ) {
+			break;				/* end of file */
+		}
+
+		switch ( code ) {
+			case MIT_ANN_SKIP:
+				if ( end - p < 4 ) {
+					p = end;
+					break;
+				}
+				/* high word first */
+				time += (qint32) ( ( (quint32) ( p[0] | ( p[1] << 8 ) ) << 16 ) | ( p[2] | ( p[3] << 8 ) ) );
+				p += 4;
+				break;
+
+			case MIT_ANN_SUB:
+				ann.subtype = word & MIT_ANN_DATA;
+				break;
+
+			case MIT_ANN_AUX:
+				{
+					int len = word & 0377;
+					ann.aux = p;
+					ann.auxLen = qMin( (qint64) len, (qint64) ( end - p ) );
+					p += qMin( (qint64) ( ( len + 1 ) & ~1 ), (qint64) ( end - p ) );
+				}
+				break;
+
+			case MIT_ANN_NUM:
+			case MIT_ANN_CHN:
+				break;
+
+			default:
+				if ( ann.valid && ! finish_mit_annotation( ann, inTable, beats ) ) {
+					return false;
+				}
+				time += word & MIT_ANN_DATA;
+				ann.valid = true;
+				ann.time = time;
+				ann.type = code >> MIT_ANN_CS;
+				ann.subtype = 0;
+				ann.aux = NULL;
+				ann.auxLen = 0;
+				break;
+		}
+	}
+
+	return ! ann.valid || finish_mit_annotation( ann, inTable, beats );
+}
+/* }}} */
+
+
+/** {{{ static int read_mapped_annotations( const QString &fileName, BeatStore &beats )
+    @brief Map the annotation file and decode it without going through getann()
+    @return 1 if beats was replaced, 0 if there is no such file, -1 if getann() has to read it
+*/
+static int read_mapped_annotations( const QString &fileName, BeatStore &beats )
+{
+	QFile file( fileName );
+	if ( ! file.open( QIODevice::ReadOnly ) ) {
+		return 0;
+	}
+
+	QByteArray contents;
+	const uchar *data = file.map( 0, file.size() );
+	if ( data == NULL ) {
+		contents = file.readAll();
+		data = (const uchar *) contents.constData();
+	}
+
+	BeatStore decoded;
+	if ( ! decode_mit_annotations( data, file.size(), decoded ) ) {
+		return -1;
+	}
+	beats = decoded;
+	return 1;
+}
+/* }}} */
+
+
+/** {{{ int EcgData::read_annotations( QString recordName, const char *ext, BeatStore &beats )
+  @brief Read the WFDB annotation file ext of recordName
+  @return true if the annotation file could be opened; beats is only replaced then
+ */
+int EcgData::read_annotations( QString recordName, const char *ext, BeatStore &beats )
+{
+	WFDB_Anninfo annoInfoAF;
+	QString pathRecord;
+	QString nameRecord;
+
+	QFileInfo pathComponents(recordName);
+	pathRecord = pathComponents.absolutePath();
+	nameRecord = record_name( recordName );
+
+	/* the same places the WFDB path below has, in the same order */
+	QString fileName = QString("%1.%2").arg(nameRecord).arg(ext);
+	int mapped = read_mapped_annotations( fileName, beats );
+	if ( mapped == 0 ) {
+		mapped = read_mapped_annotations( pathRecord + "/" + fileName, beats );
+	}
+	if ( mapped > 0 ) {
+		return true;
+	}
+
+	QMutexLocker locker( &glb_wfdb_mutex );
+
+	setwfdb( QString("./;;/;%1").arg(pathRecord).toLatin1().data() );
+
+	qDebug() << "wfdbpath = " << getwfdb();
+
+	qDebug() << QString("read_annotations(%1,%2)    setenv(DB,%3)").arg(nameRecord).arg(ext).arg(pathRecord);
+
+	annoInfoAF.name = (char *) ext;
+	annoInfoAF.stat = WFDB_READ;
+	if ( annopen( nameRecord.toLatin1().data(), &annoInfoAF, 1 ) < 0 ) {
+		// qDebug() << QString("read_annotations(%1,%2)   ERROR = %3").arg(nameRecord).arg(ext).arg( wfdb_error() );
+		return false;
+	}
+
+	beats.clear();
+	WFDB_Annotation ann;
+	while ( getann( 0, &ann ) == 0 ) {
+// #define SHOW_ALL_ANNOTATIONS
+#ifdef SHOW_ALL_ANNOTATIONS
+		qDebug() << QString( "DBR: %1  annstr(%2) = %3    aux='%4'" )
+			.arg( mstimstr( ann.time ) )
+			.arg( ( int ) ann.anntyp )
+			.arg( annstr( ann.anntyp ) )
+			.arg( ( char * ) ann.aux )
+			.toLatin1().constData();
+#endif
+		/* the aux field is a length byte followed by at most that many characters */
+		QString aux;
+		if ( ann.aux ) {
+			aux = QString::fromLatin1( ( char * ) &(ann.aux[1]), qstrnlen( ( char * ) &(ann.aux[1]), ann.aux[0] ) );
+		}
+		beats.append( ann.time, ann.anntyp, ann.subtyp, aux );
+	}
+
+	return true;
+}
+/* }}} */
+
+
+/** {{{ bool EcgData::write_annotations( QString fileName, const BeatStore &beats, int samps_per_sec )
+  @brief Write beats as a WFDB annotation file; the suffix of fileName names the annotator
+ */
+bool EcgData::write_annotations( QString fileName, const BeatStore &beats, int samps_per_sec )
+{
+	QFileInfo pathComponents(fileName);
+	QString recordName = pathComponents.absolutePath() + "/" + pathComponents.completeBaseName();
+	QByteArray annotator = pathComponents.suffix().toLatin1();
+	if ( annotator.isEmpty() ) {
+		annotator = "atr";
+	}
+
+	QMutexLocker locker( &glb_wfdb_mutex );
+
+	WFDB_Anninfo annoInfo;
+	annoInfo.name = annotator.data();
+	annoInfo.stat = WFDB_WRITE;
+	setafreq( samps_per_sec );
+	if ( annopen( recordName.toLatin1().data(), &annoInfo, 1 ) < 0 ) {
+		qDebug() << QString("write_annotations(%1)   ERROR = %2").arg(fileName).arg( wfdberror() );
+		return false;
+	}
+
+	/* one pass straight from the store; the aux field is a length byte and the characters */
+	bool ok = true;
+	for ( int b = 0 ; b < beats.size() && ok ; b++ ) {
+		WFDB_Annotation ann;
+		QByteArray aux;
+		memset( &ann, 0, sizeof(ann) );
+		ann.time = beats.pos( b );
+		ann.anntyp = beats.type( b );
+		ann.subtyp = beats.subtype( b );
+		if ( beats.hasAux( b ) ) {
+			aux = beats.aux( b ).toLatin1().left( 255 );
+			aux.prepend( (char) aux.size() );
+			ann.aux = (unsigned char *) aux.data();
+		}
+		ok = ( putann( 0, &ann ) == 0 );
+	}
+
+	oannclose( 0 );
+	setafreq( 0 );
+	return ok;
 }
 /* }}} */
 
@@ -123,6 +668,8 @@ void EcgData::cancel_data_loading()
  */
 EcgData::~EcgData()
 {
+	/* nothing may still be filtering the samples when they are unmapped */
+	filtered.clear();
 }
 /* }}} */
 
@@ -305,10 +852,35 @@ static inline  unsigned char ror8( unsigned char word, unsigned int shift)
 
 
 
+/** {{{ void EcgData::read_wfdb_samples( QVector<WFDB_Sample> &samples )
+  @brief Read every frame of the open WFDB record, channel by channel within a frame
+
+  The caller holds glb_wfdb_mutex; nothing here lets events run.
+  */
+void EcgData::read_wfdb_samples( QVector<WFDB_Sample> &samples )
+{
+	QVector<WFDB_Sample> frame( channel_count );
+
+	if ( wfdbSignalInfo->nsamp > 0 ) {
+		samples.reserve( wfdbSignalInfo->nsamp * channel_count );
+	}
+	while ( getvec( frame.data() ) > 0 ) {
+		samples += frame;
+	}
+
+	samps_per_chan_per_sec = getifreq();
+}
+/* }}} */
+
+
 /** {{{ void EcgData::Load()
-  @brief Load the data of the given signal file into channels arrays
+  @brief Decode the data of the given signal file into the channel files
+
+  For a WFDB record the samples have been read by read_wfdb_samples()
+  already, so no lock is held while this shows progress; map_channels()
+  does the rest.
   */
-int EcgData::Load( QString filename )
+int EcgData::Load( QString filename, const QVector<WFDB_Sample> &wfdbSamples )
 {
     int i;
 	long sampleCnt = 0L;
@@ -318,10 +890,6 @@ int EcgData::Load( QString filename )
 
 	if ( wfdbSignalInfo ) {
 
-		WFDB_Sample *samp;
-
-		samp = ( WFDB_Sample * ) malloc( channel_count * sizeof( WFDB_Sample ) );
-
 		device_range_mV = 10; // FIXME: Critical info. device_range_mV is 10 for SironaPWM, and 20 for Centauri.
 
 		qDebug() << "\n" << QString( "wfdbSignalInfo : load(%1)     device_range_mV = %2      nsamp = %3" ).arg( filename ).arg( device_range_mV ).arg( ( int ) wfdbSignalInfo->nsamp ) << "\n";
@@ -332,14 +900,15 @@ int EcgData::Load( QString filename )
 		}
 
 		int samplePos = 0;
-		while ( getvec( samp ) > 0 ) {
+		for ( const WFDB_Sample *samp = wfdbSamples.constData() ; samp < wfdbSamples.constData() + wfdbSamples.size() ; samp += channel_count ) {
 
 			for ( int ch = 0; ch < channel_count; ch++ ) {
-				if ( samp[ch] == -32768 ) {
-					samp[ch] = ( 1 << wfdbSignalInfo->adcres ) / 2;
+				WFDB_Sample value = samp[ch];
+				if ( value == -32768 ) {
+					value = ( 1 << wfdbSignalInfo->adcres ) / 2;
 				}
 
-				int32_t convertedSample = range_per_sample / 2 + ROUND2INT( ( ( double ) samp[ch] - ( double ) wfdbSignalInfo->adczero )
+				int32_t convertedSample = range_per_sample / 2 + ROUND2INT( ( ( double ) value - ( double ) wfdbSignalInfo->adczero )
 										  * range_per_sample / device_range_mV / wfdbSignalInfo->gain );
 
 				STORE_INTO_CHDATA( ch, samplePos, convertedSample );
@@ -351,10 +920,9 @@ int EcgData::Load( QString filename )
 			}
 		}
 
-		samps_per_chan_per_sec = getifreq();
 		datalen_secs = ( int ) ( samplePos / samps_per_chan_per_sec );
 
-		qDebug() << QString( "wfdbSignalInfo : datalen_secs = %1       sps = %2" ).arg( datalen_secs ).arg( getifreq() );
+		qDebug() << QString( "wfdbSignalInfo : datalen_secs = %1       sps = %2" ).arg( datalen_secs ).arg( samps_per_chan_per_sec );
 
 	} else {
 		if ( ! QFile::exists(filename) ) {
@@ -405,13 +973,17 @@ int EcgData::Load( QString filename )
 					long adcRange = (1 << 10);
 					sampleCnt = 0;
 
+					/* kept here and handed over in one go once the whole file is decoded */
+					QVector<quint32> spikes;
+
 					for ( i = 4-1 ; i < filesize; i += sizeof(uint32_t) ) {
 
 						SHOW_PROGRESS_AND_WATCHFOR_CANCEL(i);
 
 						/* for hammer testing we have a special format for 2 channel where these pacemaker indicators are really used for channel info */
-						if ( MASK_THESE_BITS(rawdata[i-0] >> 6, 1) == 0x01 ) {
-							emit pacer_spike_found( sampleCnt );
+						if ( MASK_THESE_BITS(rawdata[i-0] >> 6, 1) == 0x01 && sampleCnt >= PACER_FILTER_DELAY ) {
+							/* the 201 tap filter reports the spike late */
+							spikes.append( sampleCnt - PACER_FILTER_DELAY );
 						}
 
 						short samp[3] = { 0 };
@@ -462,8 +1034,8 @@ int EcgData::Load( QString filename )
 						}
 					}
 
-					/* signal the pacer storage facility that we are at the end of paced beats to be stored */
-					emit pacer_spike_found( -1 );
+					pacer.build( spikes, samps_per_chan_per_sec, sampleCnt );
+					emit pacer_spikes_found();
 
 					/* set the datalen_secs based on how much data was processed */
 					datalen_secs = (int) (sampleCnt / samps_per_chan_per_sec);
@@ -474,6 +1046,16 @@ int EcgData::Load( QString filename )
 		delete[] rawdata;
 	}
 
+    return true;
+}
+/* }}} */
+
+
+/** {{{ void EcgData::map_channels()
+  @brief Map the decoded channel files and build their window statistics
+  */
+void EcgData::map_channels()
+{
 	for ( int ch = 0 ; ch < channel_count ; ch++ ) {
         chdata[ch] = (quint16 *) fileEcgCache[ch].map( 0, fileEcgCache[ch].size() );
 
@@ -483,10 +1065,201 @@ int EcgData::Load( QString filename )
 
 		if ( chdata[ch] == NULL ) {
 			datalen_secs = 0;
+		} else {
+			chlen[ch] = fileEcgCache[ch].size() / sizeof(quint16);
 		}
 	}
 
-    return true;
+	build_window_statistics();
+}
+/* }}} */
+
+
+/** {{{ void EcgData::build_window_statistics()
+  @brief Build the per-channel running sums of the samples and their squares
+
+  The sums are kept in memory mapped temporary files like the samples are,
+  and each channel is summed on its own thread.  The files are opened here
+  on the calling thread; a channel whose files cannot be opened, written or
+  mapped is left without sums, and the window_*() functions then work its
+  windows out directly from the samples.
+  */
+void EcgData::build_window_statistics()
+{
+	QVector<int> channels;
+	for ( int ch = 0 ; ch < channel_count ; ch++ ) {
+		chsum[ch] = NULL;
+		chsumsq[ch] = NULL;
+		if ( chdata[ch] == NULL ) {
+			continue;
+		}
+		if ( ! fileSumCache[ch].open() || ! fileSumSqCache[ch].open() ) {
+			qDebug() << qPrintable(QString("fileSumCache[%1].open() -> %2 %3").arg(ch).arg(fileSumCache[ch].errorString()).arg(fileSumSqCache[ch].errorString()));
+			continue;
+		}
+		channels.append( ch );
+	}
+
+	QtConcurrent::blockingMap( channels, [this]( int ch ) {
+		const int chunk = 64 * 1024;
+		QVector<qint64> sums( chunk );
+		QVector<qint64> sumsq( chunk );
+		qint64 runningSum = 0;
+		qint64 runningSumSq = 0;
+		bool written = true;
+
+		auto write_chunk = [&]( int count ) {
+			qint64 bytes = count * sizeof(qint64);
+			written = written
+				&& fileSumCache[ch].write( (const char *) sums.constData(), bytes ) == bytes
+				&& fileSumSqCache[ch].write( (const char *) sumsq.constData(), bytes ) == bytes;
+		};
+
+		/* entry i holds the sum of samples [0,i), so entry 0 is always zero */
+		sums[0] = 0;
+		sumsq[0] = 0;
+		int filled = 1;
+		for ( long i = 0 ; i < chlen[ch] ; i++ ) {
+			qint64 samp = chdata[ch][i];
+			runningSum += samp;
+			runningSumSq += samp * samp;
+			sums[filled] = runningSum;
+			sumsq[filled] = runningSumSq;
+			if ( ++filled == chunk ) {
+				write_chunk( filled );
+				filled = 0;
+				if ( ! written ) {
+					break;
+				}
+			}
+		}
+		write_chunk( filled );
+
+		qint64 expected = ( chlen[ch] + 1 ) * (qint64) sizeof(qint64);
+		if ( ! written || ! fileSumCache[ch].flush() || ! fileSumSqCache[ch].flush()
+				|| fileSumCache[ch].size() != expected || fileSumSqCache[ch].size() != expected ) {
+			qDebug() << qPrintable(QString("fileSumCache[%1].write() -> %2 %3").arg(ch).arg(fileSumCache[ch].errorString()).arg(fileSumSqCache[ch].errorString()));
+			return;
+		}
+
+		qint64 * sumMap = (qint64 *) fileSumCache[ch].map( 0, expected );
+		qint64 * sumSqMap = (qint64 *) fileSumSqCache[ch].map( 0, expected );
+
+		if ( sumMap == NULL || sumSqMap == NULL ) {
+			qDebug() << qPrintable(QString("fileSumCache[%1].map() -> %2 %3").arg(ch).arg(fileSumCache[ch].errorString()).arg(fileSumSqCache[ch].errorString()));
+			return;
+		}
+		chsum[ch] = sumMap;
+		chsumsq[ch] = sumSqMap;
+	} );
+}
+/* }}} */
+
+
+/** {{{ bool EcgData::clamp_window( int channel_num, long &start_samps, long &count_samps )
+  @brief Clip a window to the samples stored for a channel
+  @return false if nothing is left of the window or there are no samples for it
+  */
+bool EcgData::clamp_window( int channel_num, long &start_samps, long &count_samps )
+{
+	if ( channel_num < 0 || channel_num >= CHANNEL_MAX || chdata[channel_num] == NULL ) {
+		return false;
+	}
+	if ( start_samps < 0 ) {
+		count_samps += start_samps;
+		start_samps = 0;
+	}
+	if ( start_samps + count_samps > chlen[channel_num] ) {
+		count_samps = chlen[channel_num] - start_samps;
+	}
+	return count_samps > 0;
+}
+/* }}} */
+
+
+/** {{{ void EcgData::direct_window_sums( int channel_num, long start_samps, long count_samps, long double &sum, long double &sumsq )
+  @brief Sum a clamped window's samples and their squares one by one
+
+  The fallback for a channel whose running sums could not be built.
+  */
+void EcgData::direct_window_sums( int channel_num, long start_samps, long count_samps, long double &sum, long double &sumsq )
+{
+	qint64 s = 0;
+	qint64 sq = 0;
+	const quint16 * samp = chdata[channel_num] + start_samps;
+	for ( long i = 0 ; i < count_samps ; i++ ) {
+		s += samp[i];
+		sq += (qint64) samp[i] * samp[i];
+	}
+	sum = s;
+	sumsq = sq;
+}
+/* }}} */
+
+
+/** {{{ qint64 EcgData::window_sum( int channel_num, long start_samps, long count_samps )
+  @brief Sum of the samples of a window, in constant time
+  */
+qint64 EcgData::window_sum( int channel_num, long start_samps, long count_samps )
+{
+	if ( ! clamp_window( channel_num, start_samps, count_samps ) ) {
+		return 0;
+	}
+	if ( chsum[channel_num] == NULL ) {
+		long double sum, sumsq;
+		direct_window_sums( channel_num, start_samps, count_samps, sum, sumsq );
+		return (qint64) sum;
+	}
+	return chsum[channel_num][start_samps + count_samps] - chsum[channel_num][start_samps];
+}
+/* }}} */
+
+
+/** {{{ double EcgData::window_mean( int channel_num, long start_samps, long count_samps )
+  @brief Mean of the samples of a window, in constant time
+  */
+double EcgData::window_mean( int channel_num, long start_samps, long count_samps )
+{
+	if ( ! clamp_window( channel_num, start_samps, count_samps ) ) {
+		return range_per_sample / 2;
+	}
+	return (double) window_sum( channel_num, start_samps, count_samps ) / count_samps;
+}
+/* }}} */
+
+
+/** {{{ double EcgData::window_variance( int channel_num, long start_samps, long count_samps )
+  @brief Variance of the samples of a window, in constant time
+  */
+double EcgData::window_variance( int channel_num, long start_samps, long count_samps )
+{
+	if ( ! clamp_window( channel_num, start_samps, count_samps ) ) {
+		return 0.0;
+	}
+	long double sum, sumsq;
+	if ( chsum[channel_num] == NULL ) {
+		direct_window_sums( channel_num, start_samps, count_samps, sum, sumsq );
+	} else {
+		sum = chsum[channel_num][start_samps + count_samps] - chsum[channel_num][start_samps];
+		sumsq = chsumsq[channel_num][start_samps + count_samps] - chsumsq[channel_num][start_samps];
+	}
+	long double variance = ( sumsq - sum * sum / count_samps ) / count_samps;
+
+	return variance > 0 ? (double) variance : 0.0;
+}
+/* }}} */
+
+
+/** {{{ double EcgData::window_gain( int channel_num, long start_samps, long count_samps, double half_height_mm )
+  @brief The gain, in mm/mV, that fits AUTOSCALE_SIGMAS standard deviations of a window into half_height_mm
+  */
+double EcgData::window_gain( int channel_num, long start_samps, long count_samps, double half_height_mm )
+{
+	double sigma_mV = sqrt( window_variance( channel_num, start_samps, count_samps ) ) * device_range_mV / range_per_sample;
+	if ( sigma_mV <= 0 ) {
+		return AUTOSCALE_MAX_GAIN;
+	}
+	return qBound( AUTOSCALE_MIN_GAIN, half_height_mm / ( AUTOSCALE_SIGMAS * sigma_mV ), AUTOSCALE_MAX_GAIN );
 }
 /* }}} */
 
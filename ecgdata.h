@@ -26,10 +26,22 @@
 #include "wfdb/wfdb.h"
 #include "wfdb/ecgmap.h"
 #include "wfdb/ecgcodes.h"
+#include "beatstore.h"
+#include "episodes.h"
+#include "rrseries.h"
+#include "beatjournal.h"
+#include "pacerindex.h"
+#include "beatcompare.h"
+#include "qrsdetector.h"
+#include "displayfilter.h"
 
 
 #define CHANNEL_MAX		(12)
 
+#define AUTOSCALE_SIGMAS	(4)		/**< automatic gain fits this many standard deviations of a window into half its band */
+#define AUTOSCALE_MIN_GAIN	(0.1)	/**< mm/mV */
+#define AUTOSCALE_MAX_GAIN	(500.0)
+
 #define MASK_THESE_BITS(b,bits)	((unsigned long) ((b) & ((1 << (bits)) - 1)))
 #define MASK_4_BIT(b)	MASK_THESE_BITS(b, 4)
 #define MASK_8_BIT(b)	MASK_THESE_BITS(b, 8)
@@ -40,6 +52,22 @@
 #define ECG_HEADER_UNIVERSAL	(QFileInfo(filename).absolutePath() + "/" + QString("ecg.hea"))
 
 
+/** WFDB keeps the open record and annotators in globals, so every use of it holds this */
+extern QMutex glb_wfdb_mutex;
+
+
+/* {{{ struct Annotator
+   @brief	Another annotator's labels for the record, shown in a row of their own
+*/
+struct Annotator
+{
+	QString name;					/**< the annotation file suffix, such as qrs */
+	BeatStore beats;
+	BeatComparison comparison;		/**< against the record's beats, as the reference */
+};
+/* }}} */
+
+
 /* {{{ class EcgData
    @brief	class to manage streams of ECG data
 */
@@ -52,14 +80,39 @@ public:
     EcgData( QString filename, QWidget *parent = NULL );
     ~EcgData();
 
+    static EcgData *acquire( QString filename );
+    void retain() { m_refs.ref(); }
+    static void release( EcgData *ecgdata );
+
     ulong size() { return datalen_secs * samps_per_chan_per_sec; }	/* return samples per channel */
 
+    int open( QString filename );
+    static int read_annotations( QString recordName, const char *ext, BeatStore &beats );
+    static bool write_annotations( QString fileName, const BeatStore &beats, int samps_per_sec );
+    void index_annotations();
+    void detect_beats();
+    int load_annotators( const QStringList &names );
+    void compare_annotators();
+    static QString record_name( const QString &fileName ) { return QFileInfo(fileName).completeBaseName(); }	/* only the last suffix goes: rec.v2.dat is record rec.v2 */
+    QString journal_file_name() { return QFileInfo(file_name).absolutePath() + "/" + record_name(file_name) + "." BEAT_JOURNAL_SUFFIX; }
+    void annotations_edited();
+
     QString parse_header( QString filename );
 	WFDB_Siginfo * wfdbOpen( QString filename );
-    int Load( QString filename );
+    void read_wfdb_samples( QVector<WFDB_Sample> &samples );
+    int Load( QString filename, const QVector<WFDB_Sample> &wfdbSamples );
+    void map_channels();
     long sample_count();
     quint16 *get( int channel_num, long start_time_samps, long duration_samps );
     quint16 *get_data_channel( int channel_num ) { return chdata[channel_num]; }
+    long channel_length( int channel_num ) { return chlen[channel_num]; }
+
+    qint64 window_sum( int channel_num, long start_samps, long count_samps );
+    double window_mean( int channel_num, long start_samps, long count_samps );
+    double window_variance( int channel_num, long start_samps, long count_samps );
+    double record_mean( int channel_num ) { return window_mean( channel_num, 0, chlen[channel_num] ); }
+    double record_variance( int channel_num ) { return window_variance( channel_num, 0, chlen[channel_num] ); }
+    double window_gain( int channel_num, long start_samps, long count_samps, double half_height_mm );
 
     QString file_name;
     double range_per_sample;
@@ -75,7 +128,23 @@ public:
 
 	WFDB_Siginfo *wfdbSignalInfo;
 
+    /* what was found in the record, shared by every view of it */
+    BeatStore beats;
+    PacerIndex pacer;			/**< the pacer spikes found while loading; index_annotations() marks the paced beats */
+    EpisodeIndex episodes;		/**< rebuilt from beats by index_annotations() */
+    RRSeries rr;				/**< ... and so is this */
+    BeatJournal edits;			/**< what has been done to beats since they were read */
+    QVector<Annotator> annotators;	/**< other annotation files of the record, compared by index_annotations() */
+    FilterCache filtered;		/**< the samples through the display filters, a block at a time */
+
 private:
+    /* records opened from the user interface, by canonical file name, so
+       several views of one record decode it only once */
+    static QHash<QString,EcgData *> s_records;
+    QString m_registeredName;
+    QAtomicInt m_refs;			/**< views using this record; it goes away with the last one */
+    bool m_reindexPending;		/**< annotations_edited() has asked for index_edited_annotations() */
+
     void store_edfheader_field( QByteArray header, QString fieldname, int fieldsize );
 
     QHash<QString,QString>	edfheader;
@@ -86,18 +155,32 @@ private:
     int edf_samps_per_record;
     float edf_record_duration_secs;
 
+    void build_window_statistics();
+    bool clamp_window( int channel_num, long &start_samps, long &count_samps );
+    void direct_window_sums( int channel_num, long start_samps, long count_samps, long double &sum, long double &sumsq );
+
     QTemporaryFile fileEcgCache[3];
     quint16 * chdata[12];
+    long chlen[CHANNEL_MAX];		/**< samples stored in each channel */
+
+    /* running sums (length chlen + 1) of the samples and of their squares, so
+       any window's mean and variance are available in constant time */
+    QTemporaryFile fileSumCache[CHANNEL_MAX];
+    QTemporaryFile fileSumSqCache[CHANNEL_MAX];
+    qint64 * chsum[CHANNEL_MAX];
+    qint64 * chsumsq[CHANNEL_MAX];
 
 
 public slots:
     void cancel_data_loading();
+    void index_edited_annotations();
 
 signals:
     void load_size( int filesize );
     void data_loaded_so_far( int loaded );
     void loading_finished();
-    void pacer_spike_found( long samplePos );
+    void pacer_spikes_found();
+    void annotations_changed();
 
 };
 /* }}} */
@@ -0,0 +1,352 @@
+/**
+ * @file episodes.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <algorithm>
+
+#include "episodes.h"
+
+
+/** {{{ static bool episodeStartsBefore( const Episode &episode, qint64 pos )
+ */
+static bool episodeStartsBefore( const Episode &episode, qint64 pos )
+{
+	return episode.start < pos;
+}
+/* }}} */
+
+
+/** {{{ static bool positionBeforeEpisode( qint64 pos, const Episode &episode )
+ */
+static bool positionBeforeEpisode( qint64 pos, const Episode &episode )
+{
+	return pos < episode.start;
+}
+/* }}} */
+
+
+/** {{{ static bool episodeLessThan( const Episode &a, const Episode &b )
+ */
+static bool episodeLessThan( const Episode &a, const Episode &b )
+{
+	return a.start < b.start;
+}
+/* }}} */
+
+
+/** {{{ static QString marked_episode_name( int subtype )
+    @brief What an EPISODE_MARK_BEGIN/END subtype stands for; the same names the labels use
+*/
+static QString marked_episode_name( int subtype )
+{
+	switch ( subtype ) {
+		case 'a':
+			return "AF";
+		case 'b':
+			return "B";
+		case 'p':
+			return "P";
+		case 't':
+			return "T";
+		default:
+			return QString("[%1]").arg( subtype );
+	}
+}
+/* }}} */
+
+
+/** {{{ void EpisodeIndex::clear()
+ */
+void EpisodeIndex::clear()
+{
+	m_recordEnd = 0;
+	m_kindNames.clear();
+	m_episodes.clear();
+	m_maxEnd.clear();
+	m_totalLength.clear();
+}
+/* }}} */
+
+
+/** {{{ void EpisodeIndex::build( const BeatStore &beats, qint64 recordEnd )
+    @brief Pair up the episode annotations of beats; episodes still open at the end run to recordEnd
+*/
+void EpisodeIndex::build( const BeatStore &beats, qint64 recordEnd )
+{
+	clear();
+	m_recordEnd = recordEnd;
+
+	/* only the marking annotations are looked at, in order */
+	static const int markTypes[] = { EPISODE_MARK_BEGIN, EPISODE_MARK_END, NOISE, RHYTHM };
+	QVector<int> marks;
+	for ( unsigned t = 0 ; t < sizeof(markTypes) / sizeof(markTypes[0]) ; t++ ) {
+		for ( int n = 0 ; n < beats.countOfType( markTypes[t] ) ; n++ ) {
+			marks.append( beats.nthOfType( markTypes[t], n ) );
+		}
+	}
+	std::sort( marks.begin(), marks.end() );
+
+	QHash<int,qint64> open;		/* kind -> start */
+	int rhythmKind = -1;
+	qint64 rhythmStart = 0;
+
+	foreach ( int b, marks ) {
+		qint64 pos = beats.pos( b );
+		int kind;
+
+		switch ( beats.type( b ) ) {
+			case EPISODE_MARK_BEGIN:
+				kind = kind_for( marked_episode_name( beats.subtype( b ) ) );
+				if ( ! open.contains( kind ) ) {
+					open.insert( kind, pos );
+				}
+				break;
+
+			case EPISODE_MARK_END:
+				kind = kind_for( marked_episode_name( beats.subtype( b ) ) );
+				if ( open.contains( kind ) ) {
+					add( kind, open.take( kind ), pos );
+				}
+				break;
+
+			case NOISE:
+				kind = kind_for( "NOISE" );
+				if ( beats.subtype( b ) != 0 ) {
+					if ( ! open.contains( kind ) ) {
+						open.insert( kind, pos );
+					}
+				} else if ( open.contains( kind ) ) {
+					add( kind, open.take( kind ), pos );
+				}
+				break;
+
+			case RHYTHM:
+				{
+					QString name = beats.aux( b ).trimmed();
+					if ( name.startsWith("(") ) {
+						name.remove( 0, 1 );
+					}
+					if ( name.isEmpty() ) {
+						break;
+					}
+					if ( rhythmKind >= 0 ) {
+						add( rhythmKind, rhythmStart, pos );
+					}
+					rhythmKind = kind_for( name );
+					rhythmStart = pos;
+				}
+				break;
+		}
+	}
+
+	for ( QHash<int,qint64>::const_iterator it = open.constBegin() ; it != open.constEnd() ; ++it ) {
+		add( it.key(), it.value(), recordEnd );
+	}
+	if ( rhythmKind >= 0 ) {
+		add( rhythmKind, rhythmStart, recordEnd );
+	}
+
+	finish();
+}
+/* }}} */
+
+
+/** {{{ int EpisodeIndex::kind_for( const QString &name )
+ */
+int EpisodeIndex::kind_for( const QString &name )
+{
+	int kind = m_kindNames.indexOf( name );
+	if ( kind < 0 ) {
+		kind = m_kindNames.size();
+		m_kindNames.append( name );
+		m_episodes.append( QVector<Episode>() );
+	}
+	return kind;
+}
+/* }}} */
+
+
+/** {{{ void EpisodeIndex::add( int kind, qint64 start, qint64 end )
+ */
+void EpisodeIndex::add( int kind, qint64 start, qint64 end )
+{
+	if ( end <= start ) {
+		return;
+	}
+
+	Episode episode;
+	episode.start = start;
+	episode.end = end;
+	episode.kind = kind;
+	m_episodes[kind].append( episode );
+}
+/* }}} */
+
+
+/** {{{ void EpisodeIndex::finish()
+    @brief Sort each kind by start and work out the running maximum ends and the total lengths
+*/
+void EpisodeIndex::finish()
+{
+	m_maxEnd.resize( m_episodes.size() );
+	m_totalLength.fill( 0, m_episodes.size() );
+
+	for ( int kind = 0 ; kind < m_episodes.size() ; kind++ ) {
+		QVector<Episode> &list = m_episodes[kind];
+		std::sort( list.begin(), list.end(), episodeLessThan );
+
+		QVector<qint64> &maxEnd = m_maxEnd[kind];
+		maxEnd.resize( list.size() );
+		qint64 largest = 0;
+		for ( int i = 0 ; i < list.size() ; i++ ) {
+			largest = qMax( largest, list[i].end );
+			maxEnd[i] = largest;
+		}
+
+		m_totalLength[kind] = lengthWithin( kind, 0, m_recordEnd );
+	}
+}
+/* }}} */
+
+
+/** {{{ bool EpisodeIndex::isBackground( int kind ) const
+ */
+bool EpisodeIndex::isBackground( int kind ) const
+{
+	const QString &name = m_kindNames[kind];
+	return name == "N" || name == "NSR";
+}
+/* }}} */
+
+
+/** {{{ void EpisodeIndex::overlapping( int kind, qint64 from, qint64 to, QVector<Episode> &found ) const
+    @brief Append the episodes of kind that share at least one sample with from up to to
+*/
+void EpisodeIndex::overlapping( int kind, qint64 from, qint64 to, QVector<Episode> &found ) const
+{
+	const QVector<Episode> &list = m_episodes[kind];
+	const QVector<qint64> &maxEnd = m_maxEnd[kind];
+
+	/* the ones starting before to ... */
+	int last = std::lower_bound( list.constBegin(), list.constEnd(), to, episodeStartsBefore ) - list.constBegin();
+	/* ... from the first one where some episode reaches past from */
+	int first = std::upper_bound( maxEnd.constBegin(), maxEnd.constBegin() + last, from ) - maxEnd.constBegin();
+
+	for ( int i = first ; i < last ; i++ ) {
+		if ( list[i].end > from ) {
+			found.append( list[i] );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ QVector<Episode> EpisodeIndex::overlapping( qint64 from, qint64 to ) const
+    @brief Episodes of every kind that share at least one sample with from up to to
+*/
+QVector<Episode> EpisodeIndex::overlapping( qint64 from, qint64 to ) const
+{
+	QVector<Episode> found;
+	for ( int kind = 0 ; kind < m_episodes.size() ; kind++ ) {
+		overlapping( kind, from, to, found );
+	}
+	return found;
+}
+/* }}} */
+
+
+/** {{{ bool EpisodeIndex::nextStart( qint64 pos, Episode *found ) const
+    @brief The first episode, other than sinus rhythm, that starts after pos
+*/
+bool EpisodeIndex::nextStart( qint64 pos, Episode *found ) const
+{
+	bool any = false;
+	for ( int kind = 0 ; kind < m_episodes.size() ; kind++ ) {
+		if ( isBackground( kind ) ) {
+			continue;
+		}
+		const QVector<Episode> &list = m_episodes[kind];
+		QVector<Episode>::const_iterator it = std::upper_bound( list.constBegin(), list.constEnd(), pos, positionBeforeEpisode );
+		if ( it != list.constEnd() && ( ! any || it->start < found->start ) ) {
+			*found = *it;
+			any = true;
+		}
+	}
+	return any;
+}
+/* }}} */
+
+
+/** {{{ bool EpisodeIndex::prevStart( qint64 pos, Episode *found ) const
+    @brief The last episode, other than sinus rhythm, that starts before pos
+*/
+bool EpisodeIndex::prevStart( qint64 pos, Episode *found ) const
+{
+	bool any = false;
+	for ( int kind = 0 ; kind < m_episodes.size() ; kind++ ) {
+		if ( isBackground( kind ) ) {
+			continue;
+		}
+		const QVector<Episode> &list = m_episodes[kind];
+		QVector<Episode>::const_iterator it = std::lower_bound( list.constBegin(), list.constEnd(), pos, episodeStartsBefore );
+		if ( it != list.constBegin() ) {
+			--it;
+			if ( ! any || it->start > found->start ) {
+				*found = *it;
+				any = true;
+			}
+		}
+	}
+	return any;
+}
+/* }}} */
+
+
+/** {{{ qint64 EpisodeIndex::lengthWithin( int kind, qint64 from, qint64 to ) const
+    @brief Samples from up to to covered by at least one episode of kind
+*/
+qint64 EpisodeIndex::lengthWithin( int kind, qint64 from, qint64 to ) const
+{
+	QVector<Episode> found;
+	overlapping( kind, from, to, found );
+
+	/* sorted by start, so anything below covered has been counted already */
+	qint64 total = 0;
+	qint64 covered = from;
+	foreach ( const Episode &episode, found ) {
+		qint64 start = qMax( episode.start, covered );
+		qint64 end = qMin( episode.end, to );
+		if ( end > start ) {
+			total += end - start;
+			covered = end;
+		}
+	}
+	return total;
+}
+/* }}} */
+
+
+/** {{{ double EpisodeIndex::burden( int kind ) const
+    @brief Fraction of the record spent in episodes of kind
+*/
+double EpisodeIndex::burden( int kind ) const
+{
+	return ( m_recordEnd > 0 ) ? (double) m_totalLength[kind] / m_recordEnd : 0;
+}
+/* }}} */
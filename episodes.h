@@ -0,0 +1,91 @@
+/**
+ * @file episodes.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef EPISODES_H
+#define EPISODES_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define EPISODE_MARK_BEGIN	(44)	/**< user defined code starting an episode; the subtype says which */
+#define EPISODE_MARK_END	(45)	/**< ... and the one ending it */
+
+
+/* {{{ struct Episode
+   @brief	A stretch of the record with one rhythm or condition
+*/
+struct Episode
+{
+	qint64 start;		/**< first sample */
+	qint64 end;			/**< one past the last sample */
+	int kind;			/**< EpisodeIndex::kindName() */
+};
+/* }}} */
+
+
+/* {{{ class EpisodeIndex
+   @brief	Episodes put back together from their start and end annotations
+
+   Three sorts of annotation mark episodes: the 44 and 45 codes with a
+   subtype of 'a', 'b', 'p' or 't', NOISE with a non zero subtype starting
+   noise and a zero one ending it, and RHYTHM with an aux string like
+   "(AFIB" that lasts until the next RHYTHM.  build() pairs them up once.
+
+   Each kind keeps its episodes sorted by start together with the running
+   maximum of their ends.  The episodes overlapping a window are then found
+   with two binary searches plus the ones actually returned, and the total
+   length of each kind is known without looking at the beats again.
+*/
+class EpisodeIndex
+{
+public:
+	void build( const BeatStore &beats, qint64 recordEnd );
+	void clear();
+
+	int kindCount() const { return m_kindNames.size(); }
+	const QString &kindName( int kind ) const { return m_kindNames[kind]; }
+	bool isBackground( int kind ) const;		/* sinus rhythm is not worth shading or jumping to */
+
+	int count( int kind ) const { return m_episodes[kind].size(); }
+	const Episode &episode( int kind, int i ) const { return m_episodes[kind][i]; }
+
+	QVector<Episode> overlapping( qint64 from, qint64 to ) const;
+	void overlapping( int kind, qint64 from, qint64 to, QVector<Episode> &found ) const;
+	bool nextStart( qint64 pos, Episode *found ) const;
+	bool prevStart( qint64 pos, Episode *found ) const;
+
+	qint64 totalLength( int kind ) const { return m_totalLength[kind]; }
+	qint64 lengthWithin( int kind, qint64 from, qint64 to ) const;
+	double burden( int kind ) const;
+
+private:
+	int kind_for( const QString &name );
+	void add( int kind, qint64 start, qint64 end );
+	void finish();
+
+	qint64 m_recordEnd;
+	QStringList m_kindNames;
+	QVector< QVector<Episode> > m_episodes;		/**< per kind, by start */
+	QVector< QVector<qint64> > m_maxEnd;		/**< per kind, the largest end of the episodes so far */
+	QVector<qint64> m_totalLength;
+};
+/* }}} */
+
+#endif // EPISODES_H
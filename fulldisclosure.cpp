@@ -0,0 +1,288 @@
+/**
+ * @file fulldisclosure.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtGui>
+#include <QtConcurrent>
+
+#include "myheader.h"
+#include "showsignal.h"
+#include "fulldisclosure.h"
+
+
+/** {{{ FullDisclosureExporter::FullDisclosureExporter( EcgData *ecgdata, int channel, long startPos, qreal gain_mm_per_mV, QObject *parent )
+ */
+FullDisclosureExporter::FullDisclosureExporter( EcgData *ecgdata, int channel, long startPos, qreal gain_mm_per_mV, QObject *parent )
+	: QObject(parent),
+	  m_ecgdata(ecgdata),
+	  m_channel(channel),
+	  m_startPos(startPos),
+	  m_gain_mm_per_mV(gain_mm_per_mV),
+	  m_resolution(1200),
+	  m_rasterDpi(0),
+	  m_cancelled(0),
+	  m_dotsPerSec(0),
+	  m_dotsPerMm(0),
+	  m_labelWidth(0),
+	  m_rowHeight(0),
+	  m_baselineOffset(0)
+{
+}
+/* }}} */
+
+
+/** {{{ int FullDisclosureExporter::rowCount() const
+    @brief How many one minute rows the export will draw
+*/
+int FullDisclosureExporter::rowCount() const
+{
+	long sample_count = (long) m_ecgdata->samps_per_chan_per_sec * m_ecgdata->datalen_secs - m_startPos;
+	long samples_per_row = (long) FULL_DISCLOSURE_SECONDS_PER_ROW * m_ecgdata->samps_per_chan_per_sec;
+
+	if ( sample_count <= 0 || samples_per_row <= 0 ) {
+		return 0;
+	}
+	return (sample_count + samples_per_row - 1) / samples_per_row;
+}
+/* }}} */
+
+
+/** {{{ bool FullDisclosureExporter::render( QPainter *dc, QPagedPaintDevice *device )
+    @brief Draw every row, starting new pages on device as they fill up
+    @return false if cancelled
+*/
+bool FullDisclosureExporter::render( QPainter *dc, QPagedPaintDevice *device )
+{
+	long samps_per_sec = m_ecgdata->samps_per_chan_per_sec;
+	double scalingDownSize = 0.93 * 8.0 / 60.0;
+	int device_dots_per_mm = ROUND2INT( device->logicalDpiY() / 25.4 );
+	int yPageTopPos = 10 * device_dots_per_mm;
+
+	m_dotsPerSec = device->logicalDpiX() * 2.5 / 2.54;
+	m_dotsPerMm = device->logicalDpiY() / 25.4;
+	m_rowHeight = (int) ((device->height() - yPageTopPos) / ((60.0) / 1 + 1));
+	m_baselineOffset = (STRIPHEIGHT_MM * device_dots_per_mm / 2) * scalingDownSize;
+
+	QFont fontTimeDisplay("Helvetica",7);
+	dc->setFont( fontTimeDisplay );
+	QRect textrect;
+	textrect = dc->boundingRect( textrect, Qt::AlignVCenter | Qt::AlignRight, "00:00:00 " );
+	m_labelWidth = textrect.width();
+
+	/** {{{ lay the rows out onto pages */
+	QList< QVector<Row> > pages;
+	pages.append( QVector<Row>() );
+	int yPos = yPageTopPos;
+	long sample_count = samps_per_sec * m_ecgdata->datalen_secs - m_startPos;
+	long lastStart = (m_ecgdata->datalen_secs - ECG_DISPLAY_WINDOW_SIZE_SECONDS) * samps_per_sec - 1;
+	for ( int line = 0 ; sample_count > 0 ; line++, sample_count -= FULL_DISCLOSURE_SECONDS_PER_ROW * samps_per_sec ) {
+		if ( (yPos + m_rowHeight + m_baselineOffset) > device->height() ) {
+			yPos = yPageTopPos;
+			pages.append( QVector<Row>() );
+		}
+
+		Row row;
+		row.startSample = qMax( 0L, qMin( m_startPos + line * FULL_DISCLOSURE_SECONDS_PER_ROW * samps_per_sec, lastStart ) );
+		row.sampleCount = min( (long) FULL_DISCLOSURE_SECONDS_PER_ROW, sample_count / samps_per_sec ) * samps_per_sec;
+		row.yPos = yPos;
+		pages.last().append( row );
+
+		yPos += m_rowHeight;
+	}
+	/* }}} */
+
+	QPen pen_trace( QColor("black") );
+	QPen pen_text( QColor("black"), 0, Qt::SolidLine, Qt::FlatCap, Qt::MiterJoin );
+	int rowsDrawn = 0;
+
+	for ( int page = 0 ; page < pages.size() ; page++ ) {
+		if ( page > 0 ) {
+			device->newPage();
+		}
+
+		QVector<Row> &rows = pages[page];
+
+		QVector<QImage> images;
+		if ( m_rasterDpi > 0 ) {
+			images.resize( rows.size() );
+			QVector<int> indexes( rows.size() );
+			for ( int r = 0 ; r < rows.size() ; r++ ) {
+				indexes[r] = r;
+			}
+			QtConcurrent::blockingMap( indexes, [&]( int r ) {
+				if ( ! wasCancelled() ) {
+					images[r] = row_image( rows[r] );
+				}
+			} );
+		}
+
+		for ( int r = 0 ; r < rows.size() ; r++ ) {
+			if ( wasCancelled() ) {
+				return false;
+			}
+
+			const Row &row = rows[r];
+
+			if ( m_rasterDpi > 0 ) {
+				/* the image covers three rows of height centered on this row's baseline */
+				QRectF target( m_labelWidth, row.yPos + m_baselineOffset - 1.5 * m_rowHeight,
+						row.sampleCount * scalingDownSize * m_dotsPerSec / samps_per_sec, 3 * m_rowHeight );
+				dc->drawImage( target, images[r] );
+			} else {
+				dc->setPen( pen_trace );
+				dc->drawPolyline( row_envelope( row, scalingDownSize, scalingDownSize, device->logicalDpiX() / (qreal) FULL_DISCLOSURE_ENVELOPE_DPI ) );
+			}
+
+			/* draw the time of the beginning of the row */
+			QString str = m_ecgdata->viewableDateTime.addSecs( row.startSample / samps_per_sec ).toString("hh:mm:ss");
+			dc->setPen(pen_text);
+			dc->setFont( fontTimeDisplay );
+			dc->drawText(
+					0,
+					ROUND2INT( textrect.height()/2 + row.yPos + m_baselineOffset / 2 ),
+					textrect.width(), m_rowHeight,
+					Qt::AlignVCenter | Qt::AlignLeft, str );
+
+			emit rowsDone( ++rowsDrawn );
+		}
+	}
+
+	return true;
+}
+/* }}} */
+
+
+/** {{{ QPolygonF FullDisclosureExporter::row_envelope( const Row &row, qreal xScale, qreal yScale, qreal columnWidth )
+    @brief The trace of one row, reduced to the min and max sample of every columnWidth dots
+*/
+QPolygonF FullDisclosureExporter::row_envelope( const Row &row, qreal xScale, qreal yScale, qreal columnWidth )
+{
+	QPolygonF points;
+	if ( row.sampleCount <= 0 ) {
+		return points;
+	}
+
+	quint16 *chData = m_ecgdata->get( m_channel, row.startSample, row.sampleCount );
+	double range_per_sample = m_ecgdata->range_per_sample;
+	qreal mV_per_digital_sample = (qreal) m_ecgdata->device_range_mV / (qreal) range_per_sample;
+	qreal dots_per_sample = xScale * m_dotsPerSec / m_ecgdata->samps_per_chan_per_sec;
+	qreal gain = m_gain_mm_per_mV;
+	if ( gain <= 0 ) {
+		/* "Auto": from the row's variance */
+		gain = m_ecgdata->window_gain( m_channel, row.startSample, row.sampleCount, m_rowHeight / 2.0 / ( yScale * m_dotsPerMm ) );
+	}
+	qreal dots_per_digital_sample = yScale * m_dotsPerMm * gain * mV_per_digital_sample;
+	qreal y_startpos = row.yPos + m_baselineOffset;
+	/* each row is centered on its own mean */
+	qreal centre = m_ecgdata->window_mean( m_channel, chData - m_ecgdata->get_data_channel( m_channel ), row.sampleCount );
+	qreal samples_per_column = columnWidth / dots_per_sample;
+
+	if ( samples_per_column <= 2 ) {
+		points.reserve( row.sampleCount );
+		for ( long i = 0 ; i < row.sampleCount ; i++ ) {
+			points.append( QPointF( i * dots_per_sample + m_labelWidth, (centre - chData[i]) * dots_per_digital_sample + y_startpos ) );
+		}
+		return points;
+	}
+
+	points.reserve( 2 * (row.sampleCount / samples_per_column + 2) );
+	for ( long bucketStart = 0 ; bucketStart < row.sampleCount ; ) {
+		long column = (long) ( bucketStart / samples_per_column );
+		long bucketEnd = qBound( bucketStart, (long) ceil( (column + 1) * samples_per_column ) - 1, row.sampleCount - 1 );
+
+		long iMin = bucketStart;
+		long iMax = bucketStart;
+		for ( long i = bucketStart + 1 ; i <= bucketEnd ; i++ ) {
+			if ( chData[i] < chData[iMin] ) {
+				iMin = i;
+			}
+			if ( chData[i] > chData[iMax] ) {
+				iMax = i;
+			}
+		}
+
+		long iFirst = qMin( iMin, iMax );
+		long iSecond = qMax( iMin, iMax );
+		points.append( QPointF( iFirst * dots_per_sample + m_labelWidth, (centre - chData[iFirst]) * dots_per_digital_sample + y_startpos ) );
+		if ( iSecond != iFirst ) {
+			points.append( QPointF( iSecond * dots_per_sample + m_labelWidth, (centre - chData[iSecond]) * dots_per_digital_sample + y_startpos ) );
+		}
+
+		bucketStart = bucketEnd + 1;
+	}
+
+	return points;
+}
+/* }}} */
+
+
+/** {{{ QImage FullDisclosureExporter::row_image( const Row &row )
+    @brief Rasterize one row at m_rasterDpi; safe to call for several rows at once
+*/
+QImage FullDisclosureExporter::row_image( const Row &row )
+{
+	double scalingDownSize = 0.93 * 8.0 / 60.0;
+	qreal deviceDpi = m_dotsPerMm * 25.4;
+	qreal k = m_rasterDpi / deviceDpi;
+	QRectF band( m_labelWidth, row.yPos + m_baselineOffset - 1.5 * m_rowHeight,
+			row.sampleCount * scalingDownSize * m_dotsPerSec / m_ecgdata->samps_per_chan_per_sec, 3 * m_rowHeight );
+
+	QImage image( QSize( (int) ceil( band.width() * k ), (int) ceil( band.height() * k ) ), QImage::Format_ARGB32_Premultiplied );
+	image.setDotsPerMeterX( qRound( m_rasterDpi / 0.0254 ) );
+	image.setDotsPerMeterY( qRound( m_rasterDpi / 0.0254 ) );
+	image.fill( Qt::transparent );
+
+	QPainter painter( &image );
+	painter.setRenderHint( QPainter::Antialiasing, true );
+	painter.scale( k, k );
+	painter.translate( -band.topLeft() );
+
+	QPen pen_trace( QColor("black"), 1 );
+	pen_trace.setCosmetic( true );
+	painter.setPen( pen_trace );
+	/* one envelope column per output pixel */
+	painter.drawPolyline( row_envelope( row, scalingDownSize, scalingDownSize, 1.0 / k ) );
+
+	return image;
+}
+/* }}} */
+
+
+/** {{{ bool FullDisclosureExporter::exportPdf( const QString &fileName )
+    @brief Write the whole record to a PDF file; nothing is left behind if cancelled
+*/
+bool FullDisclosureExporter::exportPdf( const QString &fileName )
+{
+	QPdfWriter writer( fileName );
+	writer.setPageLayout( m_pageLayout );
+	writer.setResolution( m_resolution );
+
+	QPainter painter;
+	if ( ! painter.begin( &writer ) ) {
+		return false;
+	}
+	bool completed = render( &painter, &writer );
+	painter.end();
+
+	if ( ! completed ) {
+		QFile::remove( fileName );
+	}
+	return completed;
+}
+/* }}} */
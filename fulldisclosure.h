@@ -0,0 +1,93 @@
+/**
+ * @file fulldisclosure.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef FULLDISCLOSURE_H
+#define FULLDISCLOSURE_H
+
+#include <QtGui>
+#include "ecgdata.h"
+
+
+#define FULL_DISCLOSURE_ENVELOPE_DPI	(600)	/**< vector rows keep one min/max pair per column this wide */
+#define FULL_DISCLOSURE_SECONDS_PER_ROW	(60)
+
+
+/* {{{ class FullDisclosureExporter
+   @brief	Lays out a whole record as one minute rows, page after page
+
+   Rows are either reduced to min/max envelopes at FULL_DISCLOSURE_ENVELOPE_DPI
+   and drawn as vectors, or, with a raster DPI set, rasterized in parallel and
+   placed as images.  Both land in the same place as the on screen full
+   disclosure printout, so the pages look the same at 100% scale.
+
+   Only reads the EcgData, so exportPdf() may run on a worker thread.
+*/
+class FullDisclosureExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	FullDisclosureExporter( EcgData *ecgdata, int channel, long startPos, qreal gain_mm_per_mV, QObject *parent = 0 );
+
+	void setPageLayout( const QPageLayout &layout ) { m_pageLayout = layout; }
+	void setResolution( int dpi ) { m_resolution = dpi; }
+	void setRasterDpi( int dpi ) { m_rasterDpi = dpi; }
+
+	int rowCount() const;
+	bool wasCancelled() const { return m_cancelled.load() != 0; }
+
+	bool render( QPainter *dc, QPagedPaintDevice *device );
+	bool exportPdf( const QString &fileName );
+
+public slots:
+	void cancel() { m_cancelled.store( 1 ); }
+
+signals:
+	void rowsDone( int rows );
+
+private:
+	struct Row
+	{
+		long startSample;
+		long sampleCount;
+		int yPos;
+	};
+
+	QPolygonF row_envelope( const Row &row, qreal xScale, qreal yScale, qreal columnWidth );
+	QImage row_image( const Row &row );
+
+	EcgData *m_ecgdata;
+	int m_channel;
+	long m_startPos;
+	qreal m_gain_mm_per_mV;
+	QPageLayout m_pageLayout;
+	int m_resolution;
+	int m_rasterDpi;
+	QAtomicInt m_cancelled;
+
+	/* geometry of the device being rendered, in its own dots */
+	qreal m_dotsPerSec;
+	qreal m_dotsPerMm;
+	int m_labelWidth;
+	int m_rowHeight;
+	qreal m_baselineOffset;
+};
+/* }}} */
+
+#endif // FULLDISCLOSURE_H
@@ -0,0 +1,135 @@
+/**
+ * @file labelcache.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtGui>
+
+#include "labelcache.h"
+
+
+/** {{{ LabelCache::LabelCache( const QFont &font )
+ */
+LabelCache::LabelCache( const QFont &font )
+	: m_font(font), m_dpiX(0), m_dpiY(0), m_device(NULL)
+{
+	m_strings.setMaxCost( LABEL_CACHE_STRINGS );
+	m_sizes.setMaxCost( LABEL_CACHE_STRINGS );
+}
+/* }}} */
+
+
+/** {{{ void LabelCache::setDevice( QPaintDevice *device )
+    @brief Select the device the labels are drawn on, dropping labels laid out for another resolution
+*/
+void LabelCache::setDevice( QPaintDevice *device )
+{
+	m_device = device;
+
+	if ( device->logicalDpiX() != m_dpiX || device->logicalDpiY() != m_dpiY ) {
+		m_dpiX = device->logicalDpiX();
+		m_dpiY = device->logicalDpiY();
+		m_keyed.clear();
+		m_strings.clear();
+		m_sizes.clear();
+	}
+}
+/* }}} */
+
+
+/** {{{ QStaticText LabelCache::prepare( const QString &str )
+ */
+QStaticText LabelCache::prepare( const QString &str )
+{
+	QStaticText label( str );
+	label.setTextFormat( Qt::PlainText );
+	label.setPerformanceHint( QStaticText::AggressiveCaching );
+	label.prepare( QTransform(), m_font );
+	return label;
+}
+/* }}} */
+
+
+/** {{{ const QStaticText *LabelCache::find( quint32 key ) const
+    @return the label stored under key, or NULL if there is none yet
+*/
+const QStaticText *LabelCache::find( quint32 key ) const
+{
+	QHash<quint32,QStaticText>::const_iterator it = m_keyed.constFind( key );
+	if ( it == m_keyed.constEnd() ) {
+		return NULL;
+	}
+	return &(it.value());
+}
+/* }}} */
+
+
+/** {{{ const QStaticText &LabelCache::insert( quint32 key, const QString &str )
+ */
+const QStaticText &LabelCache::insert( quint32 key, const QString &str )
+{
+	return *( m_keyed.insert( key, prepare( str ) ) );
+}
+/* }}} */
+
+
+/** {{{ QStaticText LabelCache::text( const QString &str )
+    @brief Label for free text such as auxiliary annotation strings
+
+    Returned by value, which only shares the layout, since a later call may
+    evict the cached copy.
+*/
+QStaticText LabelCache::text( const QString &str )
+{
+	QStaticText *cached = m_strings.object( str );
+	if ( cached != NULL ) {
+		return *cached;
+	}
+	QStaticText label = prepare( str );
+	m_strings.insert( str, new QStaticText( label ) );
+	return label;
+}
+/* }}} */
+
+
+/** {{{ QSize LabelCache::textSize( const QString &str )
+    @brief Size of str in this font on the current device, as boundingRect() would give it
+*/
+QSize LabelCache::textSize( const QString &str )
+{
+	QSize *cached = m_sizes.object( str );
+	if ( cached != NULL ) {
+		return *cached;
+	}
+	QFontMetrics fm( m_font, m_device );
+	QSize size = fm.size( 0, str );
+	m_sizes.insert( str, new QSize( size ) );
+	return size;
+}
+/* }}} */
+
+
+/** {{{ void LabelCache::draw( QPainter *dc, const QStaticText &label, qreal xCenter, qreal yTop, qreal height )
+    @brief Blit a label centered horizontally on xCenter and vertically in the given row
+*/
+void LabelCache::draw( QPainter *dc, const QStaticText &label, qreal xCenter, qreal yTop, qreal height )
+{
+	QSizeF labelSize = label.size();
+	dc->drawStaticText( QPointF( xCenter - labelSize.width() / 2, yTop + ( height - labelSize.height() ) / 2 ), label );
+}
+/* }}} */
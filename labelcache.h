@@ -0,0 +1,69 @@
+/**
+ * @file labelcache.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef LABELCACHE_H
+#define LABELCACHE_H
+
+#include <QtGui>
+
+
+#define LABEL_KEY_BEAT(type,subtype)	((1u << 24) | ((quint32) ((type) & 0xff) << 8) | (quint32) ((subtype) & 0xff))
+#define LABEL_KEY_HR(hr)				((2u << 24) | (quint32) ((hr) & 0xffff))
+
+#define LABEL_CACHE_STRINGS		(1024)	/**< free text labels and sizes kept, least recently used go first */
+
+
+/* {{{ class LabelCache
+   @brief	Pre-shaped annotation labels for one font
+
+   Labels are laid out once into QStaticText and then only blitted.  The cache
+   empties itself whenever it is used on a device of a different resolution,
+   since the layout depends on it.  Free text labels come from the record and
+   are unbounded, so only the last LABEL_CACHE_STRINGS of them are kept.
+*/
+class LabelCache
+{
+public:
+	LabelCache( const QFont &font = QFont() );
+
+	void setDevice( QPaintDevice *device );
+	const QFont &font() const { return m_font; }
+
+	const QStaticText *find( quint32 key ) const;
+	const QStaticText &insert( quint32 key, const QString &str );
+	QStaticText text( const QString &str );
+	QSize textSize( const QString &str );
+
+	void draw( QPainter *dc, const QStaticText &label, qreal xCenter, qreal yTop, qreal height );
+
+private:
+	QStaticText prepare( const QString &str );
+
+	QFont m_font;
+	int m_dpiX;
+	int m_dpiY;
+	QPaintDevice *m_device;
+
+	QHash<quint32,QStaticText> m_keyed;
+	QCache<QString,QStaticText> m_strings;
+	QCache<QString,QSize> m_sizes;
+};
+/* }}} */
+
+#endif // LABELCACHE_H
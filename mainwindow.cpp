@@ -69,6 +69,7 @@ MainWindow::MainWindow(QWidget *parent) :
     createMenus();
     createToolBars();
     createStatusBar();
+    createDockWindows();
     mdiChildActivated( NULL );
 
     readSettings();
@@ -170,6 +171,10 @@ void MainWindow::dragLeaveEvent(QDragLeaveEvent *event)
 void MainWindow::createActions()
 {
     ui->action_Open->setStatusTip( tr("Open an existing file") );
+    ui->action_Save->setStatusTip( tr("Save the annotation edits next to the record") );
+    ui->actionSave_As->setStatusTip( tr("Write the edited annotations to a new annotation file") );
+    ui->action_Undo->setStatusTip( tr("Undo the last annotation edit") );
+    ui->action_Redo->setStatusTip( tr("Redo the annotation edit last undone") );
     ui->action_Print->setStatusTip( tr("Print this document") );
     ui->action_Print_Strip->setStatusTip( tr("Print ECG strips at 25%, 50% and 75% offset") );
     ui->actionOutput_to_Pdf->setStatusTip( tr("Print this document into a PDF file") );
@@ -178,6 +183,7 @@ void MainWindow::createActions()
     ui->actionE_xit->setShortcut( tr("Ctrl+Q") );
     ui->actionE_xit->setStatusTip( tr("Exit the application") );
     ui->action_Close->setShortcut( tr("Ctrl+F4") );
+    ui->actionNew_View->setStatusTip( tr("Open another window onto the active window's record") );
     ui->action_Close->setStatusTip( tr("Close the active window") );
     ui->actionClose_All->setStatusTip( tr("Close all the windows") );
     ui->action_Tile->setStatusTip( tr("Tile the windows") );
@@ -188,12 +194,17 @@ void MainWindow::createActions()
     ui->actionLicensing->setStatusTip( tr("Show the application's Licensing box") );
 
     connect( ui->action_Open, SIGNAL(triggered()), this, SLOT(open()) );
+    connect( ui->action_Save, SIGNAL(triggered()), this, SLOT(save()) );
+    connect( ui->actionSave_As, SIGNAL(triggered()), this, SLOT(saveAs()) );
+    connect( ui->action_Undo, SIGNAL(triggered()), this, SLOT(undo()) );
+    connect( ui->action_Redo, SIGNAL(triggered()), this, SLOT(redo()) );
     connect( ui->action_Print, SIGNAL(triggered()), this, SLOT(print()) );
     connect( ui->action_Print_Strip, SIGNAL(triggered()), this, SLOT(printStrip()) );
     connect( ui->actionOutput_to_Pdf, SIGNAL(triggered()), this, SLOT(printPDF()) );
     connect( ui->actionBackwards, SIGNAL(triggered()), this, SLOT(moveLeft()) );
     connect( ui->actionForwards, SIGNAL(triggered()), this, SLOT(moveRight()) );
     connect( ui->actionE_xit, SIGNAL(triggered()), qApp, SLOT(closeAllWindows()) );
+    connect( ui->actionNew_View, SIGNAL(triggered()), this, SLOT(newView()) );
     connect( ui->action_Close, SIGNAL(triggered()), mdiArea, SLOT(closeActiveSubWindow()) );
     connect( ui->actionClose_All, SIGNAL(triggered()), mdiArea, SLOT(closeAllSubWindows()) );
     connect( ui->action_Tile, SIGNAL(triggered()), mdiArea, SLOT(tileSubWindows()) );
@@ -219,6 +230,67 @@ void MainWindow::createMenus()
     updateWindowMenu();
     connect( ui->menu_Window, SIGNAL(aboutToShow()), this, SLOT(updateWindowMenu()) );
     connect( ui->menu_File, SIGNAL(aboutToShow()), this, SLOT(updateWindowMenu()) );
+
+    ui->menu_Tools->addSeparator();
+    QAction *loadAnnotators = ui->menu_Tools->addAction( tr("Load &Annotators...") );
+    loadAnnotators->setStatusTip( tr("Show other annotation files of the record and compare them beat by beat") );
+    connect( loadAnnotators, SIGNAL(triggered()), this, SLOT(loadAnnotators()) );
+
+    QMenu *filterMenu = ui->menu_Tools->addMenu( tr("Display &Filters") );
+    struct {
+        const char *text;
+        const char *tip;
+        quint32 flag;
+    } filters[] = {
+        { QT_TR_NOOP("&Baseline Wander"), QT_TR_NOOP("High pass the traces to keep them on the baseline"), FILTER_BASELINE },
+        { QT_TR_NOOP("Mains Notch &50 Hz"), QT_TR_NOOP("Take out 50 Hz mains hum"), FILTER_NOTCH_50 },
+        { QT_TR_NOOP("Mains Notch &60 Hz"), QT_TR_NOOP("Take out 60 Hz mains hum"), FILTER_NOTCH_60 },
+        { QT_TR_NOOP("&Muscle Noise"), QT_TR_NOOP("Low pass the traces against muscle noise"), FILTER_MUSCLE },
+        { QT_TR_NOOP("&Zero Phase"), QT_TR_NOOP("Run the filters forwards and backwards so they do not shift the waves"), FILTER_ZERO_PHASE },
+    };
+    for ( unsigned f = 0 ; f < sizeof(filters) / sizeof(filters[0]) ; f++ ) {
+        if ( filters[f].flag == FILTER_ZERO_PHASE ) {
+            filterMenu->addSeparator();
+        }
+        QAction *action = filterMenu->addAction( tr( filters[f].text ) );
+        action->setStatusTip( tr( filters[f].tip ) );
+        action->setCheckable( true );
+        action->setData( filters[f].flag );
+        connect( action, SIGNAL(toggled(bool)), this, SLOT(displayFiltersChanged()) );
+        filterActions.append( action );
+    }
+}
+/* }}} */
+
+
+/** {{{ quint32 MainWindow::displayFilters()
+    @brief The FILTER_... flags checked in the Display Filters menu
+*/
+quint32 MainWindow::displayFilters()
+{
+    quint32 filters = 0;
+    foreach ( QAction *action, filterActions ) {
+        if ( action->isChecked() ) {
+            filters |= action->data().toUInt();
+        }
+    }
+    return filters;
+}
+/* }}} */
+
+
+/** {{{ void MainWindow::displayFiltersChanged()
+    @brief Show every view through the display filters now checked
+*/
+void MainWindow::displayFiltersChanged()
+{
+    quint32 filters = displayFilters();
+    foreach ( QMdiSubWindow *window, mdiArea->subWindowList() ) {
+        ShowSignal *child = qobject_cast<ShowSignal *>( window->widget() );
+        if ( child ) {
+            child->set_display_filters( filters );
+        }
+    }
 }
 /* }}} */
 
@@ -240,6 +312,7 @@ void MainWindow::createToolBars()
     comboEcgGain->addItem("100 mm/mV", 100.0 );
     comboEcgGain->addItem("250 mm/mV", 250.0 );
     comboEcgGain->addItem("500 mm/mV", 500.0 );
+    comboEcgGain->addItem("Auto", 0.0 );
     connect( comboEcgGain, SIGNAL(currentIndexChanged(int)), this, SLOT(updateVisibleChild(int)) );
     comboEcgGain->setCurrentIndex( 3 );
 
@@ -259,6 +332,37 @@ void MainWindow::createToolBars()
 void MainWindow::createStatusBar()
 {
     statusBar()->showMessage( tr("Ready") );
+
+    lblHoverReadout = new QLabel();
+    lblHoverReadout->setObjectName(QString::fromUtf8("lblHoverReadout"));
+    statusBar()->addPermanentWidget( lblHoverReadout );
+}
+/* }}} */
+
+
+/** {{{ void MainWindow::createDockWindows()
+    @brief Create the dock windows, hidden until asked for from the Tools menu
+*/
+void MainWindow::createDockWindows()
+{
+    queryPanel = new QueryPanel( this );
+    addDockWidget( Qt::RightDockWidgetArea, queryPanel );
+    queryPanel->hide();
+
+    QAction *showQuery = queryPanel->toggleViewAction();
+    showQuery->setShortcut( tr("Ctrl+Shift+F") );
+    showQuery->setStatusTip( tr("Search the annotations by type, time, heart rate or text") );
+    ui->menu_Tools->addSeparator();
+    ui->menu_Tools->addAction( showQuery );
+
+    morphologyPanel = new MorphologyPanel( this );
+    addDockWidget( Qt::RightDockWidgetArea, morphologyPanel );
+    morphologyPanel->hide();
+
+    QAction *showMorphology = morphologyPanel->toggleViewAction();
+    showMorphology->setShortcut( tr("Ctrl+Shift+M") );
+    showMorphology->setStatusTip( tr("Group the beats by shape, compare them overlaid and relabel whole groups") );
+    ui->menu_Tools->addAction( showMorphology );
 }
 /* }}} */
 
@@ -273,6 +377,11 @@ void MainWindow::readSettings()
     QSize size = settings.value("size", QSize(400, 400)).toSize();
     move(pos);
     resize(size);
+
+    quint32 filters = settings.value( "Display Filters", 0 ).toUInt();
+    foreach ( QAction *action, filterActions ) {
+        action->setChecked( filters & action->data().toUInt() );
+    }
 }
 /* }}} */
 
@@ -285,6 +394,7 @@ void MainWindow::writeSettings()
     QSettings settings("Datrix", "DatrixECGViewer");
     settings.setValue( "pos", pos() );
     settings.setValue( "size", size() );
+    settings.setValue( "Display Filters", displayFilters() );
 }
 /* }}} */
 
@@ -407,7 +517,13 @@ void MainWindow::openEcgFile( QString fileName )
         child = createMdiChild();
 		connect_child_to_signals(child);
         child->setComboViewTypeAction( ui->toolBarView->addWidget( child->getComboViewTypeWidget() ) );
-        child->m_ecgdata = new EcgData( fileName, child );
+
+        /* another view may still have the record open under a different title */
+        EcgData *record = EcgData::acquire( fileName );
+        if ( record == NULL ) {
+            record = new EcgData( fileName, child );
+        }
+        child->attach_record( record );
         child->setWindowTitle(fileName);
         if ( child->m_ecgdata ) {
             statusBar()->showMessage(tr("ECG file loaded"), 2000);
@@ -437,6 +553,36 @@ void MainWindow::openEcgFile( QString fileName )
 /* }}} */
 
 
+/** {{{ void MainWindow::newView()
+    @brief Open another window onto the record of the active window, sharing its data
+*/
+void MainWindow::newView()
+{
+    ShowSignal *ss = qobject_cast<ShowSignal *>( activeMdiChild() );
+    if ( ! ss ) {
+        return;
+    }
+
+    QString fileName = ss->m_ecgdata->file_name;
+    int views = 0;
+    foreach (QMdiSubWindow *window, mdiArea->subWindowList()) {
+        ShowSignal *other = qobject_cast<ShowSignal *>( window->widget() );
+        if ( other && other->m_ecgdata == ss->m_ecgdata ) {
+            views++;
+        }
+    }
+
+    ShowSignal *child = createMdiChild();
+    connect_child_to_signals(child);
+    child->setComboViewTypeAction( ui->toolBarView->addWidget( child->getComboViewTypeWidget() ) );
+    child->show_record_of( ss );
+    child->setWindowTitle( QString("%1:%2").arg( fileName ).arg( views + 1 ) );
+    child->setFocus(Qt::ShortcutFocusReason);
+    child->show();
+}
+/* }}} */
+
+
 /** {{{ void MainWindow::updatePacerText( QString txt )
  */
 void MainWindow::updatePacerText( QString txt )
@@ -456,6 +602,15 @@ void MainWindow::updatePacerText( QString txt )
 /* }}} */
 
 
+/** {{{ void MainWindow::updateHoverText( QString txt )
+ */
+void MainWindow::updateHoverText( QString txt )
+{
+    lblHoverReadout->setText( txt );
+}
+/* }}} */
+
+
 /** {{{ void MainWindow::connect_child_to_signals( QWidget *child )
     @brief Connect child to signals
 */
@@ -488,6 +643,7 @@ void MainWindow::connect_child_to_signals( QWidget *child )
         connect( this, SIGNAL(keyPressEvent_signaled(QKeyEvent*)), ss, SLOT(keyPressEvent(QKeyEvent*)) );
 
         connect( ss, SIGNAL(updatePacerText(QString)), this, SLOT(updatePacerText(QString)) );
+        connect( ss, SIGNAL(updateHoverText(QString)), this, SLOT(updateHoverText(QString)), Qt::UniqueConnection );
     }
 }
 /* }}} */
@@ -540,6 +696,45 @@ void MainWindow::saveAs()
 /* }}} */
 
 
+/** {{{ void MainWindow::undo()
+    @brief Undo the last annotation edit of the active window's record
+*/
+void MainWindow::undo()
+{
+    ShowSignal *ss = qobject_cast<ShowSignal *>( activeMdiChild() );
+    if ( ss ) {
+        ss->undo();
+    }
+}
+/* }}} */
+
+
+/** {{{ void MainWindow::loadAnnotators()
+    @brief Load other annotators of the active window's record
+*/
+void MainWindow::loadAnnotators()
+{
+    ShowSignal *ss = qobject_cast<ShowSignal *>( activeMdiChild() );
+    if ( ss ) {
+        ss->load_annotators();
+    }
+}
+/* }}} */
+
+
+/** {{{ void MainWindow::redo()
+    @brief Redo the annotation edit last undone
+*/
+void MainWindow::redo()
+{
+    ShowSignal *ss = qobject_cast<ShowSignal *>( activeMdiChild() );
+    if ( ss ) {
+        ss->redo();
+    }
+}
+/* }}} */
+
+
 /** {{{ void MainWindow::print()
   @brief Print the ECG data
  */
@@ -765,6 +960,7 @@ void MainWindow::mdiChildActivated( QMdiSubWindow *mdiChild )
     ui->actionForwards->setEnabled(hasMdiChild);
     ui->actionBackwards->setEnabled(hasMdiChild);
 
+    ui->actionNew_View->setEnabled(hasMdiChild);
     ui->action_Close->setEnabled(hasMdiChild);
     ui->actionClose_All->setEnabled(hasMdiChild);
     ui->action_Tile->setEnabled(hasMdiChild);
@@ -773,6 +969,9 @@ void MainWindow::mdiChildActivated( QMdiSubWindow *mdiChild )
     ui->action_Previous->setEnabled(hasMdiChild);
     actionSeparator->setVisible(hasMdiChild);
 
+    queryPanel->setView( qobject_cast<ShowSignal *>( activeMdiChild() ) );
+    morphologyPanel->setView( qobject_cast<ShowSignal *>( activeMdiChild() ) );
+
     // bool hasSelection = (activeMdiChild());
 
 
@@ -868,6 +1067,7 @@ ShowSignal *MainWindow::createMdiChild()
 {
     ShowSignal *child = new ShowSignal(mdiArea);
     mdiArea->addSubWindow(child);
+    child->set_display_filters( displayFilters() );
     /* connect - test */
     connect( child, SIGNAL(focusChanged()), this, SLOT(setFocusOnActiveWindow()) );
 
@@ -24,6 +24,8 @@
 
 #include "ecgdata.h"
 #include "showsignal.h"
+#include "querypanel.h"
+#include "morphologypanel.h"
 
 
 namespace Ui {
@@ -67,11 +69,16 @@ public slots:
 
     void updateVisibleChild(int ignored);
     void updatePacerText( QString txt );
+    void updateHoverText( QString txt );
 
     void newFile();
     void open();
     void save();
     void saveAs();
+    void undo();
+    void redo();
+    void loadAnnotators();
+    void displayFiltersChanged();
     void print();
     void printStrip();
     void printPDF();
@@ -86,6 +93,7 @@ public slots:
     void setActiveSubWindow( QWidget *window );
     void setFocusOnActiveWindow();
     void openEcgFile( QString fileName );
+    void newView();
 
     void openMruFile( int mruFileIndex );
 
@@ -114,9 +122,11 @@ private:
     void createMenus();
     void createToolBars();
     void createStatusBar();
+    void createDockWindows();
     void readSettings();
     void writeSettings();
     QWidget *activeMdiChild();
+    quint32 displayFilters();
     QMdiSubWindow *findMdiChild(const QString &fileName);
 
     QMdiArea *mdiArea;
@@ -127,6 +137,11 @@ private:
 
     QComboBox *comboEcgGain;
 	QLabel *lblPaceBeatsPerMinute;
+	QLabel *lblHoverReadout;
+
+	QueryPanel *queryPanel;
+	MorphologyPanel *morphologyPanel;
+	QList<QAction *> filterActions;	/**< checkable, each with its FILTER_... flag as data */
 
 };
 
@@ -0,0 +1,379 @@
+/**
+ * @file morphologypanel.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <algorithm>
+
+#include "mainwindow.h"
+#include "morphologypanel.h"
+
+
+/** {{{ MorphologyOverlay::MorphologyOverlay( QWidget *parent )
+ */
+MorphologyOverlay::MorphologyOverlay( QWidget *parent )
+	: QWidget( parent )
+{
+	m_before = 0;
+	m_after = 0;
+	setMinimumSize( 200, 150 );
+	setSizePolicy( QSizePolicy::Expanding, QSizePolicy::Expanding );
+}
+/* }}} */
+
+
+/** {{{ void MorphologyOverlay::setBeats( EcgData *record, const QVector<qint64> &positions, long before, long after )
+    @brief Draw the beats at positions of record, from before samples before each to after samples after
+*/
+void MorphologyOverlay::setBeats( EcgData *record, const QVector<qint64> &positions, long before, long after )
+{
+	m_record = record;
+	m_positions = positions;
+	m_before = before;
+	m_after = after;
+	update();
+}
+/* }}} */
+
+
+/** {{{ void MorphologyOverlay::paintEvent( QPaintEvent *event )
+ */
+void MorphologyOverlay::paintEvent( QPaintEvent *event )
+{
+	Q_UNUSED(event);
+
+	QPainter painter( this );
+	painter.fillRect( rect(), Qt::white );
+
+	long span = m_before + m_after;
+	if ( ! m_record || m_positions.isEmpty() || span < 2 ) {
+		painter.setPen( Qt::gray );
+		painter.drawText( rect(), Qt::AlignCenter, tr("Choose a cluster") );
+		return;
+	}
+
+	QVector<int> channels;
+	for ( int ch = 0 ; ch < m_record->channel_count ; ch++ ) {
+		if ( m_record->get_data_channel( ch ) != NULL ) {
+			channels.append( ch );
+		}
+	}
+	if ( channels.isEmpty() ) {
+		return;
+	}
+
+	painter.setRenderHint( QPainter::Antialiasing, true );
+	qreal rowHeight = (qreal) height() / channels.size();
+	qreal xScale = (qreal) width() / ( span - 1 );
+
+	/* where the beats are annotated */
+	painter.setPen( QPen( Qt::lightGray, 1, Qt::DashLine ) );
+	painter.drawLine( QPointF( m_before * xScale, 0 ), QPointF( m_before * xScale, height() ) );
+
+	for ( int c = 0 ; c < channels.size() ; c++ ) {
+		const quint16 *samples = m_record->get_data_channel( channels[c] );
+		long length = m_record->channel_length( channels[c] );
+
+		/** {{{ each beat less its own mean, and the mean of them all */
+		QVector<QVector<float> > traces;
+		QVector<float> mean( span, 0.0f );
+		float extent = 1;
+		foreach ( qint64 pos, m_positions ) {
+			if ( pos < m_before || pos + m_after > length ) {
+				continue;
+			}
+			const quint16 *x = samples + pos - m_before;
+			QVector<float> trace( span );
+			float baseline = 0;
+			for ( long s = 0 ; s < span ; s++ ) {
+				baseline += x[s];
+			}
+			baseline /= span;
+			for ( long s = 0 ; s < span ; s++ ) {
+				trace[s] = x[s] - baseline;
+				mean[s] += trace[s];
+				extent = qMax( extent, qAbs( trace[s] ) );
+			}
+			traces.append( trace );
+		}
+		if ( traces.isEmpty() ) {
+			continue;
+		}
+		/* }}} */
+
+		qreal middle = ( c + 0.5 ) * rowHeight;
+		qreal yScale = ( rowHeight / 2 - 2 ) / extent;
+
+		painter.setPen( QPen( QColor( 0, 0, 160, qBound( 12, 2400 / traces.size(), 160 ) ), 0 ) );
+		QPolygonF line( span );
+		foreach ( const QVector<float> &trace, traces ) {
+			for ( long s = 0 ; s < span ; s++ ) {
+				line[s] = QPointF( s * xScale, middle - trace[s] * yScale );
+			}
+			painter.drawPolyline( line );
+		}
+
+		painter.setPen( QPen( Qt::red, 2 ) );
+		for ( long s = 0 ; s < span ; s++ ) {
+			line[s] = QPointF( s * xScale, middle - mean[s] / traces.size() * yScale );
+		}
+		painter.drawPolyline( line );
+	}
+}
+/* }}} */
+
+
+/** {{{ MorphologyPanel::MorphologyPanel( QWidget *parent )
+ */
+MorphologyPanel::MorphologyPanel( QWidget *parent )
+	: QDockWidget( tr("Beat Morphology"), parent )
+{
+	setObjectName( "morphologyPanel" );
+	m_stale = true;
+
+	m_cluster = new QPushButton( tr("Cluster") );
+	m_cluster->setToolTip( tr("Group all the beats by shape again, from scratch") );
+	m_summary = new QLabel;
+	m_clusters = new QListWidget;
+	m_clusters->setUniformItemSizes( true );
+	m_overlay = new MorphologyOverlay;
+
+	m_relabelType = new QComboBox;
+	m_relabelType->addItem( tr("Normal"), NORMAL );
+	m_relabelType->addItem( tr("PVC"), PVC );
+	m_relabelType->addItem( tr("APC"), APC );
+	m_relabelType->addItem( tr("Fusion"), FUSION );
+	m_relabelType->addItem( tr("Unknown"), UNKNOWN );
+	m_relabelType->addItem( tr("LBBB"), LBBB );
+	m_relabelType->addItem( tr("RBBB"), RBBB );
+	m_relabel = new QPushButton( tr("Relabel Cluster") );
+	m_relabel->setToolTip( tr("Give every beat of the cluster this type, as one edit that can be undone") );
+
+	QHBoxLayout *top = new QHBoxLayout;
+	top->addWidget( m_cluster );
+	top->addWidget( m_summary, 1 );
+	QHBoxLayout *bottom = new QHBoxLayout;
+	bottom->addWidget( m_relabelType, 1 );
+	bottom->addWidget( m_relabel );
+
+	QSplitter *splitter = new QSplitter( Qt::Vertical );
+	splitter->addWidget( m_clusters );
+	splitter->addWidget( m_overlay );
+
+	QWidget *contents = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout( contents );
+	layout->setContentsMargins( 2, 2, 2, 2 );
+	layout->addLayout( top );
+	layout->addWidget( splitter, 1 );
+	layout->addLayout( bottom );
+	setWidget( contents );
+
+	connect( m_cluster, SIGNAL(clicked()), this, SLOT(recluster()) );
+	connect( m_relabel, SIGNAL(clicked()), this, SLOT(relabel_cluster()) );
+	connect( m_clusters, SIGNAL(itemSelectionChanged()), this, SLOT(cluster_chosen()) );
+	connect( m_clusters, SIGNAL(itemActivated(QListWidgetItem *)), this, SLOT(cluster_activated(QListWidgetItem *)) );
+	connect( this, SIGNAL(visibilityChanged(bool)), this, SLOT(panel_shown(bool)) );
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::setView( ShowSignal *view )
+    @brief Cluster view's record from now on
+*/
+void MorphologyPanel::setView( ShowSignal *view )
+{
+	EcgData *record = view ? view->record() : NULL;
+	m_view = view;
+	if ( record && record == m_record ) {
+		return;
+	}
+
+	if ( m_record ) {
+		disconnect( m_record, SIGNAL(annotations_changed()), this, SLOT(update_clusters()) );
+	}
+	m_record = record;
+	m_morphology.clear();
+	m_stale = true;
+	if ( m_record ) {
+		connect( m_record, SIGNAL(annotations_changed()), this, SLOT(update_clusters()) );
+	}
+	update_clusters();
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::panel_shown( bool visible )
+ */
+void MorphologyPanel::panel_shown( bool visible )
+{
+	if ( visible && m_stale ) {
+		update_clusters();
+	}
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::recluster()
+    @brief Throw the clusters away and group every beat again
+*/
+void MorphologyPanel::recluster()
+{
+	m_morphology.clear();
+	update_clusters();
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::update_clusters()
+    @brief Bring the clusters up to date with the record's annotations and list them, largest first
+*/
+void MorphologyPanel::update_clusters()
+{
+	if ( ! isVisible() ) {
+		/* nobody is looking; catch up when the panel is shown */
+		m_stale = true;
+		return;
+	}
+	m_stale = false;
+
+	int chosen = chosen_cluster();
+	m_clusters->clear();
+	m_summary->clear();
+	if ( ! m_record ) {
+		m_overlay->setBeats( NULL, QVector<qint64>(), 0, 0 );
+		return;
+	}
+
+	QVector<const quint16 *> channels;
+	long length = m_record->size();
+	for ( int ch = 0 ; ch < m_record->channel_count ; ch++ ) {
+		if ( m_record->get_data_channel( ch ) != NULL ) {
+			channels.append( m_record->get_data_channel( ch ) );
+			length = qMin( length, m_record->channel_length( ch ) );
+		}
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	int count = m_morphology.update( m_record->beats, channels, length, m_record->samps_per_chan_per_sec );
+	m_summary->setText( tr("%1 beats in %2 ms").arg( count ).arg( timer.elapsed() ) );
+
+	const QVector<BeatCluster> &clusters = m_morphology.clusters();
+	QVector<int> order;
+	for ( int c = 0 ; c < clusters.size() ; c++ ) {
+		if ( clusters[c].count > 0 ) {
+			order.append( c );
+		}
+	}
+	std::stable_sort( order.begin(), order.end(), [&clusters]( int a, int b ) { return clusters[a].count > clusters[b].count; } );
+
+	/* annstr() goes through WFDB's globals */
+	QMutexLocker locker( &glb_wfdb_mutex );
+
+	foreach ( int c, order ) {
+		const BeatCluster &cluster = clusters[c];
+		QString text = tr("%1 beats  %2% %3")
+				.arg( cluster.count )
+				.arg( 100.0 * cluster.dominantCount / cluster.count, 0, 'f', 0 )
+				.arg( annstr( cluster.dominantType ) );
+		QListWidgetItem *item = new QListWidgetItem( text, m_clusters );
+		item->setData( Qt::UserRole, c );
+		if ( c == chosen ) {
+			item->setSelected( true );
+		}
+	}
+	locker.unlock();
+
+	if ( m_clusters->selectedItems().isEmpty() ) {
+		cluster_chosen();
+	}
+}
+/* }}} */
+
+
+/** {{{ int MorphologyPanel::chosen_cluster()
+    @brief The selected cluster, -1 for none
+*/
+int MorphologyPanel::chosen_cluster()
+{
+	QList<QListWidgetItem *> selected = m_clusters->selectedItems();
+	return selected.isEmpty() ? -1 : selected.first()->data( Qt::UserRole ).toInt();
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::cluster_chosen()
+    @brief Show the overlay of the selected cluster
+*/
+void MorphologyPanel::cluster_chosen()
+{
+	int cluster = chosen_cluster();
+	if ( cluster < 0 || ! m_record ) {
+		m_overlay->setBeats( NULL, QVector<qint64>(), 0, 0 );
+		return;
+	}
+
+	/* spread through the cluster, so a long record shows beats from all of it */
+	QVector<qint64> members = m_morphology.members( cluster );
+	QVector<qint64> shown;
+	int step = qMax( 1, members.size() / MORPH_OVERLAY_MAX );
+	for ( int m = 0 ; m < members.size() && shown.size() < MORPH_OVERLAY_MAX ; m += step ) {
+		shown.append( members[m] );
+	}
+	m_overlay->setBeats( m_record, shown, m_morphology.windowBefore(), m_morphology.windowAfter() );
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::cluster_activated( QListWidgetItem *item )
+    @brief Center the view on the first beat of the cluster
+*/
+void MorphologyPanel::cluster_activated( QListWidgetItem *item )
+{
+	if ( ! m_view || ! m_record || ! item ) {
+		return;
+	}
+
+	QVector<int> indexes = m_morphology.memberIndexes( item->data( Qt::UserRole ).toInt(), m_record->beats );
+	if ( ! indexes.isEmpty() ) {
+		m_view->show_annotation( indexes.first() );
+	}
+}
+/* }}} */
+
+
+/** {{{ void MorphologyPanel::relabel_cluster()
+    @brief Give every beat of the selected cluster the chosen type, as one edit
+*/
+void MorphologyPanel::relabel_cluster()
+{
+	int cluster = chosen_cluster();
+	if ( cluster < 0 || ! m_record ) {
+		return;
+	}
+
+	int type = m_relabelType->currentData().toInt();
+	int changed = m_record->edits.relabelList( m_record->beats, m_morphology.memberIndexes( cluster, m_record->beats ), type );
+	if ( changed ) {
+		m_record->annotations_edited();
+	}
+	if ( glb_mainwindow ) {
+		glb_mainwindow->statusBar()->showMessage( tr("%1 beats relabelled %2").arg( changed ).arg( m_relabelType->currentText() ), 3000 );
+	}
+}
+/* }}} */
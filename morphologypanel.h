@@ -0,0 +1,105 @@
+/**
+ * @file morphologypanel.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef MORPHOLOGYPANEL_H
+#define MORPHOLOGYPANEL_H
+
+#include <QtWidgets>
+
+#include "showsignal.h"
+#include "beatmorphology.h"
+
+
+#define MORPH_OVERLAY_MAX		(200)	/**< beats of a cluster drawn on top of each other, spread through it */
+
+
+/* {{{ class MorphologyOverlay
+   @brief	The beats of one cluster drawn on top of each other, one row per channel
+
+   Each beat is drawn faintly with its own baseline taken out, so the common
+   shape shows up dark and the odd ones stand out, with the mean of those
+   drawn on top.
+*/
+class MorphologyOverlay : public QWidget
+{
+	Q_OBJECT
+
+public:
+	MorphologyOverlay( QWidget *parent = 0 );
+
+	void setBeats( EcgData *record, const QVector<qint64> &positions, long before, long after );
+
+protected:
+	void paintEvent( QPaintEvent *event );
+
+private:
+	QPointer<EcgData> m_record;
+	QVector<qint64> m_positions;
+	long m_before;
+	long m_after;
+};
+/* }}} */
+
+
+/* {{{ class MorphologyPanel
+   @brief	Dock window listing the active view's beats clustered by shape
+
+   The clusters are kept up to date as the record's annotations are edited
+   (see BeatMorphology::update()), so relabelling a cluster, which is one
+   edit in the record's BeatJournal, does not start them over; "Cluster"
+   does.  Choosing a cluster shows its overlay, activating it centers the
+   view on its first beat.
+*/
+class MorphologyPanel : public QDockWidget
+{
+	Q_OBJECT
+
+public:
+	MorphologyPanel( QWidget *parent = 0 );
+
+	void setView( ShowSignal *view );
+
+public slots:
+	void update_clusters();
+	void recluster();
+
+private slots:
+	void cluster_chosen();
+	void cluster_activated( QListWidgetItem *item );
+	void relabel_cluster();
+	void panel_shown( bool visible );
+
+private:
+	int chosen_cluster();
+
+	QPointer<ShowSignal> m_view;
+	QPointer<EcgData> m_record;
+	BeatMorphology m_morphology;
+	bool m_stale;				/**< the annotations changed while the panel was hidden */
+
+	QPushButton *m_cluster;
+	QLabel *m_summary;
+	QListWidget *m_clusters;
+	MorphologyOverlay *m_overlay;
+	QComboBox *m_relabelType;
+	QPushButton *m_relabel;
+};
+/* }}} */
+
+#endif // MORPHOLOGYPANEL_H
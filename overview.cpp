@@ -0,0 +1,186 @@
+/**
+ * @file overview.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtGui>
+#include <QtConcurrent>
+#include <algorithm>
+#include <math.h>
+
+#include "overview.h"
+
+
+/** {{{ static void count_beat( OverviewBucket &bucket, int type )
+    @brief Add one annotation to a bucket
+
+    Decided here rather than with isqrs(), since the WFDB macros go through
+    globals and this runs on several threads.
+*/
+static void count_beat( OverviewBucket &bucket, int type )
+{
+	switch ( type ) {
+		case PVC:
+		case VESC:
+		case RONT:
+		case FLWAV:
+			bucket.ventricular++;
+			bucket.beats++;
+			break;
+
+		case PACE:
+		case PFUS:
+			bucket.paced++;
+			bucket.beats++;
+			break;
+
+		case UNKNOWN:
+			bucket.unknown++;
+			bucket.beats++;
+			break;
+
+		case NORMAL:
+		case LBBB:
+		case RBBB:
+		case ABERR:
+		case FUSION:
+		case NPC:
+		case APC:
+		case SVPB:
+		case NESC:
+		case AESC:
+		case SVESC:
+		case BBB:
+			bucket.beats++;
+			break;
+
+		case NOISE:
+		case ARFCT:
+			bucket.noise++;
+			break;
+
+		default:
+			break;
+	}
+}
+/* }}} */
+
+
+/** {{{ RecordOverview::RecordOverview()
+ */
+RecordOverview::RecordOverview()
+	: m_valid(false), m_totalSamples(0), m_samplesPerBucket(1), m_samplesPerSec(1), m_noiseSigma(0)
+{
+}
+/* }}} */
+
+
+/** {{{ void RecordOverview::build( EcgData *ecgdata, const BeatStore &beats, const PacerIndex &pacer )
+    @brief Summarize the whole record into buckets, all buckets at once
+*/
+void RecordOverview::build( EcgData *ecgdata, const BeatStore &beats, const PacerIndex &pacer )
+{
+	m_valid = true;
+	m_pixels.clear();
+	m_buckets.clear();
+	m_totalSamples = ecgdata->size();
+	m_samplesPerSec = qMax( 1, ecgdata->samps_per_chan_per_sec );
+
+	if ( m_totalSamples <= 0 ) {
+		return;
+	}
+
+	int count = qBound( 1, ecgdata->datalen_secs, OVERVIEW_BUCKETS );
+	m_samplesPerBucket = (m_totalSamples + count - 1) / count;
+	count = (m_totalSamples + m_samplesPerBucket - 1) / m_samplesPerBucket;
+
+	OverviewBucket empty;
+	memset( &empty, 0, sizeof(empty) );
+	m_buckets.fill( empty, count );
+
+	QVector<int> indexes( count );
+	for ( int b = 0 ; b < count ; b++ ) {
+		indexes[b] = b;
+	}
+
+	QtConcurrent::blockingMap( indexes, [&]( int b ) {
+		OverviewBucket &bucket = m_buckets[b];
+		long start = b * m_samplesPerBucket;
+		long end = qMin( m_totalSamples, start + m_samplesPerBucket );
+
+		for ( int beat = beats.lowerBound( start ) ; beat < beats.size() && beats.pos(beat) < end ; beat++ ) {
+			count_beat( bucket, beats.type(beat) );
+		}
+
+		bucket.pacerSpikes = pacer.countIn( start, end );
+
+		bucket.sigma = sqrt( qMax( 0.0, ecgdata->window_variance( 0, start, end - start ) ) );
+	} );
+
+	/* a slice is noisy when it stands out from the typical one */
+	QVector<float> sigmas( count );
+	for ( int b = 0 ; b < count ; b++ ) {
+		sigmas[b] = m_buckets[b].sigma;
+	}
+	std::nth_element( sigmas.begin(), sigmas.begin() + count / 2, sigmas.end() );
+	m_noiseSigma = sigmas[count / 2] * OVERVIEW_NOISE_SIGMA_RATIO;
+}
+/* }}} */
+
+
+/** {{{ const QVector<OverviewPixel> &RecordOverview::pixels( int width )
+    @brief The summary folded into width pixel columns
+*/
+const QVector<OverviewPixel> &RecordOverview::pixels( int width )
+{
+	if ( m_pixels.size() == width || m_buckets.isEmpty() || width <= 0 ) {
+		return m_pixels;
+	}
+
+	int count = m_buckets.size();
+	m_pixels.resize( width );
+
+	for ( int x = 0 ; x < width ; x++ ) {
+		int b0 = (long) x * count / width;
+		int b1 = qMax( b0 + 1, (int) ((long) (x + 1) * count / width) );
+
+		OverviewBucket sum;
+		memset( &sum, 0, sizeof(sum) );
+		bool noisy = false;
+		for ( int b = b0 ; b < b1 && b < count ; b++ ) {
+			const OverviewBucket &bucket = m_buckets[b];
+			sum.beats += bucket.beats;
+			sum.ventricular += bucket.ventricular;
+			sum.unknown += bucket.unknown;
+			sum.paced += bucket.paced;
+			sum.pacerSpikes += bucket.pacerSpikes;
+			noisy = noisy || bucket.noise > 0 || bucket.sigma > m_noiseSigma;
+		}
+
+		OverviewPixel &pixel = m_pixels[x];
+		qreal seconds = (qreal) (b1 - b0) * m_samplesPerBucket / m_samplesPerSec;
+		pixel.hr = ( seconds > 0 ) ? sum.beats * 60.0 / seconds : 0;
+		pixel.ventricular = sum.beats ? (float) sum.ventricular / sum.beats : 0;
+		pixel.unknown = sum.beats ? (float) sum.unknown / sum.beats : 0;
+		pixel.paced = qMin( 1.0f, sum.beats ? (float) qMax( sum.paced, sum.pacerSpikes ) / sum.beats : (sum.pacerSpikes ? 1.0f : 0.0f) );
+		pixel.noisy = noisy;
+	}
+
+	return m_pixels;
+}
+/* }}} */
@@ -0,0 +1,94 @@
+/**
+ * @file overview.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef OVERVIEW_H
+#define OVERVIEW_H
+
+#include <QtGui>
+#include "ecgdata.h"
+#include "beatstore.h"
+
+
+#define OVERVIEW_BUCKETS			(4096)	/**< the record is summarized into at most this many slices */
+#define OVERVIEW_NOISE_SIGMA_RATIO	(4.0)	/**< a slice this much noisier than the median one counts as noise */
+
+
+/* {{{ struct OverviewBucket
+   @brief	What happened during one slice of the record
+*/
+struct OverviewBucket
+{
+	quint32 beats;			/**< QRS complexes */
+	quint32 ventricular;
+	quint32 unknown;
+	quint32 paced;
+	quint32 noise;			/**< noise and artifact annotations */
+	quint32 pacerSpikes;
+	float sigma;			/**< standard deviation of the first channel */
+};
+/* }}} */
+
+
+/* {{{ struct OverviewPixel
+   @brief	The buckets under one pixel column, reduced to what gets drawn
+*/
+struct OverviewPixel
+{
+	float hr;				/**< beats per minute, 0 if no beats */
+	float ventricular;		/**< fraction of the beats */
+	float unknown;
+	float paced;			/**< fraction of the beats, pacer spikes included */
+	bool noisy;
+};
+/* }}} */
+
+
+/* {{{ class RecordOverview
+   @brief	Whole record summary behind the navigation strip
+
+   build() makes one parallel pass over the beats and the channel statistics
+   into a fixed number of buckets.  pixels() folds those into one entry per
+   pixel column, and keeps the result until the width changes, so drawing
+   the strip costs the same however long the record is.
+*/
+class RecordOverview
+{
+public:
+	RecordOverview();
+
+	bool isValid() const { return m_valid; }
+	void invalidate() { m_valid = false; m_pixels.clear(); }
+
+	void build( EcgData *ecgdata, const BeatStore &beats, const PacerIndex &pacer );
+	const QVector<OverviewPixel> &pixels( int width );
+
+	long totalSamples() const { return m_totalSamples; }
+
+private:
+	bool m_valid;
+	long m_totalSamples;
+	long m_samplesPerBucket;
+	int m_samplesPerSec;
+	float m_noiseSigma;
+	QVector<OverviewBucket> m_buckets;
+	QVector<OverviewPixel> m_pixels;
+};
+/* }}} */
+
+#endif // OVERVIEW_H
@@ -0,0 +1,168 @@
+/**
+ * @file pacerindex.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <algorithm>
+
+#include "wfdb/ecgcodes.h"
+#include "pacerindex.h"
+
+
+/** {{{ static int count_below( const QVector<qint64> &sorted, qint64 pos )
+ */
+static int count_below( const QVector<qint64> &sorted, qint64 pos )
+{
+	return std::lower_bound( sorted.constBegin(), sorted.constEnd(), pos ) - sorted.constBegin();
+}
+/* }}} */
+
+
+/** {{{ PacerIndex::PacerIndex()
+ */
+PacerIndex::PacerIndex()
+{
+	clear();
+}
+/* }}} */
+
+
+/** {{{ void PacerIndex::clear()
+ */
+void PacerIndex::clear()
+{
+	m_sampsPerSec = 1;
+	m_recordEnd = 0;
+	m_spikes.clear();
+	m_perMinute.clear();
+	m_beatPos.clear();
+	m_pacedPos.clear();
+}
+/* }}} */
+
+
+/** {{{ void PacerIndex::build( const QVector<quint32> &spikes, int sampsPerSec, qint64 recordEnd )
+    @brief Take over the spikes found while loading, in ascending order
+*/
+void PacerIndex::build( const QVector<quint32> &spikes, int sampsPerSec, qint64 recordEnd )
+{
+	m_sampsPerSec = qMax( 1, sampsPerSec );
+	m_spikes = spikes;
+	m_recordEnd = qMax( recordEnd, m_spikes.isEmpty() ? (qint64) 0 : (qint64) m_spikes.last() + 1 );
+
+	long samplesPerMinute = 60L * m_sampsPerSec;
+	m_perMinute.fill( 0, ( m_recordEnd + samplesPerMinute - 1 ) / samplesPerMinute );
+	foreach ( quint32 pos, m_spikes ) {
+		m_perMinute[ pos / samplesPerMinute ]++;
+#ifdef DEBUG_PRINT_PACER_DETECTIONS
+		qDebug() << qPrintable( QString("%1:%2:%3.%4")
+				.arg( ((pos/m_sampsPerSec) / 60 / 60), 2, 10, QLatin1Char('0'))
+				.arg( ((pos/m_sampsPerSec) / 60) % 60, 2, 10, QLatin1Char('0'))
+				.arg( ((pos/m_sampsPerSec)     ) % 60, 2, 10, QLatin1Char('0'))
+				.arg( ((10 * pos/m_sampsPerSec)     ) % 10, 1, 10, QLatin1Char('0'))
+				);
+#endif
+	}
+}
+/* }}} */
+
+
+/** {{{ void PacerIndex::index_beats( const BeatStore &beats )
+    @brief Find the paced beats: those a spike or PACE annotation came shortly before
+*/
+void PacerIndex::index_beats( const BeatStore &beats )
+{
+	m_beatPos.clear();
+	m_pacedPos.clear();
+
+	qint64 capture = (qint64) PACER_CAPTURE_MS * m_sampsPerSec / 1000;
+	qint64 lastPaceAnnotation = -1;
+	int spike = 0;
+
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		qint64 pos = beats.pos( b );
+		int type = beats.type( b );
+
+		if ( type == PACE ) {
+			lastPaceAnnotation = pos;
+			continue;
+		}
+		if ( ! BeatStore::isBeat( type ) ) {
+			continue;
+		}
+
+		/* the spikes and beats are both in order, so walk them together */
+		while ( spike < m_spikes.size() && m_spikes[spike] <= pos ) {
+			spike++;
+		}
+		bool paced = ( spike > 0 && pos - m_spikes[spike - 1] <= capture )
+				|| ( lastPaceAnnotation >= 0 && pos - lastPaceAnnotation <= capture );
+
+		m_beatPos.append( pos );
+		if ( paced ) {
+			m_pacedPos.append( pos );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ int PacerIndex::lowerBound( qint64 pos ) const
+    @brief Index of the first spike at or after pos
+*/
+int PacerIndex::lowerBound( qint64 pos ) const
+{
+	if ( pos <= 0 ) {
+		return 0;
+	}
+	if ( pos > 0xffffffffLL ) {
+		return m_spikes.size();
+	}
+	return std::lower_bound( m_spikes.constBegin(), m_spikes.constEnd(), (quint32) pos ) - m_spikes.constBegin();
+}
+/* }}} */
+
+
+/** {{{ PacingStats PacerIndex::pacing( qint64 from, qint64 to ) const
+    @brief Spikes, beats and paced beats from up to to
+*/
+PacingStats PacerIndex::pacing( qint64 from, qint64 to ) const
+{
+	PacingStats s;
+	s.spikes = countIn( from, to );
+	s.beats = count_below( m_beatPos, to ) - count_below( m_beatPos, from );
+	s.paced = count_below( m_pacedPos, to ) - count_below( m_pacedPos, from );
+	return s;
+}
+/* }}} */
+
+
+/** {{{ QVector<PacingStats> PacerIndex::perHour() const
+ */
+QVector<PacingStats> PacerIndex::perHour() const
+{
+	qint64 samplesPerHour = 3600LL * m_sampsPerSec;
+	qint64 end = qMax( m_recordEnd, m_beatPos.isEmpty() ? (qint64) 0 : m_beatPos.last() + 1 );
+
+	QVector<PacingStats> hours;
+	for ( qint64 start = 0 ; start < end ; start += samplesPerHour ) {
+		hours.append( pacing( start, start + samplesPerHour ) );
+	}
+	return hours;
+}
+/* }}} */
@@ -0,0 +1,83 @@
+/**
+ * @file pacerindex.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef PACERINDEX_H
+#define PACERINDEX_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define PACER_FILTER_DELAY	(100)	/**< samples the 201 tap filter reports a spike late by */
+#define PACER_CAPTURE_MS	(300)	/**< a beat this soon after a spike counts as paced */
+
+
+/* {{{ struct PacingStats
+   @brief	How much of some stretch of the record was paced
+*/
+struct PacingStats
+{
+	int spikes;
+	int beats;
+	int paced;			/**< beats with a spike or PACE annotation shortly before them */
+
+	double percent() const { return beats > 0 ? 100.0 * paced / beats : 0.0; }
+};
+/* }}} */
+
+
+/* {{{ class PacerIndex
+   @brief	The pacer spikes the loader found, and the beats they paced
+
+   The loader collects the spikes of a whole record into a local vector and
+   hands them over once to build(), which counts them for every minute in
+   a single pass.  index_beats() runs whenever the annotations change and
+   keeps the positions of all beats and of the paced ones, so the spikes,
+   beats and paced beats in any stretch are each two binary searches.
+*/
+class PacerIndex
+{
+public:
+	PacerIndex();
+
+	void build( const QVector<quint32> &spikes, int sampsPerSec, qint64 recordEnd );
+	void index_beats( const BeatStore &beats );
+	void clear();
+
+	int size() const { return m_spikes.size(); }
+	bool isEmpty() const { return m_spikes.isEmpty(); }
+	const QVector<quint32> &positions() const { return m_spikes; }	/* ascending */
+	int lowerBound( qint64 pos ) const;
+	int countIn( qint64 from, qint64 to ) const { return lowerBound( to ) - lowerBound( from ); }
+
+	int perMinute( int minute ) const { return ( minute >= 0 && minute < m_perMinute.size() ) ? m_perMinute[minute] : 0; }
+	PacingStats pacing( qint64 from, qint64 to ) const;
+	QVector<PacingStats> perHour() const;
+
+private:
+	int m_sampsPerSec;
+	qint64 m_recordEnd;
+	QVector<quint32> m_spikes;
+	QVector<int> m_perMinute;		/**< spikes in each minute of the record */
+	QVector<qint64> m_beatPos;		/**< every beat */
+	QVector<qint64> m_pacedPos;		/**< the paced ones among them */
+};
+/* }}} */
+
+#endif // PACERINDEX_H
@@ -0,0 +1,248 @@
+/**
+ * @file qrsdetector.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <math.h>
+
+#include "qrsdetector.h"
+
+
+/** {{{ static float centered_mean( const QVector<double> &prefix, long n, long i, long len )
+    @brief Mean of the len samples around i, from their prefix sums, cut short at the ends
+*/
+static float centered_mean( const QVector<double> &prefix, long n, long i, long len )
+{
+	long first = qMax( 0L, i - len / 2 );
+	long last = qMin( n, first + len );
+	return ( prefix[last] - prefix[first] ) / ( last - first );
+}
+/* }}} */
+
+
+/** {{{ QrsDetector::QrsDetector( int sampsPerSec )
+ */
+QrsDetector::QrsDetector( int sampsPerSec )
+{
+	m_sampsPerSec = qMax( 1, sampsPerSec );
+	m_integration = qMax( 1L, (long) QRS_INTEGRATION_MS * m_sampsPerSec / 1000 );
+	m_refractory = (long) QRS_REFRACTORY_MS * m_sampsPerSec / 1000;
+	m_from = 0;
+	m_keepFrom = 0;
+	m_signalLevel = 0;
+	m_noiseLevel = 0;
+	m_threshold = 0;
+	m_lastQrs = -1;
+	m_rrAverage = 0;
+	m_candidate = -1;
+	m_candidateValue = 0;
+}
+/* }}} */
+
+
+/** {{{ void QrsDetector::update_thresholds()
+ */
+void QrsDetector::update_thresholds()
+{
+	m_threshold = m_noiseLevel + 0.25f * ( m_signalLevel - m_noiseLevel );
+}
+/* }}} */
+
+
+/** {{{ void QrsDetector::accept( long peak, float value, bool searchBack )
+    @brief Take the integrated peak at peak as a QRS complex
+*/
+void QrsDetector::accept( long peak, float value, bool searchBack )
+{
+	if ( searchBack ) {
+		m_signalLevel = 0.25f * value + 0.75f * m_signalLevel;
+	} else {
+		m_signalLevel = 0.125f * value + 0.875f * m_signalLevel;
+	}
+	if ( m_lastQrs >= 0 ) {
+		long rr = peak - m_lastQrs;
+		m_rrAverage = m_rrAverage ? ( 7 * m_rrAverage + rr ) / 8 : rr;
+	}
+	m_lastQrs = peak;
+	m_candidate = -1;
+	m_candidateValue = 0;
+	update_thresholds();
+
+	/* the integration lags the complex; the beat is at the largest deflection before the peak */
+	long best = peak;
+	for ( long i = qMax( 0L, peak - m_integration ) ; i < peak ; i++ ) {
+		if ( m_bandpass[i] > m_bandpass[best] ) {
+			best = i;
+		}
+	}
+	if ( m_from + best >= m_keepFrom ) {
+		m_beats.append( m_from + best );
+	}
+}
+/* }}} */
+
+
+/** {{{ void QrsDetector::found_peak( long peak, float value )
+    @brief Decide whether a peak of the integrated signal is a QRS complex or noise
+*/
+void QrsDetector::found_peak( long peak, float value )
+{
+	if ( m_lastQrs >= 0 && m_rrAverage > 0 && m_candidate >= 0 && peak - m_lastQrs > m_rrAverage * 166 / 100 ) {
+		/* it has been too long; the best peak since the last beat over half the threshold was one */
+		accept( m_candidate, m_candidateValue, true );
+	}
+
+	if ( m_lastQrs >= 0 && peak - m_lastQrs < m_refractory ) {
+		return;
+	}
+
+	if ( value > m_threshold ) {
+		accept( peak, value, false );
+		return;
+	}
+
+	m_noiseLevel = 0.125f * value + 0.875f * m_noiseLevel;
+	if ( value > m_threshold / 2 && value > m_candidateValue ) {
+		m_candidate = peak;
+		m_candidateValue = value;
+	}
+	update_thresholds();
+}
+/* }}} */
+
+
+/** {{{ void QrsDetector::run( const QVector<const quint16 *> &channels, long from, long to, long keepFrom )
+    @brief Detect the beats of samples from up to to, keeping those at or after keepFrom
+*/
+void QrsDetector::run( const QVector<const quint16 *> &channels, long from, long to, long keepFrom )
+{
+	long n = to - from;
+	if ( n <= 0 || channels.isEmpty() ) {
+		return;
+	}
+	m_from = from;
+	m_keepFrom = keepFrom;
+
+	/* a moving average of length L is down 3 dB at about 0.443 fs / L */
+	long shortLen = qMax( 1L, (long) qRound( 0.443 * m_sampsPerSec / 15 ) );
+	long longLen = qMax( shortLen + 1, (long) qRound( 0.443 * m_sampsPerSec / 5 ) );
+	long step = qMax( 1L, (long) qRound( m_sampsPerSec / 200.0 ) );
+
+	QVector<double> prefix( n + 1 );
+	QVector<float> bandpass( n );
+	QVector<float> energy( n, 0.0f );
+	m_bandpass.fill( 0.0f, n );
+
+	foreach ( const quint16 *samples, channels ) {
+		prefix[0] = 0;
+		for ( long i = 0 ; i < n ; i++ ) {
+			prefix[i + 1] = prefix[i] + samples[from + i];
+		}
+		for ( long i = 0 ; i < n ; i++ ) {
+			bandpass[i] = centered_mean( prefix, n, i, shortLen ) - centered_mean( prefix, n, i, longLen );
+			m_bandpass[i] += fabsf( bandpass[i] );
+		}
+		for ( long i = 4 * step ; i < n ; i++ ) {
+			float d = ( 2 * bandpass[i] + bandpass[i - step] - bandpass[i - 3 * step] - 2 * bandpass[i - 4 * step] ) / 8;
+			energy[i] += d * d;
+		}
+	}
+
+	QVector<float> integrated( n );
+	double running = 0;
+	for ( long i = 0 ; i < n ; i++ ) {
+		running += energy[i];
+		if ( i >= m_integration ) {
+			running -= energy[i - m_integration];
+		}
+		integrated[i] = running / m_integration;
+	}
+
+	/* start the levels from the first couple of seconds */
+	long learn = qMin( n, (long) QRS_LEARN_SECONDS * m_sampsPerSec );
+	float learnMax = 0;
+	double learnSum = 0;
+	for ( long i = 0 ; i < learn ; i++ ) {
+		learnMax = qMax( learnMax, integrated[i] );
+		learnSum += integrated[i];
+	}
+	m_signalLevel = 0.25f * learnMax;
+	m_noiseLevel = 0.5f * learnSum / qMax( 1L, learn );
+	update_thresholds();
+
+	for ( long i = 1 ; i + 1 < n ; i++ ) {
+		if ( integrated[i] > integrated[i - 1] && integrated[i] >= integrated[i + 1] ) {
+			found_peak( i, integrated[i] );
+		}
+	}
+}
+/* }}} */
+
+
+/** {{{ QVector<qint64> QrsDetector::detect( const QVector<const quint16 *> &channels, long length, int sampsPerSec )
+    @brief The beats of the first length samples of channels, detected in parallel chunks
+*/
+QVector<qint64> QrsDetector::detect( const QVector<const quint16 *> &channels, long length, int sampsPerSec )
+{
+	QVector<qint64> beats;
+	sampsPerSec = qMax( 1, sampsPerSec );
+	if ( length <= 0 || channels.isEmpty() ) {
+		return beats;
+	}
+
+	long chunk = (long) QRS_CHUNK_SECONDS * sampsPerSec;
+	int count = ( length + chunk - 1 ) / chunk;
+	QVector< QVector<qint64> > found( count );
+	QVector<int> indexes( count );
+	for ( int c = 0 ; c < count ; c++ ) {
+		indexes[c] = c;
+	}
+
+	QtConcurrent::blockingMap( indexes, [&]( int c ) {
+		long keepFrom = c * chunk;
+		long keepTo = qMin( length, keepFrom + chunk );
+
+		/* run on a little past the end too, so a beat right at it still gets its peak */
+		QrsDetector detector( sampsPerSec );
+		detector.run( channels, qMax( 0L, keepFrom - (long) QRS_WARMUP_SECONDS * sampsPerSec ), qMin( length, keepTo + sampsPerSec ), keepFrom );
+		foreach ( qint64 pos, detector.beats() ) {
+			if ( pos < keepTo ) {
+				found[c].append( pos );
+			}
+		}
+	} );
+
+	foreach ( const QVector<qint64> &part, found ) {
+		beats += part;
+	}
+	std::sort( beats.begin(), beats.end() );
+
+	/* neighbouring chunks can both see a beat near where they meet */
+	long refractory = (long) QRS_REFRACTORY_MS * sampsPerSec / 1000;
+	int kept = 0;
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		if ( kept == 0 || beats[b] - beats[kept - 1] >= refractory ) {
+			beats[kept++] = beats[b];
+		}
+	}
+	beats.resize( kept );
+	return beats;
+}
+/* }}} */
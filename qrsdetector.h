@@ -0,0 +1,86 @@
+/**
+ * @file qrsdetector.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef QRSDETECTOR_H
+#define QRSDETECTOR_H
+
+#include <QtCore>
+
+
+#define QRS_CHUNK_SECONDS		(5*60)	/**< stretch of the record one worker detects in */
+#define QRS_WARMUP_SECONDS		(10)	/**< ... after learning its thresholds from this much before it */
+#define QRS_LEARN_SECONDS		(2)		/**< the thresholds start from the signal over this long */
+#define QRS_INTEGRATION_MS		(150)	/**< moving window integration */
+#define QRS_REFRACTORY_MS		(200)	/**< no second QRS this soon after one */
+
+#define QRS_DETECTED_SUBTYPE	(100)	/**< subtype of the beats the detector put in, so they are never taken for reviewed ones */
+
+
+/* {{{ class QrsDetector
+   @brief	Pan-Tompkins style QRS detection for records without annotations
+
+   Each channel is band passed (the difference of two moving averages, for
+   roughly 5 to 15 Hz), differentiated and squared, and the channels are
+   added up before the moving window integration.  Peaks of the integrated
+   signal are QRS complexes or noise depending on adaptive thresholds that
+   follow the levels of both, with a search back at half the threshold when
+   a beat seems to have been missed.  The beat is put at the largest band
+   passed deflection in the integration window before its peak.
+
+   One detector streams through one stretch of the record.  detect() cuts
+   the record into QRS_CHUNK_SECONDS chunks and runs one detector for each
+   in parallel, each starting QRS_WARMUP_SECONDS early so its thresholds
+   have settled by the time its own stretch begins.
+*/
+class QrsDetector
+{
+public:
+	QrsDetector( int sampsPerSec );
+
+	void run( const QVector<const quint16 *> &channels, long from, long to, long keepFrom );
+	const QVector<qint64> &beats() const { return m_beats; }
+
+	static QVector<qint64> detect( const QVector<const quint16 *> &channels, long length, int sampsPerSec );
+
+private:
+	void found_peak( long peak, float value );
+	void accept( long peak, float value, bool searchBack );
+	void update_thresholds();
+
+	int m_sampsPerSec;
+	long m_integration;			/**< samples */
+	long m_refractory;
+
+	QVector<float> m_bandpass;	/**< sum over channels of the band passed magnitude */
+	long m_from;				/**< sample m_bandpass[0] is for */
+	long m_keepFrom;
+
+	float m_signalLevel;		/**< SPKI */
+	float m_noiseLevel;			/**< NPKI */
+	float m_threshold;
+	long m_lastQrs;
+	long m_rrAverage;			/**< of the last 8 intervals */
+	long m_candidate;			/**< the largest noise peak since the last QRS, for the search back */
+	float m_candidateValue;
+
+	QVector<qint64> m_beats;
+};
+/* }}} */
+
+#endif // QRSDETECTOR_H
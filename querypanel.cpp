@@ -0,0 +1,141 @@
+/**
+ * @file querypanel.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include "beatquery.h"
+#include "querypanel.h"
+
+
+/** {{{ QueryPanel::QueryPanel( QWidget *parent )
+ */
+QueryPanel::QueryPanel( QWidget *parent )
+	: QDockWidget( tr("Find Annotations"), parent )
+{
+	setObjectName( "queryPanel" );
+
+	m_query = new QLineEdit;
+	m_query->setPlaceholderText( tr("e.g. V hr>120 from=2:00 to=5:00") );
+	m_query->setToolTip( tr("Types by mnemonic (V,A), sub=, from=h:mm, to=h:mm, hr>bpm, rr>seconds, aux=text") );
+	m_summary = new QLabel;
+	m_results = new QListWidget;
+	m_results->setUniformItemSizes( true );
+
+	QWidget *contents = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout( contents );
+	layout->setContentsMargins( 2, 2, 2, 2 );
+	layout->addWidget( m_query );
+	layout->addWidget( m_summary );
+	layout->addWidget( m_results );
+	setWidget( contents );
+
+	connect( m_query, SIGNAL(returnPressed()), this, SLOT(run_query()) );
+	connect( m_results, SIGNAL(itemActivated(QListWidgetItem *)), this, SLOT(result_chosen(QListWidgetItem *)) );
+	connect( m_results, SIGNAL(itemClicked(QListWidgetItem *)), this, SLOT(result_chosen(QListWidgetItem *)) );
+}
+/* }}} */
+
+
+/** {{{ void QueryPanel::setView( ShowSignal *view )
+    @brief Search view's record from now on
+*/
+void QueryPanel::setView( ShowSignal *view )
+{
+	EcgData *record = view ? view->record() : NULL;
+	m_view = view;
+	if ( record && record == m_record ) {
+		return;
+	}
+
+	if ( m_record ) {
+		disconnect( m_record, SIGNAL(annotations_changed()), this, SLOT(run_query()) );
+	}
+	m_record = record;
+	if ( m_record ) {
+		connect( m_record, SIGNAL(annotations_changed()), this, SLOT(run_query()) );
+	}
+	run_query();
+}
+/* }}} */
+
+
+/** {{{ void QueryPanel::run_query()
+ */
+void QueryPanel::run_query()
+{
+	m_results->clear();
+	m_summary->clear();
+	if ( ! m_record || m_query->text().trimmed().isEmpty() ) {
+		return;
+	}
+
+	long samps_per_sec = m_record->samps_per_chan_per_sec;
+	BeatQuery query;
+	if ( ! query.parse( m_query->text(), samps_per_sec ) ) {
+		m_summary->setText( query.error() );
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QVector<int> found = query.run( m_record->beats, m_record->rr );
+	m_summary->setText( tr("%1 found in %2 ms").arg( found.size() ).arg( timer.elapsed() ) );
+
+	/* annstr() goes through WFDB's globals */
+	QMutexLocker locker( &glb_wfdb_mutex );
+
+	const BeatStore &beats = m_record->beats;
+	int listed = qMin( found.size(), QUERY_PANEL_MAX_LISTED );
+	for ( int i = 0 ; i < listed ; i++ ) {
+		int b = found[i];
+		qint64 pos = beats.pos( b );
+		long tenths = pos * 10 / samps_per_sec;
+		int interval = m_record->rr.intervalBefore( b );
+
+		QString text = QString("%1:%2:%3.%4  %5")
+				.arg( tenths / 36000 )
+				.arg( ( tenths / 600 ) % 60, 2, 10, QLatin1Char('0') )
+				.arg( ( tenths / 10 ) % 60, 2, 10, QLatin1Char('0') )
+				.arg( tenths % 10 )
+				.arg( annstr( beats.type( b ) ) );
+		if ( interval > 0 ) {
+			text += QString("  HR %1").arg( 60 * samps_per_sec / interval );
+		}
+		if ( beats.hasAux( b ) ) {
+			text += "  " + beats.aux( b );
+		}
+
+		QListWidgetItem *item = new QListWidgetItem( text, m_results );
+		item->setData( Qt::UserRole, b );
+	}
+	if ( listed < found.size() ) {
+		m_summary->setText( tr("%1 found in %2 ms, the first %3 listed").arg( found.size() ).arg( timer.elapsed() ).arg( listed ) );
+	}
+}
+/* }}} */
+
+
+/** {{{ void QueryPanel::result_chosen( QListWidgetItem *item )
+ */
+void QueryPanel::result_chosen( QListWidgetItem *item )
+{
+	if ( m_view && item ) {
+		m_view->show_annotation( item->data( Qt::UserRole ).toInt() );
+	}
+}
+/* }}} */
@@ -0,0 +1,62 @@
+/**
+ * @file querypanel.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef QUERYPANEL_H
+#define QUERYPANEL_H
+
+#include <QtWidgets>
+
+#include "showsignal.h"
+
+
+#define QUERY_PANEL_MAX_LISTED	(10000)	/**< more matches than this are counted but not listed */
+
+
+/* {{{ class QueryPanel
+   @brief	Dock window that runs a BeatQuery on the active view's record
+
+   Choosing a result centers that view on it.  The query runs again
+   whenever the record's annotations are edited, since the indexes listed
+   move with them.
+*/
+class QueryPanel : public QDockWidget
+{
+	Q_OBJECT
+
+public:
+	QueryPanel( QWidget *parent = 0 );
+
+	void setView( ShowSignal *view );
+
+public slots:
+	void run_query();
+
+private slots:
+	void result_chosen( QListWidgetItem *item );
+
+private:
+	QPointer<ShowSignal> m_view;
+	QPointer<EcgData> m_record;
+	QLineEdit *m_query;
+	QLabel *m_summary;
+	QListWidget *m_results;
+};
+/* }}} */
+
+#endif // QUERYPANEL_H
@@ -0,0 +1,284 @@
+/**
+ * @file rrseries.cpp
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "rrseries.h"
+
+
+/** {{{ static bool is_normal( int type )
+    @brief Whether a beat counts as normal for NN intervals
+*/
+static bool is_normal( int type )
+{
+	return type == NORMAL || type == LBBB || type == RBBB || type == BBB;
+}
+/* }}} */
+
+
+/** {{{ RRSeries::RRSeries()
+ */
+RRSeries::RRSeries()
+{
+	clear();
+}
+/* }}} */
+
+
+/** {{{ void RRSeries::clear()
+ */
+void RRSeries::clear()
+{
+	m_sampsPerSec = 1;
+	m_recordEnd = 0;
+	m_intervalBefore.clear();
+	m_nnTime.clear();
+	m_nnMs.clear();
+	m_diffMs.clear();
+	m_diffValid.clear();
+	memset( &m_record, 0, sizeof(m_record) );
+	m_perMinute.clear();
+	m_perHour.clear();
+}
+/* }}} */
+
+
+/** {{{ void RRSeries::build( const BeatStore &beats, int sampsPerSec, qint64 recordEnd )
+    @brief Work out the intervals of beats, then the whole record statistics and trends
+*/
+void RRSeries::build( const BeatStore &beats, int sampsPerSec, qint64 recordEnd )
+{
+	clear();
+	m_sampsPerSec = qMax( 1, sampsPerSec );
+	m_recordEnd = recordEnd;
+	if ( m_recordEnd <= 0 && ! beats.isEmpty() ) {
+		m_recordEnd = beats.pos( beats.size() - 1 ) + 1;
+	}
+
+	m_intervalBefore.resize( beats.size() );
+
+	qint64 lastPos = -1;		/* the last annotation that is not a pacer spike or rhythm change */
+	qint64 lastQrsPos = -1;
+	bool lastQrsNormal = false;
+	int lastQrsNN = -1;			/* the NN interval ending at the last beat, if any */
+
+	for ( int b = 0 ; b < beats.size() ; b++ ) {
+		qint64 pos = beats.pos( b );
+		int type = beats.type( b );
+
+		m_intervalBefore[b] = ( lastPos >= 0 ) ? (qint32) qMin( pos - lastPos, (qint64) std::numeric_limits<qint32>::max() ) : -1;
+		if ( type != PACE && type != RHYTHM ) {
+			lastPos = pos;
+		}
+
+		if ( ! BeatStore::isBeat( type ) ) {
+			continue;
+		}
+
+		bool normal = is_normal( type );
+		int endingNN = -1;
+		if ( lastQrsPos >= 0 && normal && lastQrsNormal ) {
+			float ms = ( pos - lastQrsPos ) * 1000.0f / m_sampsPerSec;
+			if ( ms >= RR_NN_MIN_MS && ms <= RR_NN_MAX_MS ) {
+				endingNN = m_nnMs.size();
+				m_nnTime.append( pos );
+				m_nnMs.append( ms );
+				m_diffMs.append( ( lastQrsNN >= 0 ) ? ms - m_nnMs[lastQrsNN] : 0.0f );
+				m_diffValid.append( ( lastQrsNN >= 0 ) ? 1.0f : 0.0f );
+			}
+		}
+		lastQrsPos = pos;
+		lastQrsNormal = normal;
+		lastQrsNN = endingNN;
+	}
+
+	m_record = stats( 0, m_recordEnd );
+	m_perMinute = trend( 60L * m_sampsPerSec );
+	m_perHour = trend( 3600L * m_sampsPerSec );
+}
+/* }}} */
+
+
+/** {{{ int RRSeries::lowerBound( qint64 pos ) const
+    @brief Index of the first NN interval ending at or after pos
+*/
+int RRSeries::lowerBound( qint64 pos ) const
+{
+	return std::lower_bound( m_nnTime.constBegin(), m_nnTime.constEnd(), pos ) - m_nnTime.constBegin();
+}
+/* }}} */
+
+
+/** {{{ RRSeries::Partial RRSeries::partial( int first, int last, bool withFirstDiff ) const
+    @brief The sums over NN intervals first up to last
+
+    withFirstDiff says whether the difference from the interval before first
+    belongs to the stretch being summed.
+*/
+RRSeries::Partial RRSeries::partial( int first, int last, bool withFirstDiff ) const
+{
+	Partial p;
+	memset( &p, 0, sizeof(p) );
+	p.minNN = std::numeric_limits<float>::max();
+
+	const float *nn = m_nnMs.constData();
+	const float *diff = m_diffMs.constData();
+	const float *valid = m_diffValid.constData();
+
+	for ( int i = first ; i < last ; i++ ) {
+		float v = nn[i];
+		p.sum += v;
+		p.sumSq += v * v;
+		p.minNN = qMin( p.minNN, v );
+		p.maxNN = qMax( p.maxNN, v );
+	}
+
+	for ( int i = withFirstDiff ? first : first + 1 ; i < last ; i++ ) {
+		float d = diff[i];
+		p.diffSumSq += d * d;
+		p.diffCount += valid[i];
+		p.nn50 += ( fabsf( d ) > 50.0f ) ? 1.0 : 0.0;
+	}
+
+	p.count = qMax( 0, last - first );
+	return p;
+}
+/* }}} */
+
+
+/** {{{ QVector<RRSeries::Partial> RRSeries::segment_partials( qint64 from, qint64 to, qint64 segmentSamples ) const
+    @brief The sums for each segment of the record that from up to to touches, in parallel
+
+    Segments are counted from the start of the record, and the first and last
+    are cut down to the window.
+*/
+QVector<RRSeries::Partial> RRSeries::segment_partials( qint64 from, qint64 to, qint64 segmentSamples ) const
+{
+	qint64 firstSegment = from / segmentSamples;
+	int count = ( to - 1 ) / segmentSamples - firstSegment + 1;
+
+	QVector<Partial> parts( count );
+	QVector<int> indexes( count );
+	for ( int c = 0 ; c < count ; c++ ) {
+		indexes[c] = c;
+	}
+
+	QtConcurrent::blockingMap( indexes, [&]( int c ) {
+		qint64 start = qMax( from, ( firstSegment + c ) * segmentSamples );
+		qint64 end = qMin( to, ( firstSegment + c + 1 ) * segmentSamples );
+		parts[c] = partial( lowerBound( start ), lowerBound( end ), start != from );
+	} );
+
+	return parts;
+}
+/* }}} */
+
+
+/** {{{ HrvStats RRSeries::stats( qint64 from, qint64 to ) const
+    @brief Time domain HRV over the NN intervals ending from up to to
+*/
+HrvStats RRSeries::stats( qint64 from, qint64 to ) const
+{
+	HrvStats s;
+	memset( &s, 0, sizeof(s) );
+	if ( to <= from || m_nnMs.isEmpty() ) {
+		return s;
+	}
+
+	QVector<Partial> parts = segment_partials( qMax( (qint64) 0, from ), to, (qint64) RR_SDANN_SECONDS * m_sampsPerSec );
+
+	Partial total;
+	memset( &total, 0, sizeof(total) );
+	total.minNN = std::numeric_limits<float>::max();
+	QVector<double> means;
+
+	foreach ( const Partial &p, parts ) {
+		total.count += p.count;
+		total.sum += p.sum;
+		total.sumSq += p.sumSq;
+		total.diffCount += p.diffCount;
+		total.diffSumSq += p.diffSumSq;
+		total.nn50 += p.nn50;
+		if ( p.count > 0 ) {
+			total.minNN = qMin( total.minNN, p.minNN );
+			total.maxNN = qMax( total.maxNN, p.maxNN );
+			means.append( p.sum / p.count );
+		}
+	}
+
+	if ( total.count == 0 ) {
+		return s;
+	}
+
+	s.count = total.count;
+	s.meanNN = total.sum / total.count;
+	s.sdnn = sqrt( qMax( 0.0, total.sumSq / total.count - s.meanNN * s.meanNN ) );
+	if ( total.diffCount > 0 ) {
+		s.rmssd = sqrt( total.diffSumSq / total.diffCount );
+		s.pnn50 = total.nn50 / total.diffCount;
+	}
+
+	double meanSum = 0;
+	double meanSumSq = 0;
+	foreach ( double mean, means ) {
+		meanSum += mean;
+		meanSumSq += mean * mean;
+	}
+	double meanOfMeans = meanSum / means.size();
+	s.sdann = sqrt( qMax( 0.0, meanSumSq / means.size() - meanOfMeans * meanOfMeans ) );
+
+	s.meanHR = 60000.0 / s.meanNN;
+	s.minHR = 60000.0 / total.maxNN;
+	s.maxHR = 60000.0 / total.minNN;
+	return s;
+}
+/* }}} */
+
+
+/** {{{ QVector<HrBucket> RRSeries::trend( qint64 bucketSamples ) const
+    @brief Heart rate for each stretch of bucketSamples from the start of the record
+*/
+QVector<HrBucket> RRSeries::trend( qint64 bucketSamples ) const
+{
+	QVector<HrBucket> buckets;
+	if ( m_recordEnd <= 0 ) {
+		return buckets;
+	}
+
+	QVector<Partial> parts = segment_partials( 0, m_recordEnd, bucketSamples );
+	buckets.resize( parts.size() );
+
+	for ( int b = 0 ; b < parts.size() ; b++ ) {
+		const Partial &p = parts[b];
+		HrBucket &bucket = buckets[b];
+		memset( &bucket, 0, sizeof(bucket) );
+		if ( p.count > 0 ) {
+			bucket.count = p.count;
+			bucket.meanHR = 60000.0 * p.count / p.sum;
+			bucket.minHR = 60000.0 / p.maxNN;
+			bucket.maxHR = 60000.0 / p.minNN;
+		}
+	}
+	return buckets;
+}
+/* }}} */
@@ -0,0 +1,125 @@
+/**
+ * @file rrseries.h
+ *
+ * Copyright (C) 2018 Datrix
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see https://www.gnu.org/licenses/.
+ *
+*/
+#ifndef RRSERIES_H
+#define RRSERIES_H
+
+#include <QtCore>
+#include "beatstore.h"
+
+
+#define RR_NN_MIN_MS		(300)	/**< shorter NN intervals are taken to be missed or extra detections */
+#define RR_NN_MAX_MS		(2000)	/**< ... and so are longer ones */
+#define RR_SDANN_SECONDS	(5*60)	/**< SDANN averages over segments this long; also the unit of parallel work */
+
+
+/* {{{ struct HrvStats
+   @brief	Time domain heart rate variability over some stretch of the record
+*/
+struct HrvStats
+{
+	int count;			/**< NN intervals */
+	double meanNN;		/**< ms */
+	double sdnn;		/**< ms */
+	double sdann;		/**< ms, of the means of the RR_SDANN_SECONDS segments */
+	double rmssd;		/**< ms */
+	double pnn50;		/**< fraction of successive differences over 50 ms */
+	double meanHR;		/**< bpm */
+	double minHR;
+	double maxHR;
+};
+/* }}} */
+
+
+/* {{{ struct HrBucket
+   @brief	Heart rate over one minute or hour of the record; all zero with no NN intervals
+*/
+struct HrBucket
+{
+	int count;
+	float meanHR;
+	float minHR;
+	float maxHR;
+};
+/* }}} */
+
+
+/* {{{ class RRSeries
+   @brief	The beat to beat intervals of a record, worked out once
+
+   For every annotation the interval back to the previous one that is not a
+   pacer spike or rhythm change is kept, which is what the strip shows as
+   the heart rate.  For the statistics the NN intervals (between successive
+   normal beats, within RR_NN_MIN_MS and RR_NN_MAX_MS) are kept in plain
+   float arrays together with their successive differences, zero where the
+   previous interval was not adjacent, so the sums are straight loops the
+   compiler can vectorize.  A window is split into RR_SDANN_SECONDS segments
+   which are summed in parallel; the segment means give SDANN as well.
+*/
+class RRSeries
+{
+public:
+	RRSeries();
+
+	void build( const BeatStore &beats, int sampsPerSec, qint64 recordEnd );
+	void clear();
+
+	int intervalBefore( int beat ) const { return m_intervalBefore[beat]; }	/* samples, -1 when there is no earlier beat */
+
+	int nnCount() const { return m_nnMs.size(); }
+	const HrvStats &stats() const { return m_record; }
+	HrvStats stats( qint64 from, qint64 to ) const;
+
+	const QVector<HrBucket> &perMinute() const { return m_perMinute; }
+	const QVector<HrBucket> &perHour() const { return m_perHour; }
+
+private:
+	struct Partial
+	{
+		double count;
+		double sum;
+		double sumSq;
+		double diffCount;
+		double diffSumSq;
+		double nn50;
+		float minNN;
+		float maxNN;
+	};
+
+	int lowerBound( qint64 pos ) const;
+	Partial partial( int first, int last, bool withFirstDiff ) const;
+	QVector<Partial> segment_partials( qint64 from, qint64 to, qint64 segmentSamples ) const;
+	QVector<HrBucket> trend( qint64 bucketSamples ) const;
+
+	int m_sampsPerSec;
+	qint64 m_recordEnd;
+	QVector<qint32> m_intervalBefore;	/**< per annotation */
+
+	QVector<qint64> m_nnTime;			/**< position of the beat ending each NN interval */
+	QVector<float> m_nnMs;
+	QVector<float> m_diffMs;			/**< from the previous NN interval, 0 if not adjacent */
+	QVector<float> m_diffValid;			/**< 1 where m_diffMs means something, else 0 */
+
+	HrvStats m_record;
+	QVector<HrBucket> m_perMinute;
+	QVector<HrBucket> m_perHour;
+};
+/* }}} */
+
+#endif // RRSERIES_H
@@ -20,29 +20,78 @@
 
 #include <QDebug>
 #include <QString>
+#include <QtConcurrent>
 
 #include "myheader.h"
 #include "mainwindow.h"
 #include "showsignal.h"
+#include "fulldisclosure.h"
+#include "overview.h"
 #include "utils.h"
 
+/** multiples of real time that playback can run at */
+static const int playbackSpeeds[PLAYBACK_SPEED_COUNT] = { 1, 2, 5, 10, 25 };
+
 
 /** {{{ ShowSignal::ShowSignal()
     @brief Define a constructor for my canvas
 */
 ShowSignal::ShowSignal(QWidget *parent, EcgData *theEcgData )
-    : QWidget(parent), m_ecgdata(theEcgData)
+    : QWidget(parent),
+      m_labelsAnnotation( QFont("Helvetica",8) ),
+      m_labelsRhythm( QFont("Helvetica",6) ),
+      m_ecgdata(theEcgData)
 {
     if ( m_ecgdata == NULL ) {
         m_ecgdata = new EcgData;
     }
+    m_beats = m_ecgdata->beats;
     curpos_samples = 0;
 	first_beat_found = -1;
 	cached_middle_beat_found = -1;
     m_testspeed = false;
+    m_timer = NULL;
+    m_playbackStartPos = 0;
+    m_playbackSpeedIndex = 0;
+    m_playbackFramesSkipped = 0;
+    m_gridCacheExtra = -1;
+
+    m_frameMsecs = RENDER_FRAME_MSECS;
+    if ( QGuiApplication::primaryScreen() && QGuiApplication::primaryScreen()->refreshRate() >= 1 ) {
+        m_frameMsecs = qMax( 1, qRound( 1000.0 / QGuiApplication::primaryScreen()->refreshRate() ) );
+    }
+    m_renderPending = false;
+    memset( &m_renderStats, 0, sizeof(m_renderStats) );
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setSingleShot( true );
+    m_frameTimer->setTimerType( Qt::PreciseTimer );
+    connect( m_frameTimer, SIGNAL(timeout()), this, SLOT(update()) );
+
+    m_lastNavKey = 0;
+    m_lastNavDelta = 0;
+    m_navType = PVC;
+    m_navAux = 0;
+    m_filterConfig = 0;
+    m_filterIncomplete = 0;
+    m_frameUnfiltered = false;
+    m_renderCache.setMaxCost( RENDER_CACHE_KBYTES );
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setSingleShot( true );
+    connect( m_prefetchTimer, SIGNAL(timeout()), this, SLOT(prefetch_next()) );
+
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        displayPixelsPerSample[ch] = 0;
+        displayAdcZero[ch] = 0;
+    }
+    m_hoverChannel = -1;
+    m_hoverSample = -1;
+    m_overviewDragging = false;
     m_test_antialiasing = false;
+    m_selectFrom = -1;
+    m_selectTo = -1;
+    connect( m_ecgdata, SIGNAL(annotations_changed()), this, SLOT(annotations_changed()) );
+    connect( &m_ecgdata->filtered, SIGNAL(blockReady()), this, SLOT(filtered_block_ready()) );
 	yOffsetDragged = 0;
-    pacerPosition.clear();
 
     comboViewType = new QComboBox();
     comboViewType->addItem("", (int) VIEWTYPE_NONE );
@@ -85,7 +134,92 @@ ShowSignal::ShowSignal(QWidget *parent, EcgData *theEcgData )
 ShowSignal::~ShowSignal()
 {
     delete comboViewType;
-    delete m_ecgdata;
+    m_prefetchTouch.waitForFinished();
+    EcgData::release( m_ecgdata );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::attach_record( EcgData *ecgdata )
+    @brief Show ecgdata, taking over the caller's reference to it
+*/
+void ShowSignal::attach_record( EcgData *ecgdata )
+{
+    if ( ecgdata == m_ecgdata ) {
+        EcgData::release( ecgdata );
+        return;
+    }
+
+    disconnect( m_ecgdata, SIGNAL(annotations_changed()), this, SLOT(annotations_changed()) );
+    disconnect( &m_ecgdata->filtered, SIGNAL(blockReady()), this, SLOT(filtered_block_ready()) );
+    m_prefetchTouch.waitForFinished();
+    EcgData::release( m_ecgdata );
+    m_ecgdata = ecgdata;
+    connect( m_ecgdata, SIGNAL(annotations_changed()), this, SLOT(annotations_changed()) );
+    connect( &m_ecgdata->filtered, SIGNAL(blockReady()), this, SLOT(filtered_block_ready()) );
+    m_selectFrom = m_selectTo = -1;
+    annotations_changed();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::annotations_changed()
+    @brief Pick up the record's annotations again after they were edited, in any view of it
+*/
+void ShowSignal::annotations_changed()
+{
+    m_beats = m_ecgdata->beats;
+    first_beat_found = -1;
+    cached_middle_beat_found = -1;
+    invalidate_render_cache();
+    request_render();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::set_display_filters( quint32 filters )
+    @brief Show the traces through the FILTER_... filters, 0 for none
+
+    Views already drawn with other filters stay in the render cache, so
+    toggling back and forth does not redraw them; blocks that are not
+    filtered yet are drawn as recorded until filtered_block_ready().
+*/
+void ShowSignal::set_display_filters( quint32 filters )
+{
+    if ( filters == m_filterConfig ) {
+        return;
+    }
+    m_filterConfig = filters;
+    m_prefetchTargets.clear();
+    request_render();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::filtered_block_ready()
+    @brief Draw the view again if it went up before its samples were filtered
+*/
+void ShowSignal::filtered_block_ready()
+{
+    if ( m_frameUnfiltered ) {
+        request_render();
+    }
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::show_record_of( ShowSignal *other )
+    @brief Become another view of the record shown by other, starting where it is
+*/
+void ShowSignal::show_record_of( ShowSignal *other )
+{
+    other->m_ecgdata->retain();
+    attach_record( other->m_ecgdata );
+
+    gain_mm_per_mV = other->gain_mm_per_mV;
+    display_extra = other->display_extra;
+    SetPos( other->GetPos() );
+    update();
 }
 /* }}} */
 
@@ -97,12 +231,28 @@ void ShowSignal::showEvent( QShowEvent * event )
 {
     Q_UNUSED(event);
 
-    glb_mainwindow->getComboEcgGainWidget()->setCurrentIndex( glb_mainwindow->getComboEcgGainWidget()->findText( QString::number(gain_mm_per_mV) + " mm/mV" ) );
+    glb_mainwindow->getComboEcgGainWidget()->setCurrentIndex( glb_mainwindow->getComboEcgGainWidget()->findData( gain_mm_per_mV ) );
 }
 
 /* }}} */
 
 
+/** {{{ bool ShowSignal::channel_visible( int ch )
+    @brief Whether channel ch is drawn; without a main window (batch reports) the first three are
+*/
+bool ShowSignal::channel_visible( int ch )
+{
+    if ( ch < 0 || ch >= 3 ) {
+        return false;
+    }
+    if ( ! glb_mainwindow ) {
+        return true;
+    }
+    return glb_mainwindow->isVisibleChan[ch];
+}
+/* }}} */
+
+
 /** {{{ void ShowSignal::hideEvent( QHideEvent * event )
     @brief Hide event which happens whenever this window gets hidden
 */
@@ -152,197 +302,12 @@ void ShowSignal::setViewType( int newViewType )
 /* }}} */
 
 
-/** {{{ void ShowSignal::store_pacer_position( long samplePos )
+/** {{{ void ShowSignal::pacer_spikes_found()
  */
-void ShowSignal::store_pacer_position( long samplePos )
+void ShowSignal::pacer_spikes_found()
 {
-    samplePos -= 100;    /**< Compensate for the 201 tap filter that misreports where the pacer spike was detected. */
-
-
-    if ( samplePos < 0 ) {
-        // qDebug() << "\n\n" << windowTitle() << " : " << "\n";
-    } else {
-
-#ifdef DEBUG_PRINT_PACER_DETECTIONS
-        int sampleRate = 256;
-
-        // sampleRate = m_ecgdata->samps_per_chan_per_sec;
-
-        qDebug() << qPrintable( QString("%1:%2:%3.%4")
-				.arg( ((samplePos/sampleRate) / 60 / 60), 2, 10, QLatin1Char('0'))
-				.arg( ((samplePos/sampleRate) / 60) % 60, 2, 10, QLatin1Char('0'))
-				.arg( ((samplePos/sampleRate)     ) % 60, 2, 10, QLatin1Char('0'))
-				.arg( ((10 * samplePos/sampleRate)     ) % 10, 1, 10, QLatin1Char('0'))
-				);
-#endif
-
-        pacerPosition.append(samplePos);
-
-        int minutePos = samplePos / m_ecgdata->samps_per_chan_per_sec / 60;
-        paceBeatsPerMinute[minutePos] += 1;
-    }
-}
-/* }}} */
-
-
-
-/** {{{ int ShowSignal::load_annotation_file( char *ext )
- */
-int ShowSignal::load_annotation_file( char *recordName, char *ext )
-{
-	int retVal;
-	WFDB_Anninfo annoInfoAF;
-	QString pathRecord;
-	QString nameRecord;
-
-
-	QFileInfo pathComponents(recordName);
-	pathRecord = pathComponents.absolutePath();
-	nameRecord = pathComponents.baseName();
-
-	setwfdb( QString("./;;/;%1").arg(pathRecord).toLatin1().data() );
-
-	qDebug() << "wfdbpath = " << getwfdb();
-
-	qDebug() << QString("load_annotation_file(%1,%2)    setenv(DB,%3)").arg(nameRecord).arg(ext).arg(pathRecord);
-
-#define SIMPLE_READ_ANNO
-#ifdef SIMPLE_READ_ANNO
-	annoInfoAF.name = ext;
-	annoInfoAF.stat = WFDB_READ;
-	if ( annopen( nameRecord.toLatin1().data(), &annoInfoAF, 1 ) >= 0 ) {
-		m_beats.clear();
-		WFDB_Annotation ann;
-		while ( getann( 0, &ann ) == 0 ) {
-// #define SHOW_ALL_ANNOTATIONS
-#ifdef SHOW_ALL_ANNOTATIONS
-			qDebug() << QString( "DBR: %1  annstr(%2) = %3    aux='%4'" )
-				.arg( mstimstr( ann.time ) )
-				.arg( ( int ) ann.anntyp )
-				.arg( annstr( ann.anntyp ) )
-				.arg( ( char * ) ann.aux )
-				.toLatin1().constData();
-#endif
-            BeatInfo bb( ann.time, ann.anntyp );
-            bb.putSubtype(ann.subtyp);
-            bb.putAnnotationString( ( char * ) ann.aux );
-            m_beats.append( bb );
-		}
-
-		retVal = true;
-
-	} else {
-		retVal = false;
-
-		// qDebug() << QString("load_annotation_file(%1,%2)   ERROR = %3").arg(nameRecord).arg(ext).arg( wfdb_error() );
-	}
-
-#else
-
-	if ( annopen( RECORDNAME, &annoInfoAF, 1 ) >= 0 ) {
-		qDebug() << QString("parse_header()    annopen(%1.%2)").arg(RECORDNAME).arg(annoInfoAF.name);
-		WFDB_Annotation ann;
-		while ( getann( 0, &ann ) == 0 ) {
-
-// #define TRY_OTHER_ANNOTATION_READER
-#ifdef TRY_OTHER_ANNOTATION_READER
-			qDebug() << QString( "%1  annstr(%2) = %3    aux='%4'" )
-				.arg( mstimstr( ann.time ) )
-				.arg( ( int ) ann.anntyp )
-				.arg( annstr( ann.anntyp ) )
-				.arg( ( char * ) &(ann.aux[1]) )
-				.toLatin1().constData();
-#endif
-			switch ( ann.anntyp ) {
-				case NORMAL:
-				case LBBB:
-				case RBBB:
-				case ABERR:
-				case PVC:
-				case NPC:
-				case SVPB:
-				case VESC:
-				case NESC:
-				case PACE:
-				case UNKNOWN:
-					{
-						BeatInfo bb( ann.time, ann.anntyp );
-						bb.putAnnotationString( ( char * ) &(ann.aux[1]) );
-						m_beats.append( bb );
-					}
-					break;
-
-				case FUSION:
-				case APC:
-					{
-						BeatInfo bb( ann.time, NORMAL );
-						bb.putAnnotationString( ( char * ) &(ann.aux[1]) );
-						m_beats.append( bb );
-					}
-					break;
-
-				case NOTE:
-				case RHYTHM:
-				case '"':
-					{
-						static bool g_withinAF = false;
-						QString val((char*)&(ann.aux[1]));
-						int type = RHYTHM;
-
-						if ( QString(val).contains("TACH") ) {
-							qDebug() << val;
-							val = "(SVT";
-							type = 'T';
-						}
-						if ( QString(val).contains("BRAD") ) {
-							qDebug() << val;
-							val = "(SBR";
-							type = 'B';
-						}
-						if ( QString(val).contains("PAUS") ) {
-							qDebug() << val;
-							val = "(PSE";
-							type = 'u';
-						}
-						if ( QString(val).contains("NSR") ) {
-							val = "(N";
-							type = RHYTHM;
-						}
-						if ( QString(val).contains("(N") ) {
-							if ( g_withinAF ) {
-								g_withinAF = false;
-								type = 'a';
-								// qDebug() << "              OFF";
-							}
-						}
-						if ( QString(val).contains("AF") ) {
-							val = "(AFIB";
-							type = 'A';
-							g_withinAF = true;
-							// qDebug() << val;
-						}
-
-						for ( int b = m_beats.size() - 1 ; b >= 0 ; b-- ) {
-							if ( (m_beats.at(b).pos_samps - ann.time) < 5 ) {
-								BeatInfo theBeat( m_beats.at(b) );
-								theBeat.type = type;
-								theBeat.putAnnotationString( ( char * ) val.toLatin1().data() );
-								m_beats.replace(b,theBeat);
-								break;
-							}
-						}
-					}
-					break;
-
-				default:
-					break;
-			}
-		}
-
-	}
-#endif
-
-	return retVal;
+    /* the record keeps the spikes; what is on screen may now be out of date */
+    invalidate_render_cache();
 }
 /* }}} */
 
@@ -470,7 +435,7 @@ qDebug() << event->pos();
         zoom_amount = 1.0;
     }
 
-    update();
+    request_render();
 }
 /* }}} */
 
@@ -480,13 +445,23 @@ qDebug() << event->pos();
 */
 void ShowSignal::mousePressEvent(QMouseEvent *event)
 {
+	if ( (event->buttons() & Qt::LeftButton) && event->y() < OVERVIEW_HEIGHT_PIXELS ) {
+		m_overviewDragging = true;
+		overview_jump( event->x() );
+		lastPos = event->pos();
+		return;
+	}
+
+	if ( event->buttons() & Qt::LeftButton ) {
+		m_pressPos = event->pos();
+	}
 	if ( event->buttons() & Qt::RightButton ) {
 		zoom_amount = 1.0;
-		update();
+		request_render();
 	}
 	if ( event->buttons() & Qt::MidButton ) {
 		display_extra = (display_extra + 1) % COUNT_OF_DISPLAY_EXTRA;
-		update();
+		request_render();
 	}
 
 	lastPos = event->pos();
@@ -505,6 +480,12 @@ void ShowSignal::mouseMoveEvent(QMouseEvent *event)
     int dx = event->x() - lastPos.x();
 	int dy = event->y() - lastPos.y();
 
+	if ( m_overviewDragging && (event->buttons() & Qt::LeftButton) ) {
+		overview_jump( event->x() );
+		lastPos = event->pos();
+		return;
+	}
+
 // qDebug() << "ShowSignal::mouseMoveEvent(" << event->pos();
 
     if ( event->buttons() & Qt::LeftButton ) {
@@ -525,19 +506,49 @@ void ShowSignal::mouseMoveEvent(QMouseEvent *event)
 
         offset -= ROUND2INT( multiplier * (dx) );
         SetPos( offset );
-        update();
+        request_render();
 
     } else if ( event->buttons() & Qt::RightButton ) {
 
 		yOffsetDragged = 0;
-		update();
+		request_render();
 
     } else {
 
         if ( zoom_amount > 1.0 ) {
             m_zoom_x = (float) event->pos().x();
             m_zoom_y = (float) event->pos().y();
-            update();
+            request_render();
+        }
+
+        /* hover readout of the sample under the mouse */
+        int channel = -1;
+        long sample = findClosestDataPointToMousePos( event->pos(), &channel );
+        if ( sample != m_hoverSample || channel != m_hoverChannel ) {
+            m_hoverSample = sample;
+            m_hoverChannel = channel;
+            if ( sample < 0 ) {
+                emit updateHoverText( QString() );
+            } else {
+                /* the value the trace shows: through the display filters once they have got there */
+                qreal value = m_ecgdata->get_data_channel( channel )[sample];
+                QString unfiltered;
+                if ( m_filterConfig != 0 ) {
+                    QVector<quint16> filtered;
+                    if ( m_ecgdata->filtered.window( channel, m_filterConfig, sample, 1, filtered ) ) {
+                        value = filtered[0];
+                    } else {
+                        unfiltered = tr("  (unfiltered)");
+                    }
+                }
+                qreal mV_per_digital_sample = (qreal) m_ecgdata->device_range_mV / (qreal) m_ecgdata->range_per_sample;
+                qreal mV = ( value - m_ecgdata->range_per_sample/2.0 ) * mV_per_digital_sample;
+                emit updateHoverText( QString( tr("Ch %1   %2   %3 mV%4") )
+                        .arg( channel + 1 )
+                        .arg( m_ecgdata->viewableDateTime.addMSecs( (qint64) sample * 1000 / m_ecgdata->samps_per_chan_per_sec ).toString("hh:mm:ss.zzz") )
+                        .arg( mV, 0, 'f', 3 )
+                        .arg( unfiltered ) );
+            }
         }
 
 #ifdef QT_DEBUG
@@ -550,6 +561,36 @@ void ShowSignal::mouseMoveEvent(QMouseEvent *event)
 /* }}} */
 
 
+/** {{{ void ShowSignal::mouseReleaseEvent(QMouseEvent *event)
+    @brief Mouse release event
+*/
+void ShowSignal::mouseReleaseEvent(QMouseEvent *event)
+{
+	/* a left click that did not drag the strip picks a beat, or with shift a range */
+	if ( ! m_overviewDragging && event->button() == Qt::LeftButton
+			&& ( event->pos() - m_pressPos ).manhattanLength() < QApplication::startDragDistance() ) {
+		select_at( event->pos(), event->modifiers() & Qt::SHIFT );
+	}
+
+	m_overviewDragging = false;
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::leaveEvent( QEvent *event )
+    @brief Clear the hover readout once the mouse is gone
+*/
+void ShowSignal::leaveEvent( QEvent *event )
+{
+    Q_UNUSED(event);
+
+    m_hoverSample = -1;
+    m_hoverChannel = -1;
+    emit updateHoverText( QString() );
+}
+/* }}} */
+
+
 
 
 /** {{{ void ShowSignal::keyPressEvent( QKeyEvent &event)
@@ -584,110 +625,45 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 	}
 
 
+	if ( ( event->modifiers() & Qt::CTRL ) && relabel_selection( event->key() ) ) {
+		return;
+	}
+
 	switch ( key ) {
 
 		case 'D':
 		case 'd':
 		case 127:
 		case Qt::Key_Delete:
+			delete_selection();
 			break;
 
-		case 'n': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
-
-					  int b = middle_beat_showing() + 1;
-					  if ( b < m_beats.size() ) {
-						  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-					  }
-				  }
-				  break;
-
-		case 'N': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
-
-					  int b = middle_beat_showing() - 1;
-					  if ( b > 0 ) {
-						  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-					  }
-				  }
-				  break;
-
-
-		case 'v': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
+		case Qt::Key_Insert:
+			insert_at_selection();
+			break;
 
-					  /* TODO: this linear search is slow */
-					  for ( int b = middle_beat_showing() + 1 ; b < m_beats.size() ; b++ ) {
-						  if ( m_beats[b].type == PVC ) {
-							  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-							  break;
-						  }
-					  }
-				  }
+		case 'n':
+		case 'N':
+		case 'v':
+		case 'V':
+		case 'u':
+		case 'U':
+		case '[':
+		case ']':
+				  offset = jump_target( key, offset );
 				  break;
 
-		case 'V': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
-
-					  /* TODO: this linear search is slow */
-					  for ( int b = middle_beat_showing() - 1 ; b > 0 ; b-- ) {
-						  if ( m_beats[b].type == PVC ) {
-							  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-							  break;
-						  }
-					  }
-				  }
+		case 'e':
+		case 'E':
+				  offset = jump_target( key, offset );
+				  show_episode_status( offset );
 				  break;
 
-
-		case 'u': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
-
-					  /* TODO: this linear search is slow */
-					  for ( int b = middle_beat_showing() + 1 ; b < m_beats.size() ; b++ ) {
-						  if ( m_beats[b].type == 'u' ) {
-							  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-							  break;
-						  }
-					  }
-				  }
+		case 't':
+				  cycle_navigation_type( +1 );
 				  break;
-
-		case 'U': {
-					  if ( ! m_beats.size() ) {
-						  return;
-					  }
-
-					  long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
-
-					  /* TODO: this linear search is slow */
-					  for ( int b = middle_beat_showing() - 1 ; b > 0 ; b-- ) {
-						  if ( m_beats[b].type == 'u' ) {
-							  offset = m_beats[b].pos_samps - sample_count / 2 - 1;
-							  break;
-						  }
-					  }
-				  }
+		case 'T':
+				  cycle_navigation_type( -1 );
 				  break;
 
 
@@ -700,14 +676,14 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 
 		case Qt::Key_Plus:
 				  gain_mm_per_mV += 1;
-				  update();
+				  request_render();
 				  break;
 		case Qt::Key_Minus:
 				  gain_mm_per_mV -= 1;
 				  if ( gain_mm_per_mV <= 0 ) {
 					  gain_mm_per_mV = 1;
 				  }
-				  update();
+				  request_render();
 				  break;
 
 		case Qt::Key_Left:
@@ -735,18 +711,8 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 
 
 		case 'p':
-				  {
-					  QVector<quint32>::iterator pPacer = qLowerBound( pacerPosition.begin(), pacerPosition.end(), (quint32) (GetPos() + samps_per_sec*ECG_DISPLAY_WINDOW_SIZE_SECONDS/2 + 2) );
-					  offset = *pPacer - samps_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS/2;
-				  }
-				  break;
-
 		case 'P':
-				  {
-					  QVector<quint32>::iterator pPacer = qLowerBound( pacerPosition.begin(), pacerPosition.end(), (quint32) (GetPos() + samps_per_sec*ECG_DISPLAY_WINDOW_SIZE_SECONDS/2 - 2) );
-					  pPacer--;
-					  offset = *pPacer - samps_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS/2;
-				  }
+				  offset = jump_target( key, offset );
 				  break;
 
 
@@ -769,23 +735,19 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 
 		case 'S':
 		case 's':
-				  {
-#ifdef ANTIQUE
-					  static QTimer *smooth_advance_timer = NULL;
-					  if ( smooth_advance_timer == NULL ) {
-						  smooth_advance_timer = new QTimer(this);
-						  QObject::connect( smooth_advance_timer, SIGNAL(timeout()), this, SLOT(smooth_advance()));
-					  }
-					  m_testspeed = ! m_testspeed;
-					  if ( m_testspeed ) {
-						  offset = 0;
-						  smooth_advance_timer->start(SCROLL_CHUNK * 1000/128);
-						  // QTimer::singleShot( 0, this, SLOT(smooth_advance()) );
-					  } else {
-						  smooth_advance_timer->stop();
-					  }
-#endif
+				  if ( m_testspeed ) {
+					  playback_stop();
+				  } else {
+					  playback_start();
 				  }
+				  request_render();
+				  break;
+
+		case '>':
+				  playback_change_speed( +1 );
+				  break;
+		case '<':
+				  playback_change_speed( -1 );
 				  break;
 
 	}
@@ -798,8 +760,15 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 	}
 
 	if ( offset != GetPos() ) {
+		m_lastNavKey = key;
+		m_lastNavDelta = offset - GetPos();
 		SetPos( offset );
-		update();
+		if ( m_testspeed ) {
+			/* keep playing from wherever the user jumped to */
+			m_playbackStartPos = GetPos();
+			m_playbackClock.restart();
+		}
+		request_render();
 	}
 	event->ignore();
 }
@@ -809,6 +778,46 @@ void ShowSignal::keyPressEvent( QKeyEvent * event )
 
 
 
+/** {{{ void ShowSignal::request_render()
+  @brief Ask for the view to be drawn as it is now, at most once per display refresh
+
+  Input handlers only change the view state and call this.  A burst of
+  requests between two frames becomes one frame, which shows whatever the
+  state is by the time it is painted.
+  */
+void ShowSignal::request_render()
+{
+    m_renderStats.requested++;
+
+    /* only what navigation changes; this runs on every input event */
+    PendingView state;
+    state.pos = GetPos();
+    state.zoom = zoom_amount;
+    state.zoomX = m_zoom_x;
+    state.zoomY = m_zoom_y;
+    state.gain = gain_mm_per_mV;
+    if ( m_renderPending ) {
+        m_renderStats.merged++;
+        if ( state != m_renderPendingState ) {
+            m_renderStats.dropped++;
+        }
+        m_renderPendingState = state;
+        return;
+    }
+
+    m_renderPending = true;
+    m_renderPendingState = state;
+
+    qint64 wait = m_frameClock.isValid() ? m_frameMsecs - m_frameClock.elapsed() : 0;
+    if ( wait > 0 ) {
+        m_frameTimer->start( wait );
+    } else {
+        update();
+    }
+}
+/* }}} */
+
+
 /** {{{ ShowSignal::paintEvent()
   @brief  Paint events are sent to widgets that need to update themselves
   */
@@ -818,18 +827,86 @@ void ShowSignal::paintEvent( QPaintEvent * event )
 
     QPainter painter(this);
 
+    if ( m_testspeed ) {
+        /* frames of a running playback are never asked for twice */
+        painter.drawImage( 0, 0, render_view_image( GetPos() ) );
+        m_frameUnfiltered = m_filterIncomplete;
+    } else {
+        RenderKey key = render_cache_key( GetPos() );
+        RenderedView *rendered = m_renderCache.object( key );
+        if ( rendered ) {
+            restore_hit_arrays( rendered );
+            painter.drawImage( 0, 0, rendered->image );
+            m_frameUnfiltered = false;
+        } else {
+            rendered = render_view( GetPos() );
+            painter.drawImage( 0, 0, rendered->image );
+            m_frameUnfiltered = m_filterIncomplete;
+            if ( m_frameUnfiltered ) {
+                /* drawn with some samples unfiltered; not the view to keep */
+                delete rendered;
+            } else {
+                m_renderCache.insert( key, rendered, rendered->image.byteCount() / 1024 );
+            }
+        }
+    }
+
+    /* after a cache hit as well, which does not draw anything */
+    show_pacer_status( GetPos() );
+
+    m_frameTimer->stop();
+    m_frameClock.start();
+    m_renderPending = false;
+    m_renderStats.rendered++;
+
+    /* hand the keyboard back from the toolbar, but only when it has wandered off */
+    if ( ! hasFocus() ) {
+        emit focusChanged();
+    }
+
+    if ( ! m_testspeed ) {
+        prefetch_schedule();
+    }
+}
+/* }}} */
+
+
+/** {{{ QImage ShowSignal::render_view_image( long pos )
+  @brief Render the whole view, as it would appear at pos, into an image the size of the widget
+
+  pos is handed down to the drawing code; the view's own position, and the
+  beats cached for it, are left alone.
+  */
+QImage ShowSignal::render_view_image( long pos )
+{
+    m_filterIncomplete = 0;
+
+    qreal devicePixelRatio = devicePixelRatioF();
+    QImage image( size() * devicePixelRatio, QImage::Format_ARGB32_Premultiplied );
+    image.setDevicePixelRatio( devicePixelRatio );
+    /* everything is sized from the device resolution, so match the widget's */
+    image.setDotsPerMeterX( qRound( logicalDpiX() / 0.0254 ) );
+    image.setDotsPerMeterY( qRound( logicalDpiY() / 0.0254 ) );
+    image.fill( palette().color( backgroundRole() ) );
+
+    QPainter painter( &image );
+
     painter.setFont( QFont("Helvetica",22) );
     if ( m_test_antialiasing ) {
         painter.setRenderHint(QPainter::Antialiasing, true);
     }
 
+    /* the whole record overview sits above the view */
+    ShowOverview( &painter, pos );
+    painter.translate( 0, OVERVIEW_HEIGHT_PIXELS );
+
     /* rescale the window when the window gets resized */
     float pixelSizeWidth = ( 8.0 /* sec */ * 2.5 /* cm */ * (painter.device()->logicalDpiX() / 2.54) );
     float pixelSizeHeight = ( (STRIPHEIGHT_MM + 10) * (painter.device()->logicalDpiY() / 25.4) );
     float scaleOntoScreen = parentWidget()->size().width() / pixelSizeWidth;
 
-    if ( pixelSizeHeight * scaleOntoScreen > parentWidget()->size().height() ) {
-        scaleOntoScreen = parentWidget()->size().height() / pixelSizeHeight;
+    if ( pixelSizeHeight * scaleOntoScreen > parentWidget()->size().height() - OVERVIEW_HEIGHT_PIXELS ) {
+        scaleOntoScreen = (parentWidget()->size().height() - OVERVIEW_HEIGHT_PIXELS) / pixelSizeHeight;
     }
 
     painter.scale( scaleOntoScreen, scaleOntoScreen );
@@ -844,85 +921,422 @@ void ShowSignal::paintEvent( QPaintEvent * event )
         ;
 */
 
-    painter.translate( m_zoom_x, m_zoom_y );
+    painter.translate( m_zoom_x, m_zoom_y - OVERVIEW_HEIGHT_PIXELS );
     painter.scale( zoom_amount, zoom_amount );
-    painter.translate( -m_zoom_x, -m_zoom_y );
+    painter.translate( -m_zoom_x, -(m_zoom_y - OVERVIEW_HEIGHT_PIXELS) );
     // painter.translate( +(m_zoom_x-VIEWWIDTH/2), +(m_zoom_y-VIEWHEIGHT/2) );
 
     switch ( getComboViewTypeIndex() ) {
         case VIEWTYPE_FULL_DISCLOSURE:
-            RenderFullDisclosure( &painter );
+            RenderFullDisclosure( &painter, pos );
             break;
         case VIEWTYPE_8_SECOND_STRIP:
-            Render( &painter );
+            Render( &painter, pos );
             break;
     }
-    emit focusChanged();
+
+    return image;
 }
 /* }}} */
 
 
-/** {{{ void ShowSignal::Render( QPainter dc, QPrinter *printer )
-  @brief Define the repainting behaviour
+/** {{{ RenderedView *ShowSignal::render_view( long pos )
+  @brief Render the view at pos, keeping the traces drawn into it for hit testing
   */
-void ShowSignal::Render( QPainter * dc, QPrinter *printer )
+RenderedView *ShowSignal::render_view( long pos )
 {
-    Q_UNUSED(printer);
-    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
-    ShowData( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, PAGE_MARGIN_TOP );
-    ShowAnnotation( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
-
-    ShowHeader( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling);
+    RenderedView *view = new RenderedView;
+    view->image = render_view_image( pos );
+    save_hit_arrays( view );
+    return view;
 }
 /* }}} */
 
 
-/** {{{ void ShowSignal::RenderStrip( QPainter dc, QPrinter *printer )
-  @brief Define the repainting behaviour
+/** {{{ void ShowSignal::save_hit_arrays( RenderedView *view )
+  @brief Copy the traces last drawn into view (the vectors are shared, not duplicated)
   */
-void ShowSignal::RenderStrip( QPainter * dc, QPrinter *printer )
+void ShowSignal::save_hit_arrays( RenderedView *view )
 {
-    Q_UNUSED(printer);
-    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
-    ShowData( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 1 );
-    ShowAnnotation( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 1 );
-
-    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
-    ShowData( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 2 );
-    ShowAnnotation( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 2 );
-
-    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
-    ShowData( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 3 );
-    ShowAnnotation( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 3 );
-
-    ShowHeader( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling);
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        view->points[ch] = displayPoints[ch];
+        view->samples[ch] = displaySamples[ch];
+        view->transform[ch] = displayTransform[ch];
+    }
 }
 /* }}} */
 
 
-/** {{{ void ShowSignal::RenderFullDisclosure( QPainter * dc, QPrinter *printer )
-  @brief Define the repainting behaviour
+/** {{{ void ShowSignal::restore_hit_arrays( const RenderedView *view )
+  @brief Make the traces of view the ones the mouse is tested against
   */
-void ShowSignal::RenderFullDisclosure( QPainter * dc, QPrinter *printer )
+void ShowSignal::restore_hit_arrays( const RenderedView *view )
 {
-    QPen pen_text = QPen( QColor("black"), 0, Qt::SolidLine, Qt::FlatCap, Qt::MiterJoin );
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        displayPoints[ch] = view->points[ch];
+        displaySamples[ch] = view->samples[ch];
+        displayTransform[ch] = view->transform[ch];
+    }
+}
+/* }}} */
 
-    long sample_count = m_ecgdata->samps_per_chan_per_sec * m_ecgdata->datalen_secs - GetPos();
 
-    /** count how many channels will be displayed */
-    int channelsBeingPrinted = 0;
-    for ( int ch = 0 ; ch < m_ecgdata->channel_count ; ch++ ) {
-        if ( glb_mainwindow->isVisibleChan[ch] ) {
-            channelsBeingPrinted++;
-        }
+/** {{{ RenderKey ShowSignal::render_cache_key( long pos )
+  @brief Everything a rendered view at pos depends on, besides the data itself
+  */
+RenderKey ShowSignal::render_cache_key( long pos )
+{
+    RenderKey key;
+    key.viewType = getComboViewTypeIndex();
+    key.pos = pos;
+    key.width = width();
+    key.height = height();
+    key.devicePixelRatio = devicePixelRatioF();
+    key.zoom = zoom_amount;
+    key.zoomX = m_zoom_x;
+    key.zoomY = m_zoom_y;
+    key.gain = gain_mm_per_mV;
+    key.displayExtra = display_extra;
+    key.antialiasing = m_test_antialiasing;
+    key.visibleChannels = 0;
+    for ( int ch = 0 ; ch < 3 ; ch++ ) {
+        key.visibleChannels |= channel_visible( ch ) << ch;
     }
-    channelsBeingPrinted = 1;
+    key.yOffsetDragged = yOffsetDragged;
+    key.parentWidth = parentWidget()->width();
+    key.parentHeight = parentWidget()->height();
+    key.selectFrom = m_selectFrom;
+    key.selectTo = m_selectTo;
+    key.filterConfig = m_filterConfig;
+    return key;
+}
+/* }}} */
 
-    int device_dots_per_mm = ROUND2INT( dc->device()->logicalDpiY() / 25.4 );
 
-    int yPageTopPos = 10 * device_dots_per_mm;
+/** {{{ void ShowSignal::invalidate_render_cache()
+  @brief Forget all rendered views, e.g. after the annotations changed
+  */
+void ShowSignal::invalidate_render_cache()
+{
+    m_renderCache.clear();
+    m_overview.invalidate();
+    m_prefetchTargets.clear();
+}
+/* }}} */
 
-    double scalingDownSize = 0.93 * 8.0 / 60.0;
+
+/** {{{ void ShowSignal::prefetch_schedule()
+  @brief Predict where the user will go next and start warming up those places
+
+  The candidates are a repeat of the last navigation step, its reverse, the
+  next and previous strips, and the next target of the last jump key.  Their
+  sample pages are touched on a worker thread, and the views themselves are
+  rendered into the cache one at a time whenever the event loop is idle.
+  */
+void ShowSignal::prefetch_schedule()
+{
+    if ( getComboViewTypeIndex() != VIEWTYPE_8_SECOND_STRIP || m_ecgdata->datalen_secs <= 0 ) {
+        return;
+    }
+
+    long pos = GetPos();
+    long window = ECG_DISPLAY_WINDOW_SIZE_SECONDS * m_ecgdata->samps_per_chan_per_sec;
+    QList<long> candidates;
+
+    switch ( m_lastNavKey ) {
+        case 'n':
+        case 'N':
+        case 'v':
+        case 'V':
+        case 'u':
+        case 'U':
+        case '[':
+        case ']':
+        case 'p':
+        case 'P':
+        case 'e':
+        case 'E':
+            candidates << jump_target( m_lastNavKey, pos );
+            break;
+        default:
+            if ( m_lastNavDelta != 0 ) {
+                candidates << pos + m_lastNavDelta << pos - m_lastNavDelta;
+            }
+            break;
+    }
+    candidates << pos + window << pos - window;
+
+    m_prefetchTargets.clear();
+    long lastPos = (m_ecgdata->datalen_secs - ECG_DISPLAY_WINDOW_SIZE_SECONDS) * m_ecgdata->samps_per_chan_per_sec - 1;
+    foreach ( long target, candidates ) {
+        target = qBound( 0L, target, lastPos );
+        if ( target != pos && ! m_prefetchTargets.contains( target ) && ! m_renderCache.contains( render_cache_key( target ) ) ) {
+            m_prefetchTargets.append( target );
+        }
+    }
+
+    if ( m_prefetchTargets.isEmpty() ) {
+        return;
+    }
+    m_prefetchTimer->start( 0 );
+
+    if ( m_prefetchTouch.isRunning() ) {
+        /* still faulting in the last lot; the views are rendered either way */
+        return;
+    }
+
+    /* fault the sample pages in off the GUI thread; touching one sample per page is enough.
+       The pages are the record's mapping, so the record is not released while this runs */
+    QVector<quint16 *> pages;
+    for ( int ch = 0 ; ch < m_ecgdata->channel_count ; ch++ ) {
+        if ( ! m_ecgdata->get_data_channel( ch ) ) {
+            continue;
+        }
+        foreach ( long target, m_prefetchTargets ) {
+            quint16 *chData = m_ecgdata->get( ch, target, window );
+            for ( long i = 0 ; i < window ; i += 4096 / sizeof(quint16) ) {
+                pages.append( chData + i );
+            }
+        }
+    }
+    m_prefetchTouch = QtConcurrent::run( [pages]() {
+        volatile quint32 touched = 0;
+        foreach ( quint16 *page, pages ) {
+            touched += *page;
+        }
+    } );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::prefetch_next()
+  @brief Render one predicted view into the cache while the event loop is idle
+  */
+void ShowSignal::prefetch_next()
+{
+    if ( m_prefetchTargets.isEmpty() || m_testspeed || ! isVisible() ) {
+        return;
+    }
+
+    long target = m_prefetchTargets.takeFirst();
+    RenderKey key = render_cache_key( target );
+
+    if ( ! m_renderCache.contains( key ) ) {
+        /* the visible traces must stay the ones the mouse is tested against */
+        RenderedView visible;
+        save_hit_arrays( &visible );
+
+        RenderedView *view = render_view( target );
+        if ( m_filterIncomplete ) {
+            /* its blocks are being filtered now; it is drawn when it is needed */
+            delete view;
+        } else {
+            m_renderCache.insert( key, view, view->image.byteCount() / 1024 );
+        }
+
+        restore_hit_arrays( &visible );
+    }
+
+    if ( ! m_prefetchTargets.isEmpty() ) {
+        m_prefetchTimer->start( 0 );
+    }
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::ShowOverview( QPainter *dc, long pos )
+  @brief Draw the whole record strip: beat type density, noise, heart rate trend and where the view is
+  */
+void ShowSignal::ShowOverview( QPainter *dc, long pos )
+{
+    if ( ! m_overview.isValid() ) {
+        m_overview.build( m_ecgdata, m_beats, m_ecgdata->pacer );
+    }
+
+    int stripWidth = width();
+    int stripHeight = OVERVIEW_HEIGHT_PIXELS;
+    const QVector<OverviewPixel> &pixels = m_overview.pixels( stripWidth );
+    long totalSamples = m_overview.totalSamples();
+
+    dc->fillRect( 0, 0, stripWidth, stripHeight, QColor("#f4f4f4") );
+    if ( pixels.isEmpty() || totalSamples <= 0 ) {
+        return;
+    }
+
+    /* beat type density, strongest abnormality wins the column */
+    for ( int x = 0 ; x < pixels.size() ; x++ ) {
+        const OverviewPixel &pixel = pixels[x];
+        QColor colour;
+        float fraction = 0;
+        if ( pixel.ventricular > fraction ) {
+            colour = QColor("#e02020");
+            fraction = pixel.ventricular;
+        }
+        if ( pixel.unknown > fraction ) {
+            colour = QColor("#f09000");
+            fraction = pixel.unknown;
+        }
+        if ( pixel.paced > fraction ) {
+            colour = QColor("#2060e0");
+            fraction = pixel.paced;
+        }
+        if ( fraction > 0 ) {
+            colour.setAlpha( 60 + ROUND2INT( 195 * fraction ) );
+            dc->fillRect( x, 0, 1, stripHeight, colour );
+        }
+        if ( pixel.noisy ) {
+            dc->fillRect( x, 0, 1, 4, QColor("#808080") );
+        }
+    }
+
+    /* heart rate trend, 30 to 200 bpm bottom to top, broken where there are no beats */
+    QPen pen_trend( QColor("black"), 1 );
+    pen_trend.setCosmetic( true );
+    dc->setPen( pen_trend );
+    QPolygonF trend;
+    for ( int x = 0 ; x <= pixels.size() ; x++ ) {
+        if ( x < pixels.size() && pixels[x].hr > 0 ) {
+            qreal hr = qBound( 30.0f, pixels[x].hr, 200.0f );
+            trend.append( QPointF( x + 0.5, stripHeight - 2 - (hr - 30) / (200 - 30) * (stripHeight - 6) ) );
+        } else if ( ! trend.isEmpty() ) {
+            dc->drawPolyline( trend );
+            trend.clear();
+        }
+    }
+
+    /* where the view is */
+    long windowSamples = ECG_DISPLAY_WINDOW_SIZE_SECONDS * m_ecgdata->samps_per_chan_per_sec;
+    if ( getComboViewTypeIndex() == VIEWTYPE_FULL_DISCLOSURE ) {
+        windowSamples = totalSamples - pos;
+    }
+    qreal x0 = (qreal) pos * stripWidth / totalSamples;
+    qreal x1 = qMax( x0 + 2, (qreal) (pos + windowSamples) * stripWidth / totalSamples );
+    dc->setPen( QPen( QColor("#203080"), 1 ) );
+    dc->setBrush( QColor(32, 48, 128, 48) );
+    dc->drawRect( QRectF( x0, 0.5, x1 - x0, stripHeight - 1 ) );
+    dc->setBrush( Qt::NoBrush );
+
+    dc->setPen( QPen( QColor("#c8c8c8"), 1 ) );
+    dc->drawLine( 0, stripHeight - 1, stripWidth, stripHeight - 1 );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::overview_jump( int x )
+  @brief Center the view on the part of the record under x in the overview strip
+  */
+void ShowSignal::overview_jump( int x )
+{
+    long totalSamples = m_overview.totalSamples();
+    if ( totalSamples <= 0 || width() <= 0 ) {
+        return;
+    }
+
+    long offset = (long) ( (qreal) qBound( 0, x, width() ) * totalSamples / width() );
+    if ( getComboViewTypeIndex() != VIEWTYPE_FULL_DISCLOSURE ) {
+        offset -= ECG_DISPLAY_WINDOW_SIZE_SECONDS * m_ecgdata->samps_per_chan_per_sec / 2;
+    }
+
+    m_lastNavKey = 0;
+    m_lastNavDelta = 0;
+    SetPos( offset );
+    request_render();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::show_annotation( int index )
+  @brief Center the view on annotation index and select it
+  */
+void ShowSignal::show_annotation( int index )
+{
+    if ( index < 0 || index >= m_beats.size() ) {
+        return;
+    }
+
+    long pos = m_beats.pos( index );
+    long offset = pos;
+    if ( getComboViewTypeIndex() != VIEWTYPE_FULL_DISCLOSURE ) {
+        offset -= ECG_DISPLAY_WINDOW_SIZE_SECONDS * m_ecgdata->samps_per_chan_per_sec / 2;
+    }
+
+    m_selectFrom = m_selectTo = pos;
+    m_lastNavKey = 0;
+    m_lastNavDelta = 0;
+    SetPos( qMax( 0L, offset ) );
+    request_render();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::Render( QPainter dc, long pos, QPrinter *printer )
+  @brief Draw the strip starting at sample pos
+  */
+void ShowSignal::Render( QPainter * dc, long pos, QPrinter *printer )
+{
+    if ( printer ) {
+        ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
+    } else {
+        ShowCachedGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
+    }
+    ShowEpisodes( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
+    if ( ! printer ) {
+        ShowSelection( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
+    }
+    ShowData( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, PAGE_MARGIN_TOP );
+    ShowAnnotation( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP );
+
+    ShowHeader( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling);
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::RenderStrip( QPainter dc, long pos, QPrinter *printer )
+  @brief Define the repainting behaviour
+  */
+void ShowSignal::RenderStrip( QPainter * dc, long pos, QPrinter *printer )
+{
+    Q_UNUSED(printer);
+    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
+    ShowData( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 1 );
+    ShowAnnotation( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 0 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 1 );
+
+    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
+    ShowData( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 2 );
+    ShowAnnotation( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 1 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 2 );
+
+    ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN) );
+    ShowData( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, 0, MM2DEVDOTS(dc,15 + PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN)), 3 );
+    ShowAnnotation( dc, pos, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling, PAGE_MARGIN_TOP + 2 * (STRIPHEIGHT_MM + PAGE_MARGIN_BETWEEN), 3 );
+
+    ShowHeader( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling);
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::RenderFullDisclosure( QPainter * dc, long pos, QPrinter *printer )
+  @brief Draw a minute per line, starting at sample pos
+  */
+void ShowSignal::RenderFullDisclosure( QPainter * dc, long pos, QPrinter *printer )
+{
+    QPen pen_text = QPen( QColor("black"), 0, Qt::SolidLine, Qt::FlatCap, Qt::MiterJoin );
+
+    long sample_count = m_ecgdata->samps_per_chan_per_sec * m_ecgdata->datalen_secs - pos;
+
+    /** count how many channels will be displayed */
+    int channelsBeingPrinted = 0;
+    for ( int ch = 0 ; ch < m_ecgdata->channel_count ; ch++ ) {
+        if ( channel_visible( ch ) ) {
+            channelsBeingPrinted++;
+        }
+    }
+    channelsBeingPrinted = 1;
+
+    int device_dots_per_mm = ROUND2INT( dc->device()->logicalDpiY() / 25.4 );
+
+    int yPageTopPos = 10 * device_dots_per_mm;
+
+    double scalingDownSize = 0.93 * 8.0 / 60.0;
 
     int yDistanceBetweenStrips;
 
@@ -943,8 +1357,6 @@ void ShowSignal::RenderFullDisclosure( QPainter * dc, QPrinter *printer )
 
     qreal baseline_offset = (STRIPHEIGHT_MM * device_dots_per_mm * (0 + 1) / (channelsBeingPrinted + 1)) * scalingDownSize;
 
-    long saveCurrentPos = GetPos();
-
     int yPos = yPageTopPos;
 
     qreal save_gain_mm_per_mV = gain_mm_per_mV;
@@ -961,21 +1373,21 @@ void ShowSignal::RenderFullDisclosure( QPainter * dc, QPrinter *printer )
             }
         }
 
-        SetPos( saveCurrentPos + line * 60 * m_ecgdata->samps_per_chan_per_sec );
+        long linePos = pos + line * 60 * m_ecgdata->samps_per_chan_per_sec;
 
         // ShowGrid( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS*5, STRIPHEIGHT_MM /* mm */, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling );
         // ShowAnnotation( dc, ECG_DISPLAY_WINDOW_SIZE_SECONDS, xScaling, yScaling );
 
         int secondsOfDataToShow = min( 60, sample_count / m_ecgdata->samps_per_chan_per_sec );
 
-        ShowData( dc, 0, secondsOfDataToShow,
+        ShowData( dc, linePos, 0, secondsOfDataToShow,
                 scalingDownSize, scalingDownSize,
                 textrect.width(),
                 yPos + baseline_offset );
 
 
         /* draw the time of the beginning of visible data on the display */
-        int second_pos = GetPos() / m_ecgdata->samps_per_chan_per_sec;
+        int second_pos = linePos / m_ecgdata->samps_per_chan_per_sec;
         QString str = m_ecgdata->viewableDateTime.addSecs(second_pos).toString("hh:mm:ss");
 
         dc->setPen(pen_text);
@@ -990,8 +1402,6 @@ void ShowSignal::RenderFullDisclosure( QPainter * dc, QPrinter *printer )
     }
 
     gain_mm_per_mV = save_gain_mm_per_mV;
-
-    SetPos( saveCurrentPos );
 }
 /* }}} */
 
@@ -1061,14 +1471,53 @@ void ShowSignal::ShowGrid( QPainter * dc, int cols, int height_mm, int ecgSecond
 /* }}} */
 
 
-/** {{{ void ShowSignal::ShowData( QPainter *dc, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots )
+/** {{{ void ShowSignal::ShowCachedGrid( QPainter * dc, int cols, int height_mm, int ecgSeconds, double xScale, double yScale, int y_startpos )
+  @brief Show the grid from an image that is only redrawn when the view geometry changes
+  */
+void ShowSignal::ShowCachedGrid( QPainter * dc, int cols, int height_mm, int ecgSeconds, double xScale, double yScale, int y_startpos )
+{
+    QTransform deviceTransform = dc->combinedTransform();
+    qreal devicePixelRatio = dc->device()->devicePixelRatioF();
+    QSize imageSize = QSize( dc->device()->width(), dc->device()->height() ) * devicePixelRatio;
+
+    if ( m_gridCache.size() != imageSize || m_gridCacheTransform != deviceTransform || m_gridCacheExtra != display_extra ) {
+        m_gridCache = QImage( imageSize, QImage::Format_ARGB32_Premultiplied );
+        m_gridCache.setDevicePixelRatio( devicePixelRatio );
+        /* ShowGrid() sizes everything from the device resolution, so match the widget's */
+        m_gridCache.setDotsPerMeterX( qRound( dc->device()->logicalDpiX() / 0.0254 ) );
+        m_gridCache.setDotsPerMeterY( qRound( dc->device()->logicalDpiY() / 0.0254 ) );
+        m_gridCache.fill( Qt::transparent );
+
+        QPainter gridPainter( &m_gridCache );
+        gridPainter.setRenderHints( dc->renderHints() );
+        gridPainter.setWorldTransform( deviceTransform );
+        ShowGrid( &gridPainter, cols, height_mm, ecgSeconds, xScale, yScale, y_startpos );
+
+        m_gridCacheTransform = deviceTransform;
+        m_gridCacheExtra = display_extra;
+    }
+
+    dc->save();
+    dc->setWorldTransform( QTransform() );
+    dc->drawImage( 0, 0, m_gridCache );
+    dc->restore();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::ShowData( QPainter *dc, long pos, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots )
   @brief Show the ECG data
+
+  When more than one channel is visible on a raster device (the screen or an
+  image), each channel's trace is rasterized concurrently into its own
+  transparent band image and the bands are composited afterwards.  Vector
+  devices such as the PDF printer keep drawing every channel directly.
   */
-void ShowSignal::ShowData( QPainter *dc, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
+void ShowSignal::ShowData( QPainter *dc, long pos, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
 {
     double device_dots_per_mm = (qreal) ( dc->device()->logicalDpiY() / 25.4 ) * Y_SCALE_RATIO;
 
-    int countVisibleChannels = glb_mainwindow->isVisibleChan[0] + glb_mainwindow->isVisibleChan[1] + glb_mainwindow->isVisibleChan[2];
+    int countVisibleChannels = channel_visible( 0 ) + channel_visible( 1 ) + channel_visible( 2 );
     int countVisibleChannelsDisplayed = 0;
 
     if ( countVisibleChannels > m_ecgdata->channel_count ) {
@@ -1076,79 +1525,304 @@ void ShowSignal::ShowData( QPainter *dc, int ecgSeconds, double xScale, double y
     }
 
     /* for each channel */
+    QVector<TraceBand> bands;
     for ( int ch = 0 ; ch < m_ecgdata->channel_count ; ch++ ) {
-        if ( glb_mainwindow->isVisibleChan[ch] ) {
+        if ( channel_visible( ch ) ) {
             countVisibleChannelsDisplayed++;
             qreal baseline_offset = STRIPHEIGHT_MM * device_dots_per_mm * countVisibleChannelsDisplayed / (countVisibleChannels + 1);
-            ShowData( dc, ch, ecgSeconds, xScale, yScale, x_startpos_devicedots, y_startpos_devicedots + baseline_offset * yScale, whichStrip );
+            TraceBand band;
+            band.channel = ch;
+            band.y_startpos_devicedots = y_startpos_devicedots + baseline_offset * yScale;
+            bands.append( band );
+        }
+    }
+
+    bool rasterizeInParallel = ( bands.size() > 1 ) && dc->paintEngine() && ( dc->paintEngine()->type() == QPaintEngine::Raster );
+
+    if ( ! rasterizeInParallel ) {
+        for ( int b = 0 ; b < bands.size() ; b++ ) {
+            ShowData( dc, pos, bands[b].channel, ecgSeconds, xScale, yScale, x_startpos_devicedots, bands[b].y_startpos_devicedots, whichStrip );
+        }
+        return;
+    }
+
+    /* everything the workers need from the painter is gathered here on the GUI thread */
+    double device_dots_per_sec = (qreal) ( dc->device()->logicalDpiX() * 2.5 / 2.54 );
+    double trace_dots_per_mm = (qreal) ( dc->device()->logicalDpiY() / 25.4 );
+    QTransform deviceTransform = dc->combinedTransform();
+    QRect deviceRect( 0, 0, dc->device()->width(), dc->device()->height() );
+    qreal devicePixelRatio = dc->device()->devicePixelRatioF();
+    QPainter::RenderHints renderHints = dc->renderHints();
+    QPen pen_solid = trace_pen();
+
+    QtConcurrent::blockingMap( bands, [&]( TraceBand &band ) {
+        int point_count = build_trace_points( band.channel, pos, ecgSeconds, xScale, yScale, x_startpos_devicedots, band.y_startpos_devicedots, device_dots_per_sec, trace_dots_per_mm, deviceTransform, deviceRect );
+        if ( point_count <= 0 ) {
+            return;
+        }
+
+        /* only allocate the part of the device this trace actually covers */
+        QRectF traceBounds = deviceTransform.mapRect( QPolygonF( displayPoints[band.channel] ).boundingRect() );
+        band.bandRect = traceBounds.toAlignedRect().adjusted( -2, -2, 2, 2 ) & deviceRect;
+        if ( band.bandRect.isEmpty() ) {
+            return;
+        }
+
+        band.image = QImage( band.bandRect.size() * devicePixelRatio, QImage::Format_ARGB32_Premultiplied );
+        band.image.setDevicePixelRatio( devicePixelRatio );
+        band.image.fill( Qt::transparent );
+
+        QPainter painter( &band.image );
+        painter.setRenderHints( renderHints );
+        painter.setWorldTransform( deviceTransform * QTransform::fromTranslate( -band.bandRect.x(), -band.bandRect.y() ) );
+        draw_trace( &painter, band.channel, point_count, pen_solid );
+    } );
+
+    /* composite the bands in device coordinates */
+    dc->save();
+    dc->setWorldTransform( QTransform() );
+    for ( int b = 0 ; b < bands.size() ; b++ ) {
+        if ( ! bands[b].image.isNull() ) {
+            dc->drawImage( bands[b].bandRect.topLeft(), bands[b].image );
+        }
+    }
+    dc->restore();
+
+    if ( display_extra == DISPLAY_EXTRA_ADC_ZERO ) {
+        for ( int b = 0 ; b < bands.size() ; b++ ) {
+            ShowAdcZero( dc, bands[b].channel, ecgSeconds, xScale, yScale, x_startpos_devicedots, bands[b].y_startpos_devicedots );
         }
     }
 }
 /* }}} */
 
 
-/** {{{ void ShowSignal::ShowData( QPainter * dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
+/** {{{ void ShowSignal::ShowData( QPainter * dc, long pos, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
   @brief Show the ECG data
   */
-void ShowSignal::ShowData( QPainter *dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
+void ShowSignal::ShowData( QPainter *dc, long pos, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip )
 {
     Q_UNUSED(whichStrip);
-    int pen_thickness = 0;
+
+    double device_dots_per_sec = (qreal) ( dc->device()->logicalDpiX() * 2.5 / 2.54 );
+    double device_dots_per_mm = (qreal) ( dc->device()->logicalDpiY() / 25.4 );
+
+    QRectF deviceRect( 0, 0, dc->device()->width(), dc->device()->height() );
+
+    int point_count = build_trace_points( whichChannel, pos, ecgSeconds, xScale, yScale, x_startpos_devicedots, y_startpos_devicedots, device_dots_per_sec, device_dots_per_mm, dc->combinedTransform(), deviceRect );
+    if ( point_count > 0 ) {
+        draw_trace( dc, whichChannel, point_count, trace_pen() );
+    }
+
+
+    /* display line depicting ADC Zero (baseline) upon request */
+    if ( display_extra == DISPLAY_EXTRA_ADC_ZERO ) {
+        ShowAdcZero( dc, whichChannel, ecgSeconds, xScale, yScale, x_startpos_devicedots, y_startpos_devicedots );
+    }
+}
+/* }}} */
+
+
+/** {{{ int ShowSignal::build_trace_points( int whichChannel, long pos, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, double device_dots_per_sec, double device_dots_per_mm, const QTransform &deviceTransform, const QRectF &deviceRect )
+  @brief Convert the samples of one channel from pos on into displayPoints[whichChannel]
+
+  Only the samples that land inside deviceRect once deviceTransform (zoom
+  included) is applied are converted.  When several samples fall on one
+  pixel column, the column is reduced to its minimum and maximum sample in
+  the order they occur, so the trace keeps its peaks at any zoom.
+
+  With display filters set the samples come from the record's FilterCache;
+  any not filtered yet are drawn as recorded and m_filterIncomplete is set.
+
+  The trace is centered on the mean of the window, from the record's running
+  sums, and drawn at trace_gain().
+
+  Only touches displayPoints[whichChannel], displayPixelsPerSample[whichChannel]
+  and displayAdcZero[whichChannel] (and m_filterIncomplete, atomically), so one
+  call per channel may run concurrently.
+
+  @return the number of points generated
+  */
+int ShowSignal::build_trace_points( int whichChannel, long pos, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, double device_dots_per_sec, double device_dots_per_mm, const QTransform &deviceTransform, const QRectF &deviceRect )
+{
     double range_per_sample = m_ecgdata->range_per_sample;
     long samples_across_grid = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
     long sample_count = m_ecgdata->samps_per_chan_per_sec * min(ecgSeconds,m_ecgdata->datalen_secs);
 
     if ( sample_count <= 0 ) {
-        return;
+        return 0;
     }
 
-    quint16 *chData = m_ecgdata->get( whichChannel, GetPos(), ecgSeconds * m_ecgdata->samps_per_chan_per_sec );
+    quint16 *chData = m_ecgdata->get( whichChannel, pos, ecgSeconds * m_ecgdata->samps_per_chan_per_sec );
 
-    /** {{{ find DC bias */
-    qreal dcBias = 0.0;
-    for ( int i = 0 ; i < sample_count ; i++ ) {
-        dcBias += (qreal)chData[i];
-    }
-    dcBias /= sample_count;
+    /** {{{ find DC bias, which the trace is centered on */
+    long startSample = chData - m_ecgdata->get_data_channel( whichChannel );
+    qreal dcBias = m_ecgdata->window_mean( whichChannel, startSample, sample_count );
     dcBias -= range_per_sample/2;
     /* }}} */
 
-    double device_dots_per_sec = (qreal) ( dc->device()->logicalDpiX() * 2.5 / 2.54 );
-    double device_dots_per_mm = (qreal) ( dc->device()->logicalDpiY() / 25.4 );
+    /* through the display filters if they have got this far, else as recorded for now */
+    const quint16 *samples = chData;
+    QVector<quint16> filtered;
+    if ( m_filterConfig != 0 ) {
+        if ( m_ecgdata->filtered.window( whichChannel, m_filterConfig, startSample, sample_count, filtered ) ) {
+            samples = filtered.constData();
+            if ( m_filterConfig & FILTER_BASELINE ) {
+                /* the high pass has taken the bias out already */
+                dcBias = 0;
+            }
+        } else {
+            m_filterIncomplete = 1;
+        }
+    }
 
     qreal mV_per_digital_sample = (qreal) m_ecgdata->device_range_mV / (qreal) range_per_sample;
-
-    /* just display a normally colored line for the data at high speed */
+    qreal dots_per_sample = xScale * (device_dots_per_sec * ecgSeconds) / samples_across_grid;
+    qreal dots_per_digital_sample = yScale * device_dots_per_mm * trace_gain( whichChannel, startSample, sample_count ) * mV_per_digital_sample;
+    qreal centre = range_per_sample/2.0 + dcBias;
+    displayAdcZero[whichChannel] = dcBias * dots_per_digital_sample;
+
+    /** {{{ find the samples that are actually on the device */
+    long firstSample = 0;
+    long lastSample = sample_count - 1;
+    qreal pixels_per_sample = dots_per_sample;
+    if ( deviceTransform.isInvertible() && ! deviceRect.isEmpty() ) {
+        QRectF visibleRect = deviceTransform.inverted().mapRect( deviceRect );
+        firstSample = qMax( 0L, (long) floor( (visibleRect.left() - x_startpos_devicedots) / dots_per_sample ) - 1 );
+        lastSample = qMin( sample_count - 1, (long) ceil( (visibleRect.right() - x_startpos_devicedots) / dots_per_sample ) + 1 );
+        pixels_per_sample = QLineF( deviceTransform.map( QPointF( 0, 0 ) ), deviceTransform.map( QPointF( dots_per_sample, 0 ) ) ).length();
+    }
+    displayPixelsPerSample[whichChannel] = pixels_per_sample;
+    displayTransform[whichChannel] = deviceTransform;
+    /* }}} */
 
     displayPoints[whichChannel].clear();
-    for ( int i = 0 ; i < sample_count ; i++ ) {
-        QPointF thisPoint;
-        thisPoint.setX( xScale * (qreal) (i * (device_dots_per_sec * ecgSeconds) / samples_across_grid) + (qreal) x_startpos_devicedots );
-        thisPoint.setY( yScale * (qreal) ( (range_per_sample/2.0 - (qreal)chData[i]) * (device_dots_per_mm * gain_mm_per_mV * mV_per_digital_sample)) + (qreal) y_startpos_devicedots );
-        displayPoints[whichChannel].append( thisPoint );
-        // QQQ("dbg.log") << "ShowSignal::ShowData()      chData[" << i << "] = " << chData[i] << "       yields -> " << thisPoint.y();
+    displaySamples[whichChannel].clear();
+    if ( firstSample > lastSample ) {
+        return 0;
+    }
+
+    if ( pixels_per_sample * TRACE_DECIMATE_SAMPLES_PER_PIXEL >= 1.0 ) {
+        displayPoints[whichChannel].reserve( lastSample - firstSample + 1 );
+        displaySamples[whichChannel].reserve( lastSample - firstSample + 1 );
+        for ( long i = firstSample ; i <= lastSample ; i++ ) {
+            displayPoints[whichChannel].append( QPointF(
+                        (qreal) i * dots_per_sample + (qreal) x_startpos_devicedots,
+                        (centre - (qreal)samples[i]) * dots_per_digital_sample + (qreal) y_startpos_devicedots ) );
+            displaySamples[whichChannel].append( startSample + i );
+        }
+    } else {
+        /** {{{ min/max per pixel column */
+        qreal samples_per_pixel = 1.0 / pixels_per_sample;
+        displayPoints[whichChannel].reserve( 2 * ( (lastSample - firstSample) / samples_per_pixel + 2 ) );
+        for ( long bucketStart = firstSample ; bucketStart <= lastSample ; ) {
+            long column = (long) ( bucketStart / samples_per_pixel );
+            long bucketEnd = qBound( bucketStart, (long) ceil( (column + 1) * samples_per_pixel ) - 1, lastSample );
+
+            long iMin = bucketStart;
+            long iMax = bucketStart;
+            for ( long i = bucketStart + 1 ; i <= bucketEnd ; i++ ) {
+                if ( samples[i] < samples[iMin] ) {
+                    iMin = i;
+                }
+                if ( samples[i] > samples[iMax] ) {
+                    iMax = i;
+                }
+            }
+
+            long iFirst = qMin( iMin, iMax );
+            long iSecond = qMax( iMin, iMax );
+            displayPoints[whichChannel].append( QPointF(
+                        (qreal) iFirst * dots_per_sample + (qreal) x_startpos_devicedots,
+                        (centre - (qreal)samples[iFirst]) * dots_per_digital_sample + (qreal) y_startpos_devicedots ) );
+            displaySamples[whichChannel].append( startSample + iFirst );
+            if ( iSecond != iFirst ) {
+                displayPoints[whichChannel].append( QPointF(
+                            (qreal) iSecond * dots_per_sample + (qreal) x_startpos_devicedots,
+                            (centre - (qreal)samples[iSecond]) * dots_per_digital_sample + (qreal) y_startpos_devicedots ) );
+                displaySamples[whichChannel].append( startSample + iSecond );
+            }
+
+            bucketStart = bucketEnd + 1;
+        }
+        /* }}} */
     }
 
+    return displayPoints[whichChannel].size();
+}
+/* }}} */
+
+
+/** {{{ qreal ShowSignal::trace_gain( int whichChannel, long startSample, long sample_count )
+  @brief The gain to draw a window of a channel at: the one chosen, or with "Auto" one from its variance
+  */
+qreal ShowSignal::trace_gain( int whichChannel, long startSample, long sample_count )
+{
+    if ( gain_mm_per_mV > 0 ) {
+        return gain_mm_per_mV;
+    }
+
+    /* the bands are spaced as ShowData() spaces them */
+    int countVisibleChannels = qMin( channel_visible( 0 ) + channel_visible( 1 ) + channel_visible( 2 ), m_ecgdata->channel_count );
+    qreal band_mm = (qreal) STRIPHEIGHT_MM / ( qMax( 1, countVisibleChannels ) + 1 );
+    return m_ecgdata->window_gain( whichChannel, startSample, sample_count, band_mm / 2 );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::draw_trace( QPainter *dc, int whichChannel, int point_count, const QPen &pen )
+  @brief Draw displayPoints[whichChannel], with a dot on every sample when zoomed in far enough to tell them apart
+  */
+void ShowSignal::draw_trace( QPainter *dc, int whichChannel, int point_count, const QPen &pen )
+{
+    dc->setPen( pen );
+    dc->drawPolyline( displayPoints[whichChannel].constData(), point_count );
+
+    if ( displayPixelsPerSample[whichChannel] >= TRACE_DOTS_PIXELS_PER_SAMPLE ) {
+        QPen pen_dots( pen.color(), 3, Qt::SolidLine, Qt::RoundCap );
+        pen_dots.setCosmetic( true );
+        dc->setPen( pen_dots );
+        dc->drawPoints( displayPoints[whichChannel].constData(), point_count );
+    }
+}
+/* }}} */
+
+
+/** {{{ QPen ShowSignal::trace_pen()
+  @brief Pen used to draw the ECG trace
+  */
+QPen ShowSignal::trace_pen()
+{
+    int pen_thickness = 0;
     QPen pen_solid( QColor("#ff0000"), pen_thickness, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin );
     if ( is_printing ) {
         pen_solid = QPen( QColor("black") );
     }
-
-    dc->setPen(pen_solid);
-    dc->drawPolyline( displayPoints[whichChannel].constData(), sample_count );
+    return pen_solid;
+}
+/* }}} */
 
 
-    /* display line depicting ADC Zero (baseline) upon request */
-    if ( display_extra == DISPLAY_EXTRA_ADC_ZERO ) {
-        dc->setPen( QPen( QColor("blue"), 1, Qt::SolidLine ) );
-        dc->drawLine(
-                xScale * (qreal) (0 * (device_dots_per_sec * ecgSeconds) / samples_across_grid) + x_startpos_devicedots,
-                yScale * (qreal) (0 * (device_dots_per_mm * gain_mm_per_mV * mV_per_digital_sample)) + y_startpos_devicedots,
-                xScale * (qreal) (sample_count * (device_dots_per_sec * ecgSeconds) / samples_across_grid) + x_startpos_devicedots,
-                yScale * (qreal) (0 * (device_dots_per_mm * gain_mm_per_mV * mV_per_digital_sample)) + y_startpos_devicedots
-                );
-    }
+/** {{{ void ShowSignal::ShowAdcZero( QPainter *dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots )
+  @brief Draw the line depicting ADC Zero (baseline) of one channel, as its trace was last built
+  */
+void ShowSignal::ShowAdcZero( QPainter *dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots )
+{
+    y_startpos_devicedots += displayAdcZero[whichChannel];
 
+    long samples_across_grid = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
+    long sample_count = m_ecgdata->samps_per_chan_per_sec * min(ecgSeconds,m_ecgdata->datalen_secs);
+    double device_dots_per_sec = (qreal) ( dc->device()->logicalDpiX() * 2.5 / 2.54 );
+    double device_dots_per_mm = (qreal) ( dc->device()->logicalDpiY() / 25.4 );
+    qreal mV_per_digital_sample = (qreal) m_ecgdata->device_range_mV / (qreal) m_ecgdata->range_per_sample;
+
+    dc->setPen( QPen( QColor("blue"), 1, Qt::SolidLine ) );
+    dc->drawLine(
+            xScale * (qreal) (0 * (device_dots_per_sec * ecgSeconds) / samples_across_grid) + x_startpos_devicedots,
+            yScale * (qreal) (0 * (device_dots_per_mm * gain_mm_per_mV * mV_per_digital_sample)) + y_startpos_devicedots,
+            xScale * (qreal) (sample_count * (device_dots_per_sec * ecgSeconds) / samples_across_grid) + x_startpos_devicedots,
+            yScale * (qreal) (0 * (device_dots_per_mm * gain_mm_per_mV * mV_per_digital_sample)) + y_startpos_devicedots
+            );
 }
 /* }}} */
 
@@ -1185,14 +1859,106 @@ void ShowSignal::ShowHeader( QPainter * dc, int ecgSeconds, double xScale, doubl
             textrect.width(), textrect.height(),
             Qt::AlignVCenter | Qt::AlignRight, str );
 
+    if ( m_testspeed && ! is_printing ) {
+        str = tr("Playback %1x").arg( playbackSpeeds[m_playbackSpeedIndex] );
+
+        textrect = dc->boundingRect( 100, 100, 1000, 1000, Qt::AlignCenter, str );
+        dc->drawText(
+                ROUND2INT(xScale * device_dots_per_sec * ecgSeconds / 2) - textrect.width() / 2,
+                ROUND2INT(yScale * device_dots_per_mm * STRIPHEIGHT_MM ),
+                textrect.width(), textrect.height(),
+                Qt::AlignCenter, str );
+    }
 }
 /* }}} */
 
 
-/** {{{ void ShowSignal::ShowAnnotation( QPainter * dc, int ecgSeconds, double xScale, double yScale, int y_startpos, int whichStrip )
+/** {{{ void ShowSignal::ShowEpisodes( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos )
+  @brief Shade the episodes that overlap the strip, under the trace
+  */
+void ShowSignal::ShowEpisodes( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos )
+{
+    static const char *colours[] = { "#ffd0d0", "#d0d8ff", "#d0f0d0", "#fff0c0", "#f0d0ff", "#d0f0f0" };
+
+    const EpisodeIndex &episodes = m_ecgdata->episodes;
+    if ( episodes.kindCount() == 0 ) {
+        return;
+    }
+
+    double device_dots_per_sec = dc->device()->logicalDpiX() * 2.5 / 2.54;
+    double device_dots_per_mm = dc->device()->logicalDpiY() / 25.4;
+    long sample_count = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
+    long start = pos;
+
+    int top = ROUND2INT(y_startpos * device_dots_per_mm);
+    int bottom = ROUND2INT(yScale * device_dots_per_mm * STRIPHEIGHT_MM + y_startpos * device_dots_per_mm);
+
+    dc->save();
+    dc->setPen( Qt::NoPen );
+    foreach ( const Episode &episode, episodes.overlapping( start, start + sample_count ) ) {
+        if ( episodes.isBackground( episode.kind ) ) {
+            continue;
+        }
+
+        int x0 = ROUND2INT(xScale * (qMax( episode.start, (qint64) start ) - start) * (device_dots_per_sec * ecgSeconds) / sample_count);
+        int x1 = ROUND2INT(xScale * (qMin( episode.end, (qint64) start + sample_count ) - start) * (device_dots_per_sec * ecgSeconds) / sample_count);
+        QColor colour( colours[ episode.kind % (sizeof(colours) / sizeof(colours[0])) ] );
+        if ( is_printing ) {
+            colour = colour.darker( 110 );
+        }
+        colour.setAlpha( 128 );
+        dc->fillRect( x0, top, x1 - x0, bottom - top, colour );
+
+        dc->setPen( QPen( colour.darker( 250 ) ) );
+        dc->drawText( x0 + 2, top, qMax( 0, x1 - x0 - 4 ), bottom - top, Qt::AlignTop | Qt::AlignLeft, episodes.kindName( episode.kind ) );
+        dc->setPen( Qt::NoPen );
+    }
+    dc->restore();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::ShowSelection( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos )
+  @brief Mark the selected beat or range, which editing works on
+  */
+void ShowSignal::ShowSelection( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos )
+{
+    if ( m_selectFrom < 0 ) {
+        return;
+    }
+
+    double device_dots_per_sec = dc->device()->logicalDpiX() * 2.5 / 2.54;
+    double device_dots_per_mm = dc->device()->logicalDpiY() / 25.4;
+    long sample_count = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
+    long start = pos;
+
+    long from = qMax( qMin( m_selectFrom, m_selectTo ), start );
+    long to = qMin( qMax( m_selectFrom, m_selectTo ), start + sample_count );
+    if ( to < from ) {
+        return;
+    }
+
+    int top = ROUND2INT(y_startpos * device_dots_per_mm);
+    int bottom = ROUND2INT(yScale * device_dots_per_mm * STRIPHEIGHT_MM + y_startpos * device_dots_per_mm);
+    int x0 = ROUND2INT(xScale * (from - start) * (device_dots_per_sec * ecgSeconds) / sample_count);
+    int x1 = ROUND2INT(xScale * (to - start) * (device_dots_per_sec * ecgSeconds) / sample_count);
+
+    dc->save();
+    if ( m_selectFrom == m_selectTo ) {
+        dc->setPen( QPen( QColor("#3060c0"), 1, Qt::DashLine ) );
+        dc->drawLine( x0, top, x0, bottom );
+    } else {
+        dc->fillRect( x0, top, x1 - x0, bottom - top, QColor( 48, 96, 192, 48 ) );
+    }
+    dc->restore();
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::ShowAnnotation( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos, int whichStrip )
   @brief Show the annotations
   */
-void ShowSignal::ShowAnnotation( QPainter * dc, int ecgSeconds, double xScale, double yScale, int y_startpos, int whichStrip )
+void ShowSignal::ShowAnnotation( QPainter * dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos, int whichStrip )
 {
     QString str;
     QRect textrect;
@@ -1201,11 +1967,14 @@ void ShowSignal::ShowAnnotation( QPainter * dc, int ecgSeconds, double xScale, d
 
     long sample_count = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
 
-    dc->setFont( QFont("Helvetica",8) );
+    m_labelsAnnotation.setDevice( dc->device() );
+    m_labelsRhythm.setDevice( dc->device() );
+
+    dc->setFont( m_labelsAnnotation.font() );
     dc->setPen( QPen() );
 
     /* draw the time of the beginning of visible data on the display */
-    int second_pos = GetPos() / m_ecgdata->samps_per_chan_per_sec;
+    int second_pos = pos / m_ecgdata->samps_per_chan_per_sec;
     if (whichStrip != 0) {
         second_pos = (m_ecgdata->size() * whichStrip / 4) / m_ecgdata->samps_per_chan_per_sec;
     }
@@ -1232,7 +2001,7 @@ void ShowSignal::ShowAnnotation( QPainter * dc, int ecgSeconds, double xScale, d
     /* draw the current gain on the display. */
     str = QString("%1 mm/sec").arg(25);
     str += "    ";
-    str += QString("%1 mm/mV ").arg(gain_mm_per_mV);
+    str += ( gain_mm_per_mV > 0 ) ? QString("%1 mm/mV ").arg(gain_mm_per_mV) : QString("auto gain ");
 
     textrect = dc->boundingRect( 100, 100, 1000, 1000, Qt::AlignVCenter | Qt::AlignRight, str );
     dc->drawText(
@@ -1243,257 +2012,580 @@ void ShowSignal::ShowAnnotation( QPainter * dc, int ecgSeconds, double xScale, d
 
 
     /* {{{ Use a binary search to find the closest position of a paced beat visible on the screen.  Then draw all the pacer positions visible. */
-    textrect = dc->boundingRect( 100, 100, 1000, 1000, Qt::AlignCenter, tr("P") );
-    int fontlinehgt = textrect.height();
-    int fontlongtextwidth = textrect.width();
+    int fontlinehgt = m_labelsAnnotation.textSize( "P" ).height();
+    QStaticText labelPacer = m_labelsAnnotation.text( "P" );
 
-    QVector<quint32>::iterator pPacer = qLowerBound( pacerPosition.begin(), pacerPosition.end(), (quint32) GetPos() );
-    quint32 endPos = GetPos() + ecgSeconds * m_ecgdata->samps_per_chan_per_sec;
+    const PacerIndex &pacer = m_ecgdata->pacer;
+    long endPos = pos + ecgSeconds * m_ecgdata->samps_per_chan_per_sec;
+    int lastPacer = pacer.lowerBound( endPos );
 
-    for ( ; *pPacer < endPos ; pPacer++ ) {
-        long xdiff = *pPacer - GetPos();
+    for ( int p = pacer.lowerBound( pos ) ; p < lastPacer ; p++ ) {
+        long xdiff = pacer.positions()[p] - pos;
         if ( (xdiff > 0) && (xdiff < sample_count) ) {
             xdiff = xScale * xdiff * (device_dots_per_sec * ecgSeconds) / sample_count;
-            dc->drawText( xdiff - fontlongtextwidth, fontlinehgt * 7/8, fontlongtextwidth * 2, fontlinehgt, Qt::AlignCenter, "P" );
+            m_labelsAnnotation.draw( dc, labelPacer, xdiff, fontlinehgt * 7/8, fontlinehgt );
         }
     }
     /* }}} */
 
-    int minutePos = GetPos() / m_ecgdata->samps_per_chan_per_sec / 60;
-    if ( paceBeatsPerMinute[minutePos] > 0 ) {
+    ShowAnnotators( dc, pos, ecgSeconds, xScale );
+
+
+	if ( m_beats.size() == 0 ) {
+		return;
+	}
+
+	QPen penNormal( QColor( "#0000ff" ), 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin );
+
+	dc->setPen( penNormal );
+
+	fontlinehgt = m_labelsAnnotation.textSize( "UNKNOWN" ).height();
+
+	QPen penNoise( QColor( "darkred" ) );
+
+	QPointF lastPtVariance;
+
+	/* the cached first beat is only good for the position being looked at */
+	int firstBeat = ( pos == GetPos() ) ? first_beat_showing() : m_beats.lowerBound( pos );
+	for ( int b = firstBeat ; b < m_beats.size() ; b++ ) {
+		long xdiff = m_beats.pos(b) - pos;
+		if ( xdiff >= sample_count ) {
+			break;
+		}
+		if ( ( xdiff > 0 ) && ( xdiff < sample_count ) ) {
+
+			xdiff = xScale * xdiff * ( device_dots_per_sec * ecgSeconds ) / sample_count;
+
+			int type = m_beats.type( b );
+
+			/** draw beat classification */
+
+			/* draw the beat type */
+			{
+				dc->setPen( ( type == NOISE ) ? penNoise : penNormal );
+				int yPos = fontlinehgt * 1/8;
+				if ( type == RHYTHM ) {
+					yPos += fontlinehgt / 2;
+					dc->setFont( m_labelsRhythm.font() );
+					m_labelsRhythm.draw( dc, beat_label( m_labelsRhythm, type, m_beats.subtype( b ) ), xdiff, yPos, fontlinehgt );
+					dc->setFont( m_labelsAnnotation.font() );
+				} else {
+					m_labelsAnnotation.draw( dc, beat_label( m_labelsAnnotation, type, m_beats.subtype( b ) ), xdiff, yPos, fontlinehgt );
+				}
+				dc->setPen( penNormal );
+			}
+
+			int interval = m_ecgdata->rr.intervalBefore( b );
+
+			/* draw HR */
+			if ( ! m_beats.hasAux( b ) && ( type != PACE ) /* && (type != NOISE) */ && ( interval > 0 ) ) {
+				int hr = ROUND2INT( 60.0 * m_ecgdata->samps_per_chan_per_sec / interval );
+				if ( (unsigned int) hr <= 300 ) {
+					const QStaticText *labelHR = m_labelsAnnotation.find( LABEL_KEY_HR(hr) );
+					if ( labelHR == NULL ) {
+						labelHR = &m_labelsAnnotation.insert( LABEL_KEY_HR(hr), QString::number( hr ) );
+					}
+					m_labelsAnnotation.draw( dc, *labelHR, xdiff, fontlinehgt * 9 / 8, fontlinehgt );
+				}
+
+			}
+			if ( m_beats.hasAux( b ) && ( interval >= 0 ) ) {
+				dc->setPen( ( type == NOISE ) ? penNoise : penNormal );
+				m_labelsAnnotation.draw( dc, m_labelsAnnotation.text( m_beats.aux( b ) ), xdiff, fontlinehgt * 17 / 8, fontlinehgt );
+				dc->setPen( penNormal );
+			}
+		}
+	}
+
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::ShowAnnotators( QPainter * dc, long pos, int ecgSeconds, double xScale )
+  @brief Show each other annotator's labels in a row under the record's, red where they disagree
+  */
+void ShowSignal::ShowAnnotators( QPainter * dc, long pos, int ecgSeconds, double xScale )
+{
+    const QVector<Annotator> &annotators = m_ecgdata->annotators;
+    if ( annotators.isEmpty() ) {
+        return;
+    }
+
+    int device_dots_per_sec = ROUND2INT( dc->device()->logicalDpiX() * 2.5 / 2.54 );
+    long sample_count = m_ecgdata->samps_per_chan_per_sec * ecgSeconds;
+    int fontlinehgt = m_labelsAnnotation.textSize( "UNKNOWN" ).height();
+
+    QPen penAgree( QColor( "#208020" ) );
+    QPen penDisagree( QColor( "#d00000" ) );
+
+    dc->save();
+    dc->setFont( m_labelsAnnotation.font() );
+    for ( int a = 0 ; a < annotators.size() ; a++ ) {
+        const Annotator &annotator = annotators[a];
+        int yPos = fontlinehgt * ( 25 + 8 * a ) / 8;
+
+        dc->setPen( penAgree );
+        dc->drawText( 2, yPos, 200, fontlinehgt, Qt::AlignLeft | Qt::AlignTop, annotator.name );
+
+        for ( int b = annotator.beats.lowerBound( pos + 1 ) ; b < annotator.beats.size() ; b++ ) {
+            long xdiff = annotator.beats.pos( b ) - pos;
+            if ( xdiff >= sample_count ) {
+                break;
+            }
+            xdiff = xScale * xdiff * ( device_dots_per_sec * ecgSeconds ) / sample_count;
+
+            dc->setPen( annotator.comparison.agrees( b ) ? penAgree : penDisagree );
+            m_labelsAnnotation.draw( dc, beat_label( m_labelsAnnotation, annotator.beats.type( b ), annotator.beats.subtype( b ) ), xdiff, yPos, fontlinehgt );
+        }
+    }
+    dc->restore();
+}
+/* }}} */
+
+
+/** {{{ const QStaticText &ShowSignal::beat_label( LabelCache &labels, int type, int subtype )
+  @brief Pre-shaped classification label of a beat, made on first use only
+  */
+const QStaticText &ShowSignal::beat_label( LabelCache &labels, int type, int subtype )
+{
+	const QStaticText *label = labels.find( LABEL_KEY_BEAT(type, subtype) );
+	if ( label == NULL ) {
+		BeatInfo beat( 0, type );
+		beat.putSubtype( subtype );
+		label = &labels.insert( LABEL_KEY_BEAT(type, subtype), beat_classification_name( beat ) );
+	}
+	return *label;
+}
+/* }}} */
+
+
+
+
+
+
+/** {{{ long middle_beat_showing()
+  @brief Middle beat showing
+  */
+long ShowSignal::middle_beat_showing()
+{
+	if ( cached_middle_beat_found < 0 ) {
+		if ( m_beats.isEmpty() ) {
+			return 0;
+		}
+
+		cached_middle_beat_found = middle_beat_at( GetPos() );
+	}
+	return cached_middle_beat_found;
+}
+/* }}} */
+
+
+/** {{{ long ShowSignal::middle_beat_at( long pos )
+  @brief The beat that would be in the middle of the display if it started at pos
+  */
+long ShowSignal::middle_beat_at( long pos )
+{
+	long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
+
+	return findBeatNearPosition( pos + sample_count / 2, SelectiveDirectionCanBeHigher );
+}
+/* }}} */
+
+
+/** {{{ long ShowSignal::jump_target( int key, long fromPos )
+  @brief Where a jump key ('n', 'v', 'u', 'p', 'e' and their capitals, '[' and ']') goes when pressed with the display at fromPos
+  @return the new display position, or fromPos if there is nothing to jump to
+  */
+long ShowSignal::jump_target( int key, long fromPos )
+{
+	long samps_per_sec = m_ecgdata->samps_per_chan_per_sec;
+	long sample_count = samps_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
+	long offset = fromPos;
+
+	switch ( key ) {
+		case 'p':
+		case 'P':
+				  {
+					  const PacerIndex &pacer = m_ecgdata->pacer;
+					  if ( pacer.isEmpty() ) {
+						  break;
+					  }
+					  if ( key == 'p' ) {
+						  int p = pacer.lowerBound( fromPos + sample_count/2 + 2 );
+						  if ( p < pacer.size() ) {
+							  offset = pacer.positions()[p] - sample_count/2;
+						  }
+					  } else {
+						  int p = pacer.lowerBound( fromPos + sample_count/2 - 2 );
+						  if ( p > 0 ) {
+							  offset = pacer.positions()[p - 1] - sample_count/2;
+						  }
+					  }
+				  }
+				  return offset;
+	}
+
+	if ( ! m_beats.size() ) {
+		return offset;
+	}
+
+	if ( key == 'e' || key == 'E' ) {
+		Episode episode;
+		bool found = ( key == 'e' )
+			? m_ecgdata->episodes.nextStart( fromPos + sample_count/2 + 2, &episode )
+			: m_ecgdata->episodes.prevStart( fromPos + sample_count/2 - 2, &episode );
+		if ( found ) {
+			offset = episode.start - sample_count/2;
+		}
+		return offset;
+	}
+
+	int middle = ( fromPos == GetPos() ) ? middle_beat_showing() : middle_beat_at( fromPos );
+
+	switch ( key ) {
+		case 'n': {
+					  int b = middle + 1;
+					  if ( b < m_beats.size() ) {
+						  offset = m_beats.pos(b) - sample_count / 2 - 1;
+					  }
+				  }
+				  break;
+
+		case 'N': {
+					  int b = middle - 1;
+					  if ( b > 0 ) {
+						  offset = m_beats.pos(b) - sample_count / 2 - 1;
+					  }
+				  }
+				  break;
+
+		case 'v':
+		case 'u':
+		case ']': {
+					  int beatType = ( key == 'v' ) ? PVC : ( key == 'u' ) ? 'u' : m_navType;
+
+					  /* with nothing at or after the middle, everything is before it */
+					  int after = ( middle >= 0 ) ? middle : m_beats.size() - 1;
+					  int b = ( key == ']' && beatType == RHYTHM ) ? m_beats.nextOfRhythm( m_navAux, after ) : m_beats.nextOfType( beatType, after );
+					  if ( b >= 0 ) {
+						  offset = m_beats.pos(b) - sample_count / 2 - 1;
+					  }
+				  }
+				  break;
+
+		case 'V':
+		case 'U':
+		case '[': {
+					  int beatType = ( key == 'V' ) ? PVC : ( key == 'U' ) ? 'u' : m_navType;
+
+					  int before = ( middle >= 0 ) ? middle : m_beats.size();
+					  int b = ( key == '[' && beatType == RHYTHM ) ? m_beats.prevOfRhythm( m_navAux, before ) : m_beats.prevOfType( beatType, before );
+					  if ( b >= 0 ) {
+						  offset = m_beats.pos(b) - sample_count / 2 - 1;
+					  }
+				  }
+				  break;
+	}
+
+	return offset;
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::show_pacer_status( long pos )
+  @brief Report the paced beats during the minute the view at pos starts in
+  */
+void ShowSignal::show_pacer_status( long pos )
+{
+    int minutePos = pos / m_ecgdata->samps_per_chan_per_sec / 60;
+    if ( m_ecgdata->pacer.perMinute( minutePos ) > 0 ) {
         emit updatePacerText( QString("%1 Paced Beats during minute %2")
-                .arg( paceBeatsPerMinute[minutePos] )
+                .arg( m_ecgdata->pacer.perMinute( minutePos ) )
                 .arg( minutePos )
                 );
     } else {
         emit updatePacerText(QString());
     }
+}
+/* }}} */
 
 
+/** {{{ long first_beat_showing()
+  @brief First beat showing
+  */
+long ShowSignal::first_beat_showing()
+{
+	if ( first_beat_found < 0 ) {
+		first_beat_found = m_beats.lowerBound( GetPos() );
+	}
+	return first_beat_found;
+}
+/* }}} */
 
 
-	if ( m_beats.size() == 0 ) {
-		return;
-	}
+/** {{{ int ShowSignal::next_beat_of_a_type( int beatIndex, int beatType )
+ */
+int ShowSignal::next_beat_of_a_type( int beatIndex, int beatType )
+{
+	int b = m_beats.nextOfType( beatType, beatIndex );
+	return ( b >= 0 ) ? b : beatIndex;
+}
+/* }}} */
 
-	QPen penNormal( QColor( "#0000ff" ), 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin );
 
-	dc->setPen( penNormal );
+/** {{{ int ShowSignal::prev_beat_of_a_type( int beatIndex, int beatType )
+ */
+int ShowSignal::prev_beat_of_a_type( int beatIndex, int beatType )
+{
+	return m_beats.prevOfType( beatType, beatIndex );
+}
+/* }}} */
 
-	// dc->setFont( QFont("Helvetica",12) );
-	textrect = dc->boundingRect( 100, 100, 1000, 1000, Qt::AlignCenter, tr( "UNKNOWN" ) );
-	fontlinehgt = textrect.height();
-	fontlongtextwidth = textrect.width();
 
-	QPointF lastPtVariance;
+/** {{{ int ShowSignal::next_beat_of_AFRelated( int beatIndex )
+ */
+int ShowSignal::next_beat_of_AFRelated( int beatIndex )
+{
+	static const int afTypes[] = { RHYTHM, 'A', 'a' };
+	int retval = -1;
 
-	for ( int b = first_beat_showing() ; b < m_beats.size() ; b++ ) {
-		long xdiff = m_beats[b].pos_samps - GetPos();
-		if ( xdiff >= sample_count ) {
-			break;
+	for ( unsigned t = 0 ; t < sizeof(afTypes) / sizeof(afTypes[0]) ; t++ ) {
+		int b = m_beats.nextOfType( afTypes[t], beatIndex );
+		if ( b >= 0 && ( retval < 0 || b < retval ) ) {
+			retval = b;
 		}
-		if ( ( xdiff > 0 ) && ( xdiff < sample_count ) ) {
+	}
+	return ( retval >= 0 ) ? retval : beatIndex;
+}
+/* }}} */
 
-			xdiff = xScale * xdiff * ( device_dots_per_sec * ecgSeconds ) / sample_count;
 
-			/** draw beat classification */
+/** {{{ int ShowSignal::prev_beat_of_AFRelated( int beatIndex )
+ */
+int ShowSignal::prev_beat_of_AFRelated( int beatIndex )
+{
+	static const int afTypes[] = { RHYTHM, 'A', 'a' };
+	int retval = 0;
 
-			/* draw the beat type */
-			{
-				dc->save();
-				dc->setPen( penNormal );
-				if ( m_beats[b].type == NOISE ) {
-					dc->setPen( QPen( QColor( "darkred" ) ) );
-				}
-				int yPos = fontlinehgt * 1/8;
-				if ( m_beats[b].type == RHYTHM ) {
-					dc->setFont( QFont("Helvetica",6) );
-					yPos += fontlinehgt / 2;
-				}
-                dc->drawText( xdiff - fontlongtextwidth, yPos, fontlongtextwidth * 2, fontlinehgt, Qt::AlignCenter, beat_classification_name(m_beats[b]));
-				dc->restore();
-			}
+	for ( unsigned t = 0 ; t < sizeof(afTypes) / sizeof(afTypes[0]) ; t++ ) {
+		retval = qMax( retval, m_beats.prevOfType( afTypes[t], beatIndex ) );
+	}
+	return retval;
+}
+/* }}} */
 
-			BeatInfo *lastbeat = previous_beat( b );
 
-			/* draw HR */
-			if ( m_beats[b].annotationString.isEmpty() && ( m_beats[b].type != PACE ) /* && (m_beats[b].type != NOISE) */ && ( lastbeat != NULL ) ) {
-				QString strHR = QString::number( ROUND2INT( 60.0 * m_ecgdata->samps_per_chan_per_sec / ( ( m_beats[b].pos_samps - lastbeat->pos_samps ) ) ) );
-				if ( (unsigned int) strHR.toInt() <= 300 ) {
-					dc->drawText( xdiff - fontlongtextwidth, fontlinehgt * 9 / 8, fontlongtextwidth * 2, fontlinehgt, Qt::AlignCenter, strHR );
-				}
+/** {{{ void ShowSignal::cycle_navigation_type( int steps )
+  @brief Step through the annotation types in the record for '[' and ']' to jump between
 
+  Rhythm changes are stepped through one rhythm at a time rather than as
+  the single RHYTHM type.
+  */
+void ShowSignal::cycle_navigation_type( int steps )
+{
+	QList< QPair<int,quint32> > kinds;
+	foreach ( int type, m_beats.typesPresent() ) {
+		if ( type == RHYTHM ) {
+			foreach ( quint32 auxId, m_beats.rhythmsPresent() ) {
+				kinds.append( qMakePair( type, auxId ) );
 			}
-			if ( ! m_beats[b].annotationString.isEmpty() && ( lastbeat != NULL ) ) {
-				dc->save();
-				dc->setPen( penNormal );
-				if ( m_beats[b].type == NOISE ) {
-					dc->setPen( QPen( QColor( "darkred" ) ) );
-				}
-				dc->drawText( xdiff - fontlongtextwidth, fontlinehgt * 17 / 8, fontlongtextwidth * 2, fontlinehgt, Qt::AlignCenter, m_beats[b].annotationString );
-				dc->restore();
-			}
+		} else {
+			kinds.append( qMakePair( type, (quint32) 0 ) );
 		}
 	}
+	if ( kinds.isEmpty() ) {
+		return;
+	}
 
+	int current = kinds.indexOf( qMakePair( m_navType, ( m_navType == RHYTHM ) ? m_navAux : (quint32) 0 ) );
+	if ( current < 0 ) {
+		current = ( steps > 0 ) ? -1 : 0;
+	}
+	int next = ( current + steps + kinds.size() ) % kinds.size();
+	m_navType = kinds[next].first;
+	m_navAux = kinds[next].second;
+
+	if ( glb_mainwindow ) {
+		qint64 end = m_beats.positions().isEmpty() ? 0 : m_beats.positions().last() + 1;
+		QString name = beat_classification_name( BeatInfo( 0, m_navType ) ).trimmed();
+		int total = m_beats.countOfType( m_navType );
+		int after = m_beats.countOfType( m_navType, GetPos(), end );
+		if ( m_navType == RHYTHM ) {
+			name = m_beats.auxStrings().value( m_navAux ).trimmed();
+			if ( name.startsWith( "(" ) ) {
+				name.remove( 0, 1 );
+			}
+			name = tr("%1 rhythm").arg( name );
+			total = m_beats.countOfRhythm( m_navAux );
+			after = m_beats.countOfRhythm( m_navAux, GetPos(), end );
+		}
+		glb_mainwindow->statusBar()->showMessage( tr("Jumping between %1 annotations with [ and ]  (%2 in the record, %3 after this point)")
+				.arg( name )
+				.arg( total )
+				.arg( after ),
+				5000 );
+	}
 }
 /* }}} */
 
 
 
-
-
-
-
-/** {{{ long middle_beat_showing()
-  @brief Middle beat showing
+/** {{{ void ShowSignal::show_episode_status( long pos )
+  @brief Tell the user about the episode in the middle of the display at pos
   */
-long ShowSignal::middle_beat_showing()
+void ShowSignal::show_episode_status( long pos )
 {
-	if ( cached_middle_beat_found < 0 ) {
-		if ( m_beats.isEmpty() ) {
-			return 0;
-		}
+	if ( ! glb_mainwindow ) {
+		return;
+	}
 
-		long sample_count = m_ecgdata->samps_per_chan_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS;
+	const EpisodeIndex &episodes = m_ecgdata->episodes;
+	long samps_per_sec = qMax( 1, m_ecgdata->samps_per_chan_per_sec );
+	long middle = pos + samps_per_sec * ECG_DISPLAY_WINDOW_SIZE_SECONDS / 2;
 
-		/* linear search for the first beat showing on the screen */
-		cached_middle_beat_found = findBeatNearPosition( GetPos() + sample_count / 2, SelectiveDirectionCanBeHigher );
+	foreach ( const Episode &episode, episodes.overlapping( middle, middle + 1 ) ) {
+		if ( episodes.isBackground( episode.kind ) ) {
+			continue;
+		}
+		glb_mainwindow->statusBar()->showMessage( tr("%1 episode of %2 seconds  (%3 of them, %4% of the record)")
+				.arg( episodes.kindName( episode.kind ) )
+				.arg( (episode.end - episode.start) / samps_per_sec )
+				.arg( episodes.count( episode.kind ) )
+				.arg( episodes.burden( episode.kind ) * 100, 0, 'f', 1 ),
+				5000 );
+		return;
 	}
-	return cached_middle_beat_found;
+	glb_mainwindow->statusBar()->showMessage( tr("No more episodes"), 3000 );
 }
 /* }}} */
 
 
-/** {{{ long first_beat_showing()
-  @brief First beat showing
+/** {{{ void ShowSignal::select_at( QPoint point, bool extend )
+  @brief Select the sample under point, or stretch the selection to it
   */
-long ShowSignal::first_beat_showing()
+void ShowSignal::select_at( QPoint point, bool extend )
 {
-	if ( middle_beat_showing() < 0 ) {
-		return 0;
+	long sample = findClosestDataPointToMousePos( point );
+	if ( sample < 0 ) {
+		m_selectFrom = m_selectTo = -1;
+	} else if ( extend && m_selectFrom >= 0 ) {
+		m_selectTo = sample;
 	} else {
-		if ( m_beats.isEmpty() ) {
-			return 0;
-		}
+		m_selectFrom = m_selectTo = sample;
+	}
+	request_render();
 
-		/* linear backward search for the first beat showing */
-		first_beat_found = 0;
-		for ( int b = middle_beat_showing() ; b > 0 ; b-- ) {
-			if ( m_beats[b].pos_samps < GetPos() ) {
-				first_beat_found = b + 1;	/* this beat is no longer on the display, so use the beat just after this one */
-				break;
-			}
+	if ( glb_mainwindow && m_selectFrom >= 0 ) {
+		if ( m_selectFrom == m_selectTo ) {
+			glb_mainwindow->statusBar()->showMessage( tr("Delete removes the nearest beat, Insert adds one here, Ctrl+N/V/A/F/U/L/R relabels it"), 5000 );
+		} else {
+			glb_mainwindow->statusBar()->showMessage( tr("%1 annotations selected, Ctrl+N/V/A/F/U/L/R relabels the beats among them")
+					.arg( m_beats.lowerBound( qMax( m_selectFrom, m_selectTo ) ) - m_beats.lowerBound( qMin( m_selectFrom, m_selectTo ) ) ),
+					5000 );
 		}
-		return first_beat_found;
 	}
 }
 /* }}} */
 
 
-/** {{{ BeatInfo *ShowSignal::previous_beat( int beatIndex )
- */
-BeatInfo *ShowSignal::previous_beat( int beatIndex )
+/** {{{ bool ShowSignal::relabel_selection( int qtKey )
+  @brief Relabel the selected beat, or every beat in the selected range
+  @return false if qtKey is not a relabelling key or nothing is selected
+  */
+bool ShowSignal::relabel_selection( int qtKey )
 {
-	BeatInfo *retval = NULL;
+	int type;
+	switch ( qtKey ) {
+		case Qt::Key_N:	type = NORMAL;	break;
+		case Qt::Key_V:	type = PVC;		break;
+		case Qt::Key_A:	type = APC;		break;
+		case Qt::Key_F:	type = FUSION;	break;
+		case Qt::Key_U:	type = UNKNOWN;	break;
+		case Qt::Key_L:	type = LBBB;	break;
+		case Qt::Key_R:	type = RBBB;	break;
+		default:
+			return false;
+	}
+	if ( m_selectFrom < 0 ) {
+		return false;
+	}
 
-	while ( --beatIndex >= 0 ) {
-		if ( (m_beats[beatIndex].type != PACE) && (m_beats[beatIndex].type != RHYTHM) ) {
-			retval = &( m_beats[beatIndex] );
-			break;
+	int changed = 0;
+	if ( m_selectFrom == m_selectTo ) {
+		/* the record's beats, which may already be ahead of m_beats by a few edits */
+		int b = findBeatNearPosition( m_ecgdata->beats, m_selectFrom, SelectiveDirectionClosest );
+		if ( b >= 0 && BeatStore::isBeat( m_ecgdata->beats.type( b ) ) && m_ecgdata->edits.relabel( m_ecgdata->beats, b, type ) ) {
+			changed = 1;
 		}
+	} else {
+		changed = m_ecgdata->edits.relabelRange( m_ecgdata->beats, qMin( m_selectFrom, m_selectTo ), qMax( m_selectFrom, m_selectTo ) + 1, type );
 	}
-	return retval;
+
+	if ( changed ) {
+		m_ecgdata->annotations_edited();
+	}
+	if ( glb_mainwindow ) {
+		glb_mainwindow->statusBar()->showMessage( tr("%1 beats relabelled %2").arg( changed ).arg( beat_classification_name( BeatInfo( 0, type ) ).trimmed() ), 3000 );
+	}
+	return true;
 }
 /* }}} */
 
 
-/** {{{ int ShowSignal::next_beat_of_a_type( int beatIndex, int beatType )
- */
-int ShowSignal::next_beat_of_a_type( int beatIndex, int beatType )
+/** {{{ void ShowSignal::delete_selection()
+  @brief Delete the beat nearest the selected sample
+  */
+void ShowSignal::delete_selection()
 {
-	int retval = beatIndex;
+	if ( m_selectFrom < 0 || m_selectFrom != m_selectTo ) {
+		return;
+	}
 
-	for ( int b = beatIndex + 1 ; b < m_beats.size() ; b++ ) {
-		if ( m_beats[b].type == beatType ) {
-			retval = b;
-			break;
-		}
+	if ( m_ecgdata->edits.remove( m_ecgdata->beats, findBeatNearPosition( m_ecgdata->beats, m_selectFrom, SelectiveDirectionClosest ) ) ) {
+		m_ecgdata->annotations_edited();
 	}
-	return retval;
 }
 /* }}} */
 
 
-/** {{{ int ShowSignal::prev_beat_of_a_type( int beatIndex, int beatType )
- */
-int ShowSignal::prev_beat_of_a_type( int beatIndex, int beatType )
+/** {{{ void ShowSignal::insert_at_selection()
+  @brief Add a normal beat at the selected sample
+  */
+void ShowSignal::insert_at_selection()
 {
-	int retval = -1;
-
-	while ( --beatIndex >= 0 ) {
-		if ( m_beats[beatIndex].type == beatType ) {
-			retval = beatIndex;
-			break;
-		}
+	if ( m_selectFrom < 0 || m_selectFrom != m_selectTo ) {
+		return;
 	}
 
-	return retval;
+	if ( m_ecgdata->edits.insert( m_ecgdata->beats, m_selectFrom, NORMAL ) ) {
+		m_ecgdata->annotations_edited();
+	}
 }
 /* }}} */
 
 
-/** {{{ int ShowSignal::next_beat_of_AFRelated( int beatIndex )
+/** {{{ void ShowSignal::undo()
  */
-int ShowSignal::next_beat_of_AFRelated( int beatIndex )
+void ShowSignal::undo()
 {
-	int retval = beatIndex;
-
-	for ( int b = beatIndex + 1 ; b < m_beats.size() ; b++ ) {
-		switch ( m_beats[b].type ) {
-			case RHYTHM:
-			case 'A':
-			case 'a':
-				retval = b;
-				return retval;
-				break;
-
-			case NORMAL:
-			default:
-				break;
-		}
+	if ( m_ecgdata->edits.undo( m_ecgdata->beats ) ) {
+		m_ecgdata->annotations_edited();
 	}
-	return retval;
 }
 /* }}} */
 
 
-/** {{{ int ShowSignal::prev_beat_of_AFRelated( int beatIndex )
+/** {{{ void ShowSignal::redo()
  */
-int ShowSignal::prev_beat_of_AFRelated( int beatIndex )
+void ShowSignal::redo()
 {
-	int retval = 0;
-
-	while ( --beatIndex >= 0 ) {
-		switch ( m_beats[beatIndex].type ) {
-			case RHYTHM:
-			case 'A':
-			case 'a':
-				retval = beatIndex;
-				return retval;
-				break;
-
-			case NORMAL:
-			default:
-				break;
-		}
+	if ( m_ecgdata->edits.redo( m_ecgdata->beats ) ) {
+		m_ecgdata->annotations_edited();
 	}
-	return retval;
 }
 /* }}} */
 
 
-
 /** {{{ int ShowSignal::findBeatNearPosition( int samplePos, int direction = SelectiveDirectionEitherPart );
  * @brief Binary search for a beat.
  * @param samplePos Find closes beat to this sample position.
@@ -1503,97 +2595,53 @@ int ShowSignal::prev_beat_of_AFRelated( int beatIndex )
  */
 int ShowSignal::findBeatNearPosition( int samplePos, int direction )
 {
-	if ( m_beats.count() == 0 ) {
-		return -1;
-	}
+	return findBeatNearPosition( m_beats, samplePos, direction );
+}
+/* }}} */
 
-	// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2").arg(samplePos).arg(m_beats.size());
 
-	int imin = 0;
-	int beatCount = m_beats.count();
-	int imax = beatCount - 1;
+/** {{{ int ShowSignal::findBeatNearPosition( const BeatStore &beats, int samplePos, int direction )
+ * @brief Binary search for a beat in beats, which need not be the view's copy
+ *
+ * Editing looks in the record's own beats: the view's copy is only brought
+ * up to date once the record has reindexed, after a burst of edits.
+ */
+int ShowSignal::findBeatNearPosition( const BeatStore &beats, int samplePos, int direction )
+{
+	int beatCount = beats.size();
+	if ( beatCount == 0 ) {
+		return -1;
+	}
 
-	while ( imax > imin ) {
-		int imid = ( imin + imax ) / 2;
-		int beatVal = m_beats.at( imid ).pos_samps;
+	/* the first beat at or after samplePos */
+	int next = beats.lowerBound( samplePos );
 
-		if ( samplePos < beatVal ) {
-			imax = imid - 1;
-			if ( imax < imin ) {
-				imax = imin;
-			}
-		} else if ( samplePos > beatVal ) {
-			imin = imid + 1;
-			if ( imin > imax ) {
-				imin = imax;
-			}
-		} else {
-			// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imid = %3").arg(samplePos).arg(m_beats.size()).arg(imid);
-			return imid;
-		}
+	if ( next < beatCount && beats.pos( next ) == samplePos ) {
+		return next;
 	}
-	// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imin = %3  imax = %4   pos_samps = %5") .arg(samplePos) .arg(m_beats.size()) .arg(imin) .arg(imax) .arg(m_beats.at(imin).pos_samps) ;
 
-	if ( m_beats.at( imin ).pos_samps == samplePos ) {
-		// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imin = %3").arg(samplePos).arg(m_beats.size()).arg(imin);
-		return imin;
-	}
+	switch ( direction ) {
+		case SelectiveDirectionCanBeHigher:
+			return ( next < beatCount ) ? next : -1;
 
-	if ( direction == SelectiveDirectionCanBeHigher ) {
-		if ( m_beats.at( imin ).pos_samps < samplePos ) {
-			if ( imin + 1 < beatCount ) {
-				// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imin+1 = %3").arg(samplePos).arg(m_beats.size()).arg(imin+1);
-				return imin + 1;
-			} else {
-				// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    -1 A").arg(samplePos).arg(m_beats.size());
-				return -1;
+		case SelectiveDirectionCanBeLower:
+			return next - 1;
+
+		case SelectiveDirectionClosest:
+			if ( next == 0 ) {
+				return 0;
 			}
-		}
-	} else if ( direction == SelectiveDirectionCanBeLower ) {
-		if ( m_beats.at( imin ).pos_samps > samplePos ) {
-			if ( imin > 0 ) {
-				// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imin-1 = %3").arg(samplePos).arg(m_beats.size()).arg(imin-1);
-				return imin - 1;
-			} else {
-				// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    -1 B").arg(samplePos).arg(m_beats.size());
-				return -1;
+			if ( next == beatCount ) {
+				return beatCount - 1;
 			}
-		}
-	} else if ( direction == SelectiveDirectionClosest ) {
-
-		int prevSampleIndex = imin;
-		int nextSampleIndex;
-
-		if ( m_beats.at( imin ).pos_samps > samplePos ) {
-			if ( imin > 0 ) {
-				prevSampleIndex = imin - 1;
-			} else {
-				// qDebug() << QString("findBeatNearPosition(arg(samplePos).arg(m_beats.size()).arg(imin);
-				return imin;
+			if ( ( samplePos - beats.pos( next - 1 ) ) < ( beats.pos( next ) - samplePos ) ) {
+				return next - 1;
 			}
-		}
-
-		nextSampleIndex = prevSampleIndex + 1;
-
-		if ( nextSampleIndex >= m_beats.count() ) {
-			// qDebug() << QString("findBeatNearPosition(arg(samplePos).arg(m_beats.size()).arg(prevSampleIndex);
-			return prevSampleIndex;
-		}
-
-		int prevSample = m_beats.at( prevSampleIndex ).pos_samps;
-		int nextSample = m_beats.at( nextSampleIndex ).pos_samps;
+			return next;
 
-		if ( ( samplePos - prevSample ) < ( nextSample - samplePos ) ) {
-			// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    prevSampleIndex A = %3").arg(samplePos).arg(m_beats.size()).arg(prevSampleIndex);
-			return prevSampleIndex;
-		} else {
-			// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    nextSampleIndex = %3").arg(samplePos).arg(m_beats.size()).arg(nextSampleIndex);
-			return nextSampleIndex;
-		}
+		default:
+			return qMin( next, beatCount - 1 );
 	}
-
-	// qDebug() << QString("findBeatNearPosition(%1,direction)   out of m_beats.size() = %2    imin B = %3").arg(samplePos).arg(m_beats.size()).arg(imin);
-	return imin;
 }
 /* }}} */
 
@@ -1765,46 +2813,158 @@ long ShowSignal::SetPos( long start_time_samps )
 
 
 
-/** {{{ int ShowSignal::findClosestDataPointToMousePos( QPoint mousePt )
+/** {{{ static bool traceXLessThan( const QPointF &a, const QPointF &b )
  */
-int ShowSignal::findClosestDataPointToMousePos( QPoint mousePt )
+static bool traceXLessThan( const QPointF &a, const QPointF &b )
 {
-    float distanceClosest = 1e10;
-    int samplePosClosest = 0;
+    return a.x() < b.x();
+}
+/* }}} */
 
-    for ( int ch = 0 ; ch < m_ecgdata->channel_count ; ch++ ) {
-        for ( int i = 0 ; i < displayPoints[ch].size() ; i++ ) {
-            float thisDistance = ( pow(displayPoints[ch].value(i).x() - mousePt.x(),2) + pow(displayPoints[ch].value(i).y() - mousePt.y(),2) );
+
+/** {{{ long ShowSignal::findClosestDataPointToMousePos( QPoint mousePt, int *channel )
+    @brief Find the sample drawn nearest to a point on the widget
+
+    Each channel's points increase in x, so a binary search finds the ones
+    within HIT_TEST_RADIUS_PIXELS horizontally and only those are measured.
+
+    @return the record sample index, or -1 if no trace is that close; the
+    channel it is on goes to *channel
+ */
+long ShowSignal::findClosestDataPointToMousePos( QPoint mousePt, int *channel )
+{
+    qreal distanceClosest = HIT_TEST_RADIUS_PIXELS * HIT_TEST_RADIUS_PIXELS;
+    long samplePosClosest = -1;
+    int channelClosest = -1;
+
+    for ( int ch = 0 ; ch < CHANNEL_MAX ; ch++ ) {
+        const QVector<QPointF> &points = displayPoints[ch];
+        if ( points.isEmpty() || ! displayTransform[ch].isInvertible() ) {
+            continue;
+        }
+
+        QTransform toTrace = displayTransform[ch].inverted();
+        QPointF mouse = toTrace.map( QPointF( mousePt ) );
+        qreal radius = QLineF( toTrace.map( QPointF( 0, 0 ) ), toTrace.map( QPointF( HIT_TEST_RADIUS_PIXELS, 0 ) ) ).length();
+
+        int lo = qLowerBound( points.constBegin(), points.constEnd(), QPointF( mouse.x() - radius, 0 ), traceXLessThan ) - points.constBegin();
+        int hi = qLowerBound( points.constBegin() + lo, points.constEnd(), QPointF( mouse.x() + radius, 0 ), traceXLessThan ) - points.constBegin();
+        /* the neighbours either side count too, for when samples are further apart than the radius */
+        lo = qMax( 0, lo - 1 );
+        hi = qMin( points.size() - 1, hi );
+
+        for ( int i = lo ; i <= hi ; i++ ) {
+            QPointF delta = displayTransform[ch].map( points[i] ) - QPointF( mousePt );
+            qreal thisDistance = delta.x() * delta.x() + delta.y() * delta.y();
             if ( thisDistance < distanceClosest ) {
-                // qDebug() << i << "  FOUND sample = " << i << "   when comparing  mouse = " << mousePt << "     to   pt = " << displayPoints[0].value(i) << "   with distance = " << thisDistance;
                 distanceClosest = thisDistance;
-                samplePosClosest = i;
+                samplePosClosest = displaySamples[ch][i];
+                channelClosest = ch;
             }
         }
     }
 
-    return ROUND2INT( (float) samplePosClosest * (float) QApplication::desktop()->physicalDpiX() / m_ecgdata->samps_per_chan_per_sec );
+    if ( channel ) {
+        *channel = channelClosest;
+    }
+    return samplePosClosest;
 }
 /* }}} */
 
 
 
 /** {{{ void ShowSignal::smooth_advance()
-    @brief Smooth advance of the ECG data
+    @brief Advance the real time playback by however much time has passed
+
+    The position comes from a monotonic clock rather than from counting timer
+    ticks, so the playback speed does not depend on how long frames take.  When
+    the previous frame has not been painted yet the tick is dropped and the
+    next one catches up.
 */
 void ShowSignal::smooth_advance()
 {
-    if ( m_testspeed ) {
-        SetPos( GetPos() + SCROLL_CHUNK );
-        update();
-        // QTimer::singleShot( 0, this, SLOT(smooth_advance()) );
-    } else {
-        SetPos( GetPos() + SCROLL_CHUNK );
-        update();
+    if ( ! m_testspeed ) {
+        return;
+    }
+    if ( m_renderPending ) {
+        m_playbackFramesSkipped++;
+        return;
+    }
+
+    long samps_per_sec = m_ecgdata->samps_per_chan_per_sec;
+    long lastPos = (m_ecgdata->datalen_secs - ECG_DISPLAY_WINDOW_SIZE_SECONDS) * samps_per_sec - 1;
+    long newPos = m_playbackStartPos + (long) ( (double) m_playbackClock.nsecsElapsed() * playbackSpeeds[m_playbackSpeedIndex] * samps_per_sec / 1e9 );
+
+    if ( newPos >= lastPos ) {
+        SetPos( lastPos );
+        playback_stop();
+        request_render();
+        return;
+    }
+
+    if ( newPos != GetPos() ) {
+        SetPos( newPos );
+        request_render();
+    }
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::playback_start()
+    @brief Start scrolling through the data in real time
+*/
+void ShowSignal::playback_start()
+{
+    if ( m_timer == NULL ) {
+        m_timer = new QTimer(this);
+        m_timer->setTimerType( Qt::PreciseTimer );
+        QObject::connect( m_timer, SIGNAL(timeout()), this, SLOT(smooth_advance()));
+    }
+
+    m_testspeed = true;
+    m_playbackStartPos = GetPos();
+    m_playbackFramesSkipped = 0;
+    m_playbackClock.start();
+    m_timer->start( PLAYBACK_FRAME_MSECS );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::playback_stop()
+*/
+void ShowSignal::playback_stop()
+{
+    if ( m_timer ) {
+        m_timer->stop();
+    }
+    m_testspeed = false;
+
+#ifdef QT_DEBUG
+    qDebug() << "playback stopped after skipping" << m_playbackFramesSkipped << "frames;"
+        << m_renderStats.rendered << "frames drawn for" << m_renderStats.requested << "requests,"
+        << m_renderStats.merged << "merged," << m_renderStats.dropped << "dropped";
+#endif
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::playback_change_speed( int steps )
+    @brief Step through the 1x, 2x, 5x, 10x and 25x playback speeds
+*/
+void ShowSignal::playback_change_speed( int steps )
+{
+    m_playbackSpeedIndex += steps;
+    if ( m_playbackSpeedIndex < 0 ) {
+        m_playbackSpeedIndex = 0;
     }
-    if ( GetPos() > (long) m_ecgdata->size() ) {
-        SetPos( m_ecgdata->size() - m_ecgdata->sample_count() );
+    if ( m_playbackSpeedIndex >= PLAYBACK_SPEED_COUNT ) {
+        m_playbackSpeedIndex = PLAYBACK_SPEED_COUNT - 1;
     }
+
+    /* the new speed applies from here on */
+    m_playbackStartPos = GetPos();
+    m_playbackClock.restart();
+    request_render();
 }
 /* }}} */
 
@@ -1871,10 +3031,13 @@ void ShowSignal::printRender( QPrinter *printer )
     is_printing = true;
     switch ( getComboViewTypeIndex() ) {
         case VIEWTYPE_FULL_DISCLOSURE:
-            RenderFullDisclosure( &painter, printer );
+            {
+                FullDisclosureExporter exporter( m_ecgdata, 0, GetPos(), gain_mm_per_mV );
+                exporter.render( &painter, printer );
+            }
             break;
         case VIEWTYPE_8_SECOND_STRIP:
-            Render( &painter, printer );
+            Render( &painter, GetPos(), printer );
             break;
     }
     is_printing = false;
@@ -1887,11 +3050,26 @@ void ShowSignal::printRender( QPrinter *printer )
 void ShowSignal::printRenderStrip( QPrinter *printer )
 {
     qDebug() << "ShowSignal::printRender()";
+    printRenderStripPages( printer, QVector<long>() << GetPos() );
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::printRenderStripPages( QPrinter * printer, const QVector<long> &positions )
+    @brief Print one page of strips starting at each of positions
+*/
+void ShowSignal::printRenderStripPages( QPrinter *printer, const QVector<long> &positions )
+{
     QPainter painter(printer);
     painter.setRenderHint( QPainter::HighQualityAntialiasing );
 
     is_printing = true;
-    RenderStrip( &painter, printer );
+    for ( int p = 0 ; p < positions.size() ; p++ ) {
+        if ( p > 0 ) {
+            printer->newPage();
+        }
+        RenderStrip( &painter, positions[p], printer );
+    }
     is_printing = false;
 }
 /* }}} */
@@ -1933,6 +3111,14 @@ void ShowSignal::printPDF()
 
     printer.setOutputFormat(QPrinter::PdfFormat);
     printer.setOutputFileName(fileName);
+
+    if ( getComboViewTypeIndex() == VIEWTYPE_FULL_DISCLOSURE ) {
+        if ( ! export_full_disclosure( fileName, &printer ) ) {
+            qDebug() << "PDF export cancelled";
+        }
+        return;
+    }
+
     printer.newPage();
 
     QPainter painter(&printer);
@@ -1940,10 +3126,10 @@ void ShowSignal::printPDF()
     is_printing = true;
     switch ( getComboViewTypeIndex() ) {
         case VIEWTYPE_FULL_DISCLOSURE:
-            RenderFullDisclosure( &painter, &printer );
+            RenderFullDisclosure( &painter, GetPos(), &printer );
             break;
         case VIEWTYPE_8_SECOND_STRIP:
-            Render( &painter, &printer );
+            Render( &painter, GetPos(), &printer );
             break;
     }
     is_printing = false;
@@ -1954,13 +3140,48 @@ void ShowSignal::printPDF()
 /* }}} */
 
 
+/** {{{ bool ShowSignal::export_full_disclosure( const QString &fileName, QPrinter *printer )
+    @brief Write the full disclosure PDF on a worker thread, with progress and cancel
+
+    The page layout and resolution come from printer.  Setting
+    FullDisclosureRasterDpi in the settings rasterizes the rows at that DPI
+    instead of writing them as vectors.
+*/
+bool ShowSignal::export_full_disclosure( const QString &fileName, QPrinter *printer )
+{
+    QSettings settings("Datrix", "DatrixECGViewer");
+
+    FullDisclosureExporter exporter( m_ecgdata, 0, GetPos(), gain_mm_per_mV );
+    exporter.setPageLayout( printer->pageLayout() );
+    exporter.setResolution( printer->resolution() );
+    exporter.setRasterDpi( settings.value( "FullDisclosureRasterDpi", 0 ).toInt() );
+
+    QProgressDialog progress( tr("Exporting full disclosure..."), tr("Cancel"), 0, exporter.rowCount(), this );
+    progress.setWindowModality( Qt::WindowModal );
+    progress.setMinimumDuration( 500 );
+    connect( &exporter, SIGNAL(rowsDone(int)), &progress, SLOT(setValue(int)) );
+    connect( &progress, SIGNAL(canceled()), &exporter, SLOT(cancel()), Qt::DirectConnection );
+
+    QFutureWatcher<bool> watcher;
+    QEventLoop loop;
+    connect( &watcher, SIGNAL(finished()), &loop, SLOT(quit()) );
+    watcher.setFuture( QtConcurrent::run( &exporter, &FullDisclosureExporter::exportPdf, fileName ) );
+    loop.exec();
+
+    progress.reset();
+
+    return watcher.result();
+}
+/* }}} */
+
+
 /** {{{ void ShowSignal::moveLeft()
     @brief Move the ECG data to the left
 */
 void ShowSignal::moveLeft()
 {
     SetPos( GetPos() - 1 * m_ecgdata->samps_per_chan_per_sec );
-    update();
+    request_render();
 }
 /* }}} */
 
@@ -1971,7 +3192,7 @@ void ShowSignal::moveLeft()
 void ShowSignal::moveRight()
 {
     SetPos( GetPos() + 1 * m_ecgdata->samps_per_chan_per_sec );
-    update();
+    request_render();
 }
 /* }}} */
 
@@ -1994,7 +3215,8 @@ void ShowSignal::cancel_data_saving()
 */
 bool ShowSignal::saveAs()
 {
-    QString fileName = QFileDialog::getSaveFileName( this, tr("Save format file as") );
+    QFileInfo record( m_ecgdata->file_name );
+    QString fileName = QFileDialog::getSaveFileName( this, tr("Save annotations as"), record.absolutePath() + "/" + record.baseName() + ".edt" );
 
     if ( fileName.isEmpty() ) {
         return false;
@@ -2006,11 +3228,105 @@ bool ShowSignal::saveAs()
 
 
 /** {{{ bool ShowSignal::save( QString fileName )
+    @brief Save the annotation edits
+
+    Without a file name only the journal next to the record is brought up to
+    date, which usually means appending a few lines.  With one, the edited
+    annotations are written out in full as a new annotation file.
  */
 bool ShowSignal::save( QString fileName )
 {
-    Q_UNUSED(fileName);
-    return true;
+    bool ok;
+    if ( fileName.isEmpty() ) {
+        fileName = m_ecgdata->journal_file_name();
+        ok = m_ecgdata->edits.save( fileName );
+    } else {
+        ok = EcgData::write_annotations( fileName, m_ecgdata->beats, m_ecgdata->samps_per_chan_per_sec );
+    }
+
+    if ( ! ok ) {
+        QMessageBox::warning( this, tr("Save"), tr("Could not write %1").arg( fileName ) );
+    }
+    return ok;
+}
+/* }}} */
+
+
+/** {{{ void ShowSignal::load_annotators()
+    @brief Ask for other annotation files of the record and compare them with its own
+ */
+void ShowSignal::load_annotators()
+{
+    QFileInfo record( m_ecgdata->file_name );
+    QString recordName = EcgData::record_name( m_ecgdata->file_name );
+
+    /* the record's own files, and atr, which is what the others are compared with */
+    QStringList notAnnotators;
+    notAnnotators << "hea" << "dat" << "atr" << BEAT_JOURNAL_SUFFIX << record.suffix().toLower();
+
+    QStringList candidates;
+    foreach ( const QString &file, QDir( record.absolutePath() ).entryList( QStringList() << recordName + ".*", QDir::Files ) ) {
+        if ( ! notAnnotators.contains( QFileInfo( file ).suffix().toLower() ) ) {
+            candidates << file;
+        }
+    }
+    if ( candidates.isEmpty() ) {
+        QMessageBox::information( this, tr("Load annotators"), tr("There are no other annotation files of %1 next to it").arg( recordName ) );
+        return;
+    }
+
+    QStringList files = QFileDialog::getOpenFileNames( this, tr("Load annotators"), record.absolutePath(),
+            tr("Annotation files (%1)").arg( candidates.join( " " ) ) );
+    if ( files.isEmpty() ) {
+        return;
+    }
+
+    /* a name typed into the dialog gets past its filter */
+    QStringList names;
+    QStringList rejected;
+    foreach ( const QString &file, files ) {
+        QFileInfo picked( file );
+        if ( picked.absolutePath() != record.absolutePath() || EcgData::record_name( file ) != recordName
+                || notAnnotators.contains( picked.suffix().toLower() ) ) {
+            rejected << picked.fileName();
+        } else {
+            names << picked.suffix();
+        }
+    }
+    if ( ! rejected.isEmpty() ) {
+        QMessageBox::warning( this, tr("Load annotators"),
+                tr("These are not other annotators of %1 and are left out:\n%2").arg( recordName ).arg( rejected.join( "\n" ) ) );
+    }
+    if ( names.isEmpty() ) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int count = m_ecgdata->load_annotators( names );
+    if ( count < names.size() ) {
+        QMessageBox::warning( this, tr("Load annotators"), tr("Only %1 of the %2 annotation files could be read").arg( count ).arg( names.size() ) );
+    }
+
+    QString summary;
+    QString details;
+    foreach ( const Annotator &annotator, m_ecgdata->annotators ) {
+        if ( names.contains( annotator.name ) ) {
+            summary += tr("%1: Se %2%  +P %3%\n").arg( annotator.name )
+                    .arg( annotator.comparison.sensitivity() * 100, 0, 'f', 2 )
+                    .arg( annotator.comparison.positivePredictivity() * 100, 0, 'f', 2 );
+            details += tr("%1 against atr\n").arg( annotator.name )
+                    + annotator.comparison.report( m_ecgdata->samps_per_chan_per_sec, 200 ) + "\n";
+        }
+    }
+    if ( glb_mainwindow ) {
+        glb_mainwindow->statusBar()->showMessage( tr("Loaded and compared %1 annotators in %2 ms").arg( count ).arg( timer.elapsed() ), 5000 );
+    }
+    if ( count > 0 ) {
+        QMessageBox box( QMessageBox::Information, tr("Beat by beat comparison"), summary, QMessageBox::Ok, this );
+        box.setDetailedText( details );
+        box.exec();
+    }
 }
 /* }}} */
 
@@ -30,8 +30,10 @@
 #include <QtPrintSupport/QPrinter>
 #include <QtPrintSupport/QPrintDialog>
 #include <QtPrintSupport/QPrintPreviewDialog>
-#include "beatinfo.h"
+#include "beatstore.h"
 #include "ecgdata.h"
+#include "labelcache.h"
+#include "overview.h"
 
 // #include "mainwindow.h"	// DEBUG: just used for isVisibleChan[] for now
 
@@ -68,7 +70,20 @@
 
 #define MM2DEVDOTS(dc,x)	((x) * ((float)(dc)->device()->logicalDpiY() / 25.4))
 
-#define SCROLL_CHUNK	(4)
+#define PLAYBACK_FRAME_MSECS	(16)	/**< how often playback looks at the clock */
+#define PLAYBACK_SPEED_COUNT	(5)
+
+#define RENDER_CACHE_KBYTES		(64 * 1024)
+
+#define RENDER_FRAME_MSECS		(16)	/**< frame interval when the screen does not report its refresh rate */
+
+#define TRACE_DECIMATE_SAMPLES_PER_PIXEL	(2)	/**< above this, each pixel column is reduced to its min and max */
+#define TRACE_DOTS_PIXELS_PER_SAMPLE		(4)	/**< at or above this, every sample also gets a dot */
+
+#define OVERVIEW_HEIGHT_PIXELS	(28)	/**< whole record strip above the view */
+
+#define HIT_TEST_RADIUS_PIXELS	(20)	/**< how far from a trace the mouse may be and still point at it */
+
 #define ECG_DISPLAY_WINDOW_SIZE_SECONDS		(8)
 
 #define min(a,b)	( (a) < (b) ? (a) : (b) )
@@ -77,6 +92,114 @@
 #define Y_SCALE_RATIO (1.0)
 
 
+/* {{{ struct TraceBand
+   @brief	One channel's trace rasterized into its own transparent image
+*/
+struct TraceBand
+{
+	int channel;
+	int y_startpos_devicedots;
+	QRect bandRect;		/**< device coordinates covered by image */
+	QImage image;
+};
+/* }}} */
+
+
+/* {{{ struct RenderedView
+   @brief	A finished view, and the traces in it so the mouse can still find them
+*/
+struct RenderedView
+{
+	QImage image;
+	QVector<QPointF> points[CHANNEL_MAX];
+	QVector<long> samples[CHANNEL_MAX];
+	QTransform transform[CHANNEL_MAX];
+};
+/* }}} */
+
+
+/* {{{ struct RenderKey
+   @brief	Everything a rendered view depends on, besides the data itself
+*/
+struct RenderKey
+{
+	int viewType;
+	long pos;
+	int width;
+	int height;
+	qreal devicePixelRatio;
+	float zoom;
+	float zoomX;
+	float zoomY;
+	qreal gain;
+	int displayExtra;
+	bool antialiasing;
+	int visibleChannels;	/**< bit per channel */
+	int yOffsetDragged;
+	int parentWidth;
+	int parentHeight;
+	long selectFrom;
+	long selectTo;
+	quint32 filterConfig;
+
+	bool operator==( const RenderKey &other ) const
+	{
+		return viewType == other.viewType && pos == other.pos
+			&& width == other.width && height == other.height && devicePixelRatio == other.devicePixelRatio
+			&& zoom == other.zoom && zoomX == other.zoomX && zoomY == other.zoomY
+			&& gain == other.gain && displayExtra == other.displayExtra && antialiasing == other.antialiasing
+			&& visibleChannels == other.visibleChannels && yOffsetDragged == other.yOffsetDragged
+			&& parentWidth == other.parentWidth && parentHeight == other.parentHeight
+			&& selectFrom == other.selectFrom && selectTo == other.selectTo && filterConfig == other.filterConfig;
+	}
+	bool operator!=( const RenderKey &other ) const { return ! ( *this == other ); }
+};
+
+inline uint qHash( const RenderKey &key, uint seed = 0 )
+{
+	/* the position changes on nearly every frame, the rest hardly ever */
+	uint h = qHash( (qint64) key.pos, seed );
+	h = h * 31 + qHash( key.zoom ) + qHash( key.zoomX ) * 7 + qHash( key.zoomY ) * 13;
+	h = h * 31 + key.width * 17 + key.height + key.viewType * 3 + key.visibleChannels * 5;
+	h = h * 31 + qHash( key.gain ) + key.filterConfig + key.yOffsetDragged * 11;
+	h = h * 31 + qHash( (qint64) key.selectFrom ) + qHash( (qint64) key.selectTo ) * 3;
+	return h;
+}
+/* }}} */
+
+
+/* {{{ struct PendingView
+   @brief	Where and how big a requested frame is; enough to tell one request from the next
+*/
+struct PendingView
+{
+	long pos;
+	float zoom;
+	float zoomX;
+	float zoomY;
+	qreal gain;
+
+	bool operator!=( const PendingView &other ) const
+	{
+		return pos != other.pos || zoom != other.zoom || zoomX != other.zoomX || zoomY != other.zoomY || gain != other.gain;
+	}
+};
+/* }}} */
+
+
+/* {{{ struct RenderStats
+   @brief	What the render scheduler did with the requests it was given
+*/
+struct RenderStats
+{
+	long requested;		/**< calls to request_render() */
+	long merged;		/**< requests folded into a frame that was already due */
+	long dropped;		/**< view states replaced before they were ever drawn */
+	long rendered;		/**< frames painted */
+};
+/* }}} */
+
+
 /* {{{ class ShowSignal
    @brief	Displays an ECG signal on the screen
 */
@@ -99,7 +222,15 @@ public:
     int getComboViewTypeIndex() { if ( comboViewType ) { return comboViewType->currentIndex(); }; return -1; };
     QComboBox *getComboViewTypeWidget() { return comboViewType; };
 
-	int load_annotation_file( char *recordName, char *ext );
+	void attach_record( EcgData *ecgdata );
+	EcgData *record() { return m_ecgdata; }
+	void show_record_of( ShowSignal *other );
+	bool channel_visible( int ch );
+
+	void request_render();
+	void set_display_filters( quint32 filters );
+	quint32 display_filters() const { return m_filterConfig; }
+	const RenderStats &render_stats() const { return m_renderStats; }
 
 protected:
 	void focusInEvent( QFocusEvent *event );
@@ -117,23 +248,38 @@ protected:
 	float m_zoom_x;
 	float m_zoom_y;
 
-	QVector<quint32> pacerPosition;
-	QHash<int,int> paceBeatsPerMinute;
+	BeatStore m_beats;		/**< the record's beats; shares its storage */
 
-	QList<BeatInfo> m_beats;
+	LabelCache m_labelsAnnotation;
+	LabelCache m_labelsRhythm;
 
 public slots:
 	void mousePressEvent( QMouseEvent *event );
 	void mouseMoveEvent( QMouseEvent *event );
+	void mouseReleaseEvent( QMouseEvent *event );
+	void leaveEvent( QEvent *event );
 	void wheelEvent( QWheelEvent *e );
 	void keyPressEvent( QKeyEvent * event );
 	void setViewType( int newViewType );
 	void printRender( QPrinter * printer );
     void printRenderStrip( QPrinter * printer );
+    void printRenderStripPages( QPrinter * printer, const QVector<long> &positions );
 
 	void smooth_advance();
+	void playback_start();
+	void playback_stop();
+	void playback_change_speed( int steps );
+
+	void pacer_spikes_found();
+
+	void prefetch_next();
+	void filtered_block_ready();
 
-	void store_pacer_position( long samplePos );
+	void annotations_changed();
+	void undo();
+	void redo();
+	void show_annotation( int index );
+	void load_annotators();
 
     void newFile();
     /** @brief Save the file */
@@ -144,6 +290,7 @@ public slots:
     void print();
     void print_strip();
     void printPDF();
+    bool export_full_disclosure( const QString &fileName, QPrinter *printer );
 
 	void cancel_data_saving();
 
@@ -158,6 +305,7 @@ signals:
 	void loading_finished();
 
 	void updatePacerText( QString txt );
+	void updateHoverText( QString txt );
 
 public:
 	EcgData *m_ecgdata;
@@ -175,6 +323,10 @@ public:
 private:
 
 	QVector<QPointF> displayPoints[CHANNEL_MAX];
+	QVector<long> displaySamples[CHANNEL_MAX];		/**< record sample index of each of displayPoints */
+	QTransform displayTransform[CHANNEL_MAX];		/**< maps displayPoints onto the widget */
+	qreal	displayPixelsPerSample[CHANNEL_MAX];	/**< horizontal device pixels between samples in displayPoints */
+	qreal	displayAdcZero[CHANNEL_MAX];	/**< where ADC zero is from the trace's baseline, which is its window's mean */
 
     QString curFile;	// used for MDI
     bool isUntitled;	// used for MDI
@@ -191,25 +343,55 @@ private:
 	int yOffsetDragged;
 
 protected:
-	void Render( QPainter * dc, QPrinter *printer = NULL );
-    void RenderStrip( QPainter * dc, QPrinter *printer = NULL );
-    void RenderFullDisclosure( QPainter * dc, QPrinter *printer = NULL );
+	QImage render_view_image( long pos );
+	RenderedView *render_view( long pos );
+	RenderKey render_cache_key( long pos );
+	void invalidate_render_cache();
+	void prefetch_schedule();
+
+	void ShowOverview( QPainter *dc, long pos );
+	void overview_jump( int x );
+
+	void Render( QPainter * dc, long pos, QPrinter *printer = NULL );
+    void ShowCachedGrid( QPainter *dc, int cols, int height_mm, int ecgSeconds, double xScale, double yScale, int y_startpos );
+    void RenderStrip( QPainter * dc, long pos, QPrinter *printer = NULL );
+    void RenderFullDisclosure( QPainter * dc, long pos, QPrinter *printer = NULL );
     void ShowGrid( QPainter *dc, int cols, int height_mm, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0, int y_startpos = 0  );
-    void ShowData( QPainter *dc, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0, int x_startpos_devicedots = 0, int y_startpos_devicedots = 0, int whichStrip = 0 );
-    void ShowData( QPainter *dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip = 0 );
+    void ShowData( QPainter *dc, long pos, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0, int x_startpos_devicedots = 0, int y_startpos_devicedots = 0, int whichStrip = 0 );
+    void ShowData( QPainter *dc, long pos, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, int whichStrip = 0 );
+    int build_trace_points( int whichChannel, long pos, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots, double device_dots_per_sec, double device_dots_per_mm, const QTransform &deviceTransform, const QRectF &deviceRect );
+    void draw_trace( QPainter *dc, int whichChannel, int point_count, const QPen &pen );
+    QPen trace_pen();
+    void ShowAdcZero( QPainter *dc, int whichChannel, int ecgSeconds, double xScale, double yScale, int x_startpos_devicedots, int y_startpos_devicedots );
+    qreal trace_gain( int whichChannel, long startSample, long sample_count );
     void ShowHeader( QPainter * dc, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0 );
-    void ShowAnnotation( QPainter *dc, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0, int y_startpos = 0, int whichStrip = 0 );
-	int findClosestDataPointToMousePos( QPoint mousePt );
+    void ShowAnnotation( QPainter *dc, long pos, int ecgSeconds = ECG_DISPLAY_WINDOW_SIZE_SECONDS, double xScale = 1.0, double yScale = 1.0, int y_startpos = 0, int whichStrip = 0 );
+    void ShowEpisodes( QPainter *dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos );
+    void ShowSelection( QPainter *dc, long pos, int ecgSeconds, double xScale, double yScale, int y_startpos );
+    void ShowAnnotators( QPainter *dc, long pos, int ecgSeconds, double xScale );
+	long findClosestDataPointToMousePos( QPoint mousePt, int *channel = NULL );
+	void save_hit_arrays( RenderedView *view );
+	void restore_hit_arrays( const RenderedView *view );
     QString beat_classification_name(BeatInfo beat);
+    const QStaticText &beat_label( LabelCache &labels, int type, int subtype );
 
-	BeatInfo *previous_beat( int beatIndex );
 	int next_beat_of_a_type( int beatIndex, int beatType );
 	int prev_beat_of_a_type( int beatIndex, int beatType );
 	int next_beat_of_AFRelated( int beatIndex );
 	int prev_beat_of_AFRelated( int beatIndex );
+	void cycle_navigation_type( int steps );
+	void show_episode_status( long pos );
+	void show_pacer_status( long pos );
+	void select_at( QPoint point, bool extend );
+	bool relabel_selection( int qtKey );
+	void delete_selection();
+	void insert_at_selection();
 	long first_beat_showing();
 	long middle_beat_showing();
+	long middle_beat_at( long pos );
+	long jump_target( int key, long fromPos );
 	int findBeatNearPosition( int samplePos, int direction );
+	static int findBeatNearPosition( const BeatStore &beats, int samplePos, int direction );
 
 	long SetPos( long start_time_samps );
 	long GetPos() { return curpos_samples; };
@@ -230,8 +412,43 @@ public:
     QTimer		*m_timer;
 	long	m_time_ends;
 
-	bool	m_testspeed;
+	bool	m_testspeed;		/**< real time playback is running */
+	QElapsedTimer m_playbackClock;
+	long	m_playbackStartPos;
+	int		m_playbackSpeedIndex;
+	long	m_playbackFramesSkipped;
+
+	/* render scheduling: input only changes the view state, frames are drawn at most once per refresh */
+	QTimer	*m_frameTimer;
+	QElapsedTimer m_frameClock;	/**< since the last frame was painted */
+	int		m_frameMsecs;
+	bool	m_renderPending;
+	PendingView	m_renderPendingState;
+	RenderStats m_renderStats;
+
+	QImage	m_gridCache;		/**< the grid does not move, so playback frames only redraw data and labels */
+	QTransform m_gridCacheTransform;
+	int		m_gridCacheExtra;
+
+	QCache<RenderKey,RenderedView> m_renderCache;	/**< finished views, cost in kbytes */
+	QList<long> m_prefetchTargets;
+	QTimer	*m_prefetchTimer;
+	QFuture<void> m_prefetchTouch;	/**< faulting in the pages of m_prefetchTargets; waited for before the record goes */
+	quint32	m_filterConfig;		/**< FILTER_... display filters, 0 for none */
+	QAtomicInt m_filterIncomplete;	/**< the last view rendered drew some samples unfiltered */
+	bool	m_frameUnfiltered;	/**< ... and so did the frame on screen */
+	int		m_lastNavKey;
+	int		m_navType;			/**< annotation type '[' and ']' jump between */
+	quint32	m_navAux;			/**< ... and when that is RHYTHM, the aux id of the rhythm */
+	long	m_lastNavDelta;
+	RecordOverview m_overview;
+	bool	m_overviewDragging;
+	int		m_hoverChannel;
+	long	m_hoverSample;
 	bool	m_test_antialiasing;
+	QPoint	m_pressPos;
+	long	m_selectFrom;		/**< sample clicked on, -1 for none */
+	long	m_selectTo;			/**< ... and shift-clicked on, the same for a single beat */
 
 };
 /* }}} */